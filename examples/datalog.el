@@ -0,0 +1,26 @@
+% A Datalog program, to be evaluated bottom-up with --datalog.
+edge(a, b).
+edge(b, c).
+edge(c, a).
+edge(c, d).
+node(a).
+node(b).
+node(c).
+node(d).
+node(e).
+% Left recursion, which is derived to a fixpoint by semi-naive evaluation.
+path(X, Y) :- edge(X, Y).
+path(X, Y) :- path(X, Z), edge(Z, Y).
+% Stratified negation.
+unreachable(X) :- node(X), \+ path(a, X).
+% Relations without arguments, derived from rules that do and do not hold.
+connected :- path(a, d).
+cyclic :- path(X, X).
+linked(X) :- edge(X, Y).
+linked(Y) :- edge(X, Y).
+isolated :- unreachable(X), \+ linked(X).
+disconnected :- path(d, X).
+?- path(a, Y).
+?- unreachable(X).
+?- connected, cyclic, isolated.
+?- \+ disconnected.
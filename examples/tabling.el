@@ -0,0 +1,27 @@
+% Tabled predicates, which terminate under left recursion and on cyclic data, where plain resolution would loop.
+:- table path/2.
+:- table even/1.
+:- table odd/1.
+% A cyclic graph: a -> b -> c -> a, with a branch from c to d.
+edge(a, b).
+edge(b, c).
+edge(c, a).
+edge(c, d).
+% Left recursion over the cycle: each node is reachable from a, including a itself.
+path(X, Y) :- path(X, Z), edge(Z, Y).
+path(X, Y) :- edge(X, Y).
+reachable(X) :- path(a, Y), write(X), write(' reaches '), writeln(Y), fail.
+reachable(X).
+?- reachable(a).
+% The same variant is called repeatedly within a query, and is answered from its completed table after the first call.
+?- path(a, d), path(a, d), path(a, a), writeln('a reaches d and a').
+% A variant that has no answers is completed, rather than looping.
+?- \+ path(d, Y), writeln('d reaches nothing').
+% Mutual recursion across subgoals: the nodes an even or odd number of steps from a, which (through the cycle of three) include every node at both parities.
+even(a).
+even(Y) :- odd(X), edge(X, Y).
+odd(Y) :- even(X), edge(X, Y).
+parities(X) :- even(X), write('even: '), writeln(X), fail.
+parities(X) :- odd(X), write('odd: '), writeln(X), fail.
+parities(X).
+?- parities(Y).
@@ -10,14 +10,11 @@ namespace Epilog {
 			if (name.length() > 2 && name[0] == '\'') {
 				// Atoms / Functors.
 				std::string unquoted = name.substr(1, name.length() - 2);
-				pegmatite::StringInput input(unquoted);
-				Parser::EpilogParser parser;
-				pegmatite::ParserDelegate* delegate = reinterpret_cast<pegmatite::ParserDelegate*>(&parser);
-				pegmatite::Context context(input, Parser::EpilogGrammar::get().whitespace, *delegate);
-				if (context.parse_non_term(Parser::EpilogGrammar::get().simpleIdentifier)) {
+				// The quotes are redundant if the atom begins with a simple identifier (after any whitespace), as the grammar would have it.
+				std::string::size_type first = unquoted.find_first_not_of(" \t\n");
+				if (first != std::string::npos && ((unquoted[first] >= 'a' && unquoted[first] <= 'z') || std::string("<>.+-*/=").find(unquoted[first]) != std::string::npos || unquoted.compare(first, 2, "[]") == 0)) {
 					normalised = unquoted;
 				}
-				context.clear_cache();
 			} else if (name.length() == 1 && name[0] == '_') {
 				// Variables.
 				std::string unique = "_" + std::to_string(anonymousIndex ++);
@@ -1,3 +1,4 @@
+#include <atomic>
 #include <iostream>
 #include <list>
 #include <unordered_set>
@@ -14,6 +15,7 @@
 namespace Epilog {
 	namespace Parser {
 		class EpilogParser;
+		class Reader;
 	}
 	
 	namespace AST {
@@ -42,7 +44,7 @@ namespace Epilog {
 		
 		// Dynamic terms are terms that might resolve to terms of different types (for example: compound terms, or numbers) each time they are evaluated. This is used to enable certain runtime modifications to clauses.
 		class DynamicTerm: public Term {
-			static int64_t dynamicID;
+			static std::atomic<int64_t> dynamicID;
 			
 			public:
 			std::string name;
@@ -52,10 +54,13 @@ namespace Epilog {
 			virtual std::list<Instruction*> instructions(std::shared_ptr<TermNode> node, std::unordered_map<std::string, HeapReference>& allocations, bool dependentAllocations, bool argumentTerm) const = 0;
 			
 			DynamicTerm(std::string name, bool usesRegister = true) : name(name), symbol(name + ":" + std::to_string(DynamicTerm::dynamicID ++)), usesRegister(usesRegister) {
-				
+			
 			}
 		};
 		
+		// The number of anonymous variables named so far, each of which is given a unique name.
+		extern uint64_t anonymousIndex;
+		
 		std::string normaliseIdentifierName(std::string);
 		
 		class Identifier: public pegmatite::ASTString {
@@ -115,23 +120,36 @@ namespace Epilog {
 			}
 		};
 		
-		class Clause: public pegmatite::ASTContainer {
+		class Clause: public pegmatite::ASTContainer, public Printable {
 			public:
-			virtual void interpret(Interpreter::Context& context) = 0;
+			// Returns false if the clause was a query that could not be satisfied.
+			virtual bool interpret(Interpreter::Context& context) = 0;
 		};
 		
 		// A collection of clauses.
 		class Clauses: public pegmatite::ASTContainer {
+			friend class Parser::Reader;
 			pegmatite::ASTList<Clause> clauses;
 			
 			public:
-			void interpret(Interpreter::Context& context);
+			bool interpret(Interpreter::Context& context);
+			
+			// Returns whether the collection is a single query, rather than any clause that would change the program.
+			bool isQuery() const;
+			
+			std::string toString() const {
+				std::string text;
+				for (auto& clause : clauses) {
+					text += clause->toString() + "\n";
+				}
+				return text;
+			}
 		};
 		
 		class Variable: public Term {
+			public:
 			pegmatite::ASTChild<VariableIdentifier> name;
 			
-			public:
 			std::string toString() const override {
 				return name;
 			}
@@ -149,7 +167,12 @@ namespace Epilog {
 			pegmatite::ASTPtr<Term, true> tail;
 			
 			std::string toString() const override {
-				return "<temporary list literal>";
+				std::string elements;
+				bool first = true;
+				for (auto& element : elementList->elements) {
+					elements += (!first ? "," : (first = false, "")) + element->toString();
+				}
+				return "[" + elements + (tail != nullptr ? "|" + tail->toString() : "") + "]";
 			}
 		};
 		
@@ -161,7 +184,7 @@ namespace Epilog {
 			pegmatite::ASTChild<StringContent> text;
 			
 			std::string toString() const override {
-				return "<temporary string literal>";
+				return "\"" + text + "\"";
 			}
 		};
 		
@@ -181,24 +204,79 @@ namespace Epilog {
 		};
 		
 		class Fact: public Clause {
+			friend class Parser::Reader;
 			pegmatite::ASTPtr<CompoundTerm> head;
 			
 			public:
-			void interpret(Interpreter::Context& context) override;
+			bool interpret(Interpreter::Context& context) override;
+			
+			std::string toString() const override {
+				return head->toString() + ".";
+			}
 		};
 		
 		class Rule: public Clause {
+			friend class Parser::Reader;
 			pegmatite::ASTPtr<CompoundTerm> head;
 			pegmatite::ASTPtr<Body> body;
 			
 			public:
-			void interpret(Interpreter::Context& context) override;
+			bool interpret(Interpreter::Context& context) override;
+			
+			std::string toString() const override {
+				return head->toString() + ":-" + body->toString() + ".";
+			}
 		};
 		
 		class Query: public Clause {
 			public:
 			pegmatite::ASTPtr<Body> body;
-			void interpret(Interpreter::Context& context) override;
+			bool interpret(Interpreter::Context& context) override;
+			
+			std::string toString() const override {
+				return "?-" + body->toString() + ".";
+			}
+		};
+		
+		class PredicateIndicator: public pegmatite::ASTContainer, public Printable {
+			public:
+			pegmatite::ASTChild<Identifier> name;
+			pegmatite::ASTPtr<Number> arity;
+			
+			std::string toString() const override {
+				return name + "/" + arity->toString();
+			}
+		};
+		
+		class TableDirective: public Clause {
+			friend class Parser::Reader;
+			pegmatite::ASTList<PredicateIndicator> predicates;
+			
+			public:
+			bool interpret(Interpreter::Context& context) override;
+			
+			std::string toString() const override {
+				std::string indicators;
+				bool first = true;
+				for (auto& predicate : predicates) {
+					indicators += (!first ? "," : (first = false, "")) + predicate->toString();
+				}
+				return ":-table " + indicators + ".";
+			}
+		};
+		
+		// Loads the rows of a delimited file as facts of a predicate, without building a syntax tree for any of them.
+		class LoadDirective: public Clause {
+			friend class Parser::Reader;
+			pegmatite::ASTChild<Identifier> file;
+			pegmatite::ASTPtr<PredicateIndicator> predicate;
+			
+			public:
+			bool interpret(Interpreter::Context& context) override;
+			
+			std::string toString() const override {
+				return ":-load_csv(" + file + "," + predicate->toString() + ").";
+			}
 		};
 	}
 }
@@ -0,0 +1,78 @@
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include "batch.hh"
+#include "interpreter.hh"
+
+namespace Epilog {
+	void Batch::addQuery(Instruction::instructionReference startAddress, Instruction::instructionReference endAddress) {
+		queries.push_back(Query { startAddress, endAddress });
+	}
+	
+	bool Batch::execute(unsigned threads) {
+		Runtime& runtime = *Runtime::currentRuntime;
+		runtime.code->shareIndexes();
+		
+		struct Result {
+			std::string output;
+			std::string error;
+			bool succeeded = false;
+			bool finished = false;
+		};
+		std::vector<Result> results(queries.size());
+		std::atomic<std::vector<Query>::size_type> nextQuery(0);
+		std::mutex mutex;
+		std::condition_variable finished;
+		
+		auto work = [&] () {
+			Runtime worker(runtime);
+			Runtime::currentRuntime = &worker;
+			std::ostringstream output;
+			worker.output = &output;
+			for (std::vector<Query>::size_type query; (query = nextQuery ++) < queries.size(); ) {
+				// Queries are independent, so nothing on the heap outlives the query that built it.
+				worker.heap.truncate(0);
+				Result result;
+				try {
+					result.succeeded = AST::executeInstructions(worker, queries[query].startAddress, queries[query].endAddress, nullptr);
+				} catch (const Exception& exception) {
+					result.error = exception.toString();
+				}
+				result.output = output.str();
+				output.str(std::string());
+				result.finished = true;
+				std::lock_guard<std::mutex> lock(mutex);
+				results[query] = std::move(result);
+				finished.notify_all();
+			}
+		};
+		std::vector<std::thread> workers;
+		for (unsigned i = 0; i < std::max(threads, 1U); ++ i) {
+			workers.emplace_back(work);
+		}
+		
+		// The results are written as soon as each, and every query before it, has finished.
+		bool succeeded = true;
+		for (Result& pending : results) {
+			Result result;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				finished.wait(lock, [&pending] { return pending.finished; });
+				result = std::move(pending);
+			}
+			std::cout << result.output;
+			if (!result.error.empty()) {
+				std::cerr << result.error << std::endl;
+			} else {
+				std::cout << (result.succeeded ? "true." : "false.") << std::endl;
+			}
+			succeeded = succeeded && result.succeeded;
+		}
+		for (std::thread& worker : workers) {
+			worker.join();
+		}
+		return succeeded;
+	}
+}
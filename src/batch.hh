@@ -0,0 +1,26 @@
+#pragma once
+
+#include <vector>
+#include "runtime.hh"
+
+namespace Epilog {
+	// Independent queries, which are compiled along with the program they query, and then executed across several threads.
+	// Each thread executes queries on a runtime of its own, and every runtime shares the linked code, which is no longer modified once the queries are executed.
+	class Batch {
+		public:
+		// Records a query of the current runtime.
+		void addQuery(Instruction::instructionReference startAddress, Instruction::instructionReference endAddress);
+		
+		// Executes each recorded query on one of the given number of threads, writing the output of each query, and whether it succeeded, in the order of the queries.
+		// Returns false if any query failed.
+		bool execute(unsigned threads);
+		
+		private:
+		struct Query {
+			Instruction::instructionReference startAddress;
+			Instruction::instructionReference endAddress;
+		};
+		
+		std::vector<Query> queries;
+	};
+}
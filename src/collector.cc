@@ -0,0 +1,170 @@
+#include <bitset>
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "runtime.hh"
+
+namespace Epilog {
+	void GarbageCollector::collect(Runtime& runtime, HeapReference::heapIndex arguments) {
+		auto start = std::chrono::steady_clock::now();
+		Cell* heap = runtime.heap.data();
+		HeapReference::heapIndex size = runtime.heap.size();
+		
+		// The cells outside the heap that may refer to it: the arguments, and the cells of every environment and choice point that may be returned or backtracked to.
+		std::vector<Cell*> roots;
+		std::vector<ChoicePoint*> choicePoints;
+		std::vector<bool> visited(runtime.stateStack.size());
+		auto visitEnvironments = [&] (StateReference::stateIndex index) {
+			while (index != -1UL && !visited[index]) {
+				visited[index] = true;
+				Environment* environment = reinterpret_cast<Environment*>(&runtime.stateStack[index]);
+				for (HeapReference::heapIndex i = 0; i < environment->size; ++ i) {
+					roots.push_back(&environment->variables()[i]);
+				}
+				index = environment->previousEnvironment;
+			}
+		};
+		auto visitChoicePoints = [&] (StateReference::stateIndex index) {
+			while (index != -1UL && !visited[index]) {
+				visited[index] = true;
+				ChoicePoint* choicePoint = reinterpret_cast<ChoicePoint*>(&runtime.stateStack[index]);
+				choicePoints.push_back(choicePoint);
+				for (HeapReference::heapIndex i = 0; i < choicePoint->size; ++ i) {
+					roots.push_back(&choicePoint->arguments()[i]);
+				}
+				visitEnvironments(choicePoint->environment);
+				index = choicePoint->previousChoicePoint;
+			}
+		};
+		visitEnvironments(runtime.topEnvironment);
+		visitChoicePoints(runtime.topChoicePoint);
+		// A negation or catch may restore the frames that were current when it was called, even if they have since been popped.
+		for (const Modifier& modifier : runtime.modifiers) {
+			visitEnvironments(modifier.topEnvironment);
+			visitChoicePoints(modifier.topChoicePoint);
+		}
+		for (HeapReference::heapIndex i = 0; i < arguments && i < runtime.registers.size(); ++ i) {
+			roots.push_back(&runtime.registers[i]);
+		}
+		
+		// Mark every cell reachable from the roots. A structure keeps its functor and each of its arguments.
+		std::vector<uint64_t> marks((size + 63) / 64);
+		std::vector<HeapReference::heapIndex> pending;
+		auto mark = [&] (HeapReference::heapIndex index) {
+			if (index >= size) {
+				throw RuntimeException("Found a reference beyond the top of the heap.", __FILENAME__, __func__, __LINE__);
+			}
+			uint64_t bit = UINT64_C(1) << (index % 64);
+			if (!(marks[index / 64] & bit)) {
+				marks[index / 64] |= bit;
+				pending.push_back(index);
+			}
+		};
+		auto scan = [&] (Cell cell) {
+			switch (cell.tag()) {
+				case Cell::Tag::reference:
+					mark(cell.address());
+					break;
+				case Cell::Tag::structure: {
+					HeapReference::heapIndex functor = cell.address();
+					mark(functor);
+					for (int64_t i = 1; i <= heap[functor].functor().parameters; ++ i) {
+						mark(functor + i);
+					}
+					break;
+				}
+				default:
+					break;
+			}
+		};
+		auto drain = [&] () {
+			while (!pending.empty()) {
+				HeapReference::heapIndex index = pending.back();
+				pending.pop_back();
+				scan(heap[index]);
+			}
+		};
+		for (Cell* root : roots) {
+			scan(*root);
+			drain();
+		}
+		// Trailed cells are reset when backtracking, so they are kept, along with whatever they are bound to until then.
+		for (const HeapReference& reference : runtime.trail) {
+			if (reference.area == StorageArea::heap) {
+				mark(reference.index);
+				drain();
+			}
+		}
+		
+		// Each marked cell moves to the number of marked cells below it, which is found from the count of each preceding block of marks.
+		std::vector<HeapReference::heapIndex> counts(marks.size());
+		HeapReference::heapIndex live = 0;
+		for (std::vector<uint64_t>::size_type block = 0; block < marks.size(); ++ block) {
+			counts[block] = live;
+			live += std::bitset<64>(marks[block]).count();
+		}
+		auto forward = [&] (HeapReference::heapIndex index) {
+			if (index >= size) {
+				return live;
+			}
+			return counts[index / 64] + std::bitset<64>(marks[index / 64] & ((UINT64_C(1) << (index % 64)) - 1)).count();
+		};
+		auto relocate = [&] (Cell& cell) {
+			switch (cell.tag()) {
+				case Cell::Tag::reference:
+					cell = Cell::reference(forward(cell.address()));
+					break;
+				case Cell::Tag::structure:
+					cell = Cell::structure(forward(cell.address()));
+					break;
+				default:
+					break;
+			}
+		};
+		
+		for (Cell* root : roots) {
+			relocate(*root);
+		}
+		// Any other register is overwritten before it is next read, but may refer to a cell that is about to be reclaimed, so it is cleared.
+		for (HeapReference::heapIndex i = arguments; i < runtime.registers.size(); ++ i) {
+			runtime.registers[i] = Cell();
+		}
+		for (ChoicePoint* choicePoint : choicePoints) {
+			choicePoint->heapSize = forward(choicePoint->heapSize);
+		}
+		for (HeapReference& reference : runtime.trail) {
+			if (reference.area == StorageArea::heap) {
+				reference.index = forward(reference.index);
+			}
+		}
+		
+		// Slide the marked cells down, in order, relocating their contents as they go.
+		HeapReference::heapIndex destination = 0;
+		for (std::vector<uint64_t>::size_type block = 0; block < marks.size(); ++ block) {
+			for (uint64_t bits = marks[block]; bits != 0; bits &= bits - 1) {
+				HeapReference::heapIndex index = block * 64 + std::bitset<64>((bits & -bits) - 1).count();
+				Cell cell = heap[index];
+				relocate(cell);
+				heap[destination ++] = cell;
+			}
+		}
+		runtime.heap.truncate(live);
+		
+		++ collections;
+		reclaimed += size - live;
+		limit = static_cast<HeapReference::heapIndex>(live * growth);
+		std::chrono::steady_clock::duration pause = std::chrono::steady_clock::now() - start;
+		pauses += pause;
+		longestPause = std::max(longestPause, pause);
+	}
+	
+	std::string GarbageCollector::toString() const {
+		auto milliseconds = [] (std::chrono::steady_clock::duration duration) {
+			std::ostringstream stream;
+			stream << std::fixed << std::setprecision(3) << std::chrono::duration<double, std::milli>(duration).count();
+			return stream.str();
+		};
+		return std::to_string(collections) + " collections, " + std::to_string(reclaimed * sizeof(Cell)) + " bytes reclaimed, " + milliseconds(pauses) + " ms paused (longest " + milliseconds(longestPause) + " ms)";
+	}
+}
@@ -0,0 +1,123 @@
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#if LLVM_MAJOR >= 14
+	#include <llvm/MC/TargetRegistry.h>
+#else
+	#include <llvm/Support/TargetRegistry.h>
+#endif
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/Target/TargetOptions.h>
+#include "compiler.hh"
+
+#ifndef DEBUG
+	#define DEBUG false
+#endif
+
+// Compiled programs are linked by the C++ compiler, against the runtime library and the libraries it depends on, which are configured by the build.
+#ifndef EPILOG_LINKER
+	#define EPILOG_LINKER "c++"
+#endif
+#ifndef EPILOG_RUNTIME_LIBRARY
+	#define EPILOG_RUNTIME_LIBRARY "libepilogruntime.a"
+#endif
+#ifndef EPILOG_LINK_FLAGS
+	#define EPILOG_LINK_FLAGS ""
+#endif
+
+namespace Epilog {
+	namespace Compiler {
+		static std::string quote(const std::string& argument) {
+			std::string quoted = "'";
+			for (char character : argument) {
+				quoted += character == '\'' ? std::string("'\\''") : std::string(1, character);
+			}
+			return quoted + "'";
+		}
+		
+		static void emitObject(const std::vector<Image::word>& image, const std::string& path) {
+			if (llvm::InitializeNativeTarget() || llvm::InitializeNativeTargetAsmPrinter()) {
+				throw CompilationException("Native code may not be generated for this machine.", __FILENAME__, __func__, __LINE__);
+			}
+			std::string triple = llvm::sys::getDefaultTargetTriple();
+			std::string error;
+			const llvm::Target* target = llvm::TargetRegistry::lookupTarget(triple, error);
+			if (target == nullptr) {
+				throw CompilationException(error, __FILENAME__, __func__, __LINE__);
+			}
+			std::unique_ptr<llvm::TargetMachine> machine(target->createTargetMachine(triple, "generic", "", llvm::TargetOptions(), llvm::Reloc::PIC_));
+			
+			llvm::LLVMContext context;
+			llvm::Module module("image", context);
+			module.setDataLayout(machine->createDataLayout());
+			module.setTargetTriple(triple);
+			llvm::IRBuilder<> builder(context);
+			llvm::Type* wordType = builder.getInt64Ty();
+			
+			// The image is held as a constant array, which the main function passes to the runtime.
+			llvm::ArrayType* imageType = llvm::ArrayType::get(wordType, image.size());
+			llvm::Constant* contents = llvm::ConstantDataArray::get(context, llvm::ArrayRef<uint64_t>(image.data(), image.size()));
+			llvm::GlobalVariable* global = new llvm::GlobalVariable(module, imageType, true, llvm::GlobalValue::PrivateLinkage, contents, "image");
+			llvm::FunctionType* entryType = llvm::FunctionType::get(builder.getInt32Ty(), { wordType->getPointerTo(), wordType }, false);
+			llvm::FunctionCallee entry = module.getOrInsertFunction("epilogMain", entryType);
+			llvm::FunctionType* mainType = llvm::FunctionType::get(builder.getInt32Ty(), { builder.getInt32Ty(), builder.getInt8PtrTy()->getPointerTo() }, false);
+			llvm::Function* main = llvm::Function::Create(mainType, llvm::Function::ExternalLinkage, "main", module);
+			builder.SetInsertPoint(llvm::BasicBlock::Create(context, "entry", main));
+			llvm::Value* words = builder.CreateConstInBoundsGEP2_64(imageType, global, 0, 0);
+			builder.CreateRet(builder.CreateCall(entry, { words, builder.getInt64(image.size()) }));
+			
+			std::error_code errorCode;
+			llvm::raw_fd_ostream stream(path, errorCode, llvm::sys::fs::OF_None);
+			if (errorCode) {
+				throw CompilationException("Could not write " + path + ": " + errorCode.message(), __FILENAME__, __func__, __LINE__);
+			}
+			llvm::legacy::PassManager passes;
+			if (machine->addPassesToEmitFile(passes, stream, nullptr, llvm::CGFT_ObjectFile)) {
+				throw CompilationException("Object files may not be emitted for this machine.", __FILENAME__, __func__, __LINE__);
+			}
+			passes.run(module);
+			stream.flush();
+		}
+		
+		void compile(const std::vector<Image::word>& image, const std::string& output) {
+			std::string object = output + ".o";
+			emitObject(image, object);
+			std::string command = std::string(EPILOG_LINKER) + " " + quote(object) + " " + quote(EPILOG_RUNTIME_LIBRARY) + " " + EPILOG_LINK_FLAGS + " -o " + quote(output);
+			if (DEBUG) {
+				std::cerr << "Link: " << command << std::endl;
+			}
+			int status = std::system(command.c_str());
+			std::remove(object.c_str());
+			if (status != 0) {
+				throw CompilationException("Could not link " + output + ".", __FILENAME__, __func__, __LINE__);
+			}
+		}
+	}
+}
+
+extern "C" int epilogMain(const uint64_t* image, uint64_t size) {
+	using namespace Epilog;
+	try {
+		Runtime mainRuntime;
+		Runtime::currentRuntime = &mainRuntime;
+		Image program;
+		program.load(image, size);
+		if (!program.execute()) {
+			std::cout << "false." << std::endl;
+			return EXIT_FAILURE;
+		}
+		std::cout << "true." << std::endl;
+	} catch (const Exception& exception) {
+		exception.print();
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "image.hh"
+
+namespace Epilog {
+	// Compiles programs ahead of time into executables, which execute their queries without parsing or compiling the program when they are run.
+	namespace Compiler {
+		// Emits an object file holding the image, along with a main function that executes it, and links it against the runtime library.
+		void compile(const std::vector<Image::word>& image, const std::string& output);
+	}
+}
+
+// The entry point of compiled programs, which is called from their main function with their image.
+extern "C" int epilogMain(const uint64_t* image, uint64_t size);
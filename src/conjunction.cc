@@ -0,0 +1,320 @@
+#include <sstream>
+#include <stack>
+#include <unordered_map>
+#include <unordered_set>
+#include "conjunction.hh"
+#include "interpreter.hh"
+#include "tabling.hh"
+
+namespace Epilog {
+	thread_local unsigned TaskPool::queue = 0;
+	
+	struct TaskPool::Task {
+		enum class Result { failed, succeeded, nondeterminate, error };
+		
+		Runtime* caller;
+		const Conjunction::Goal* goal;
+		// The arguments of the conjunction, copied from the caller's heap onto a heap of their own, which is shared by every task.
+		StackHeap* heap;
+		const std::vector<Cell>* arguments;
+		std::atomic<std::size_t>* remaining;
+		// The tasks of every goal of the conjunction, in order, and the flag by which they are cancelled.
+		const std::vector<std::unique_ptr<Task>>* tasks;
+		Cancellation* cancellation;
+		
+		Result result = Result::error;
+		// Set once the result is known, after which it may be read by the tasks of the other goals.
+		std::atomic<bool> finished { false };
+		std::ostringstream output;
+		// The arguments that the goal uses, once it has succeeded, copied onto a heap of their own.
+		StackHeap results;
+		std::vector<Cell> bindings;
+	};
+	
+	// Follows the bindings of a cell on a heap, returning the cell of the term it is bound to, or the reference to it, if it is unbound.
+	static Cell resolve(StackHeap& heap, Cell cell) {
+		while (cell.tag() == Cell::Tag::reference && heap[cell.address()] != cell) {
+			cell = heap[cell.address()];
+		}
+		return cell;
+	}
+	
+	// Records the address of each unbound variable in a term.
+	static void findVariables(StackHeap& heap, Cell cell, std::unordered_set<std::size_t>& variables) {
+		std::unordered_set<std::size_t> structures;
+		std::stack<Cell> terms;
+		terms.push(cell);
+		while (!terms.empty()) {
+			Cell term = resolve(heap, terms.top()); terms.pop();
+			if (term.tag() == Cell::Tag::reference) {
+				variables.insert(term.address());
+			} else if (term.tag() == Cell::Tag::structure && structures.insert(term.address()).second) {
+				for (int64_t i = 1; i <= heap[term.address()].functor().parameters; ++ i) {
+					terms.push(heap[term.address() + i]);
+				}
+			}
+		}
+	}
+	
+	// Copies a term from one heap onto another, returning the cell that refers to the copy.
+	// Each unbound variable is copied once, however often it is met, as recorded in variables.
+	static Cell copyTerm(StackHeap& from, Cell cell, StackHeap& to, std::unordered_map<std::size_t, Cell>& variables) {
+		std::stack<std::pair<Cell, HeapReference::heapIndex>> arguments;
+		auto copy = [&] (Cell cell) {
+			cell = resolve(from, cell);
+			switch (cell.tag()) {
+				case Cell::Tag::reference: {
+					auto variable = variables.find(cell.address());
+					if (variable != variables.end()) {
+						return variable->second;
+					}
+					Cell copied = Cell::reference(to.size());
+					to.push_back(copied);
+					variables.emplace(cell.address(), copied);
+					return copied;
+				}
+				case Cell::Tag::structure: {
+					Cell header = from[cell.address()];
+					HeapReference::heapIndex index = to.size();
+					to.push_back(header);
+					for (int64_t i = 1; i <= header.functor().parameters; ++ i) {
+						to.push_back(Cell());
+						arguments.emplace(from[cell.address() + i], index + i);
+					}
+					return Cell::structure(index);
+				}
+				default:
+					return cell;
+			}
+		};
+		Cell copied = copy(cell);
+		while (!arguments.empty()) {
+			auto argument = arguments.top(); arguments.pop();
+			Cell value = copy(argument.first);
+			to[argument.second] = value;
+		}
+		return copied;
+	}
+	
+	TaskPool::TaskPool(unsigned threads) : queues(std::max(threads, 1U)), queued(0) {
+		for (unsigned i = 1; i < queues.size(); ++ i) {
+			workers.emplace_back(&TaskPool::work, this, i);
+		}
+	}
+	
+	TaskPool::~TaskPool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		changed.notify_all();
+		for (std::thread& worker : workers) {
+			worker.join();
+		}
+	}
+	
+	bool TaskPool::execute(Runtime& runtime, const Conjunction& conjunction, bool& succeeded) {
+		// The goals are independent if no unbound variable is reachable from the arguments of more than one of them.
+		std::unordered_map<std::size_t, std::size_t> owners;
+		for (std::size_t goal = 0; goal < conjunction.goals.size(); ++ goal) {
+			std::unordered_set<std::size_t> variables;
+			for (std::size_t argument : conjunction.goals[goal].arguments) {
+				findVariables(runtime.heap, runtime.registers[argument], variables);
+			}
+			for (std::size_t variable : variables) {
+				if (!owners.emplace(variable, goal).second) {
+					return false;
+				}
+			}
+		}
+		
+		StackHeap heap;
+		std::vector<Cell> arguments;
+		std::unordered_map<std::size_t, Cell> variables;
+		for (int64_t argument = 0; argument < conjunction.parameters; ++ argument) {
+			arguments.push_back(copyTerm(runtime.heap, runtime.registers[argument], heap, variables));
+		}
+		std::atomic<std::size_t> remaining(conjunction.goals.size());
+		Cancellation cancellation(runtime.cancellation);
+		std::vector<std::unique_ptr<Task>> tasks;
+		for (const Conjunction::Goal& goal : conjunction.goals) {
+			tasks.emplace_back(new Task());
+			Task& task = *tasks.back();
+			task.caller = &runtime;
+			task.goal = &goal;
+			task.heap = &heap;
+			task.arguments = &arguments;
+			task.remaining = &remaining;
+			task.tasks = &tasks;
+			task.cancellation = &cancellation;
+		}
+		{
+			// The tasks are queued in reverse, so that the first goal is the first to be taken by this thread.
+			std::lock_guard<std::mutex> lock(queues[queue].mutex);
+			for (auto task = tasks.rbegin(); task != tasks.rend(); ++ task) {
+				queues[queue].tasks.push_back(task->get());
+			}
+			queued += tasks.size();
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+		}
+		changed.notify_all();
+		while (remaining > 0) {
+			if (Task* task = take()) {
+				run(*task);
+				continue;
+			}
+			std::unique_lock<std::mutex> lock(mutex);
+			changed.wait(lock, [this, &remaining] { return remaining == 0 || queued > 0; });
+		}
+		
+		// The goals are joined in order, as though they had been run in turn: the conjunction fails at the first goal to fail, as long as every goal before it was determinate.
+		for (std::unique_ptr<Task>& task : tasks) {
+			if (task->result == Task::Result::failed) {
+				for (std::unique_ptr<Task>& written : tasks) {
+					*runtime.output << written->output.str();
+					if (written == task) {
+						break;
+					}
+				}
+				succeeded = false;
+				return true;
+			}
+			if (task->result != Task::Result::succeeded) {
+				return false;
+			}
+		}
+		succeeded = true;
+		for (std::unique_ptr<Task>& task : tasks) {
+			std::unordered_map<std::size_t, Cell> variables;
+			for (std::size_t argument : task->goal->arguments) {
+				Cell copied = copyTerm(task->results, task->bindings[argument], runtime.heap, variables);
+				HeapReference binding(StorageArea::heap, runtime.heap.size());
+				runtime.heap.push_back(copied);
+				HeapReference reference(StorageArea::reg, argument);
+				succeeded = succeeded && unify(runtime, reference, binding);
+			}
+			*runtime.output << task->output.str();
+		}
+		return true;
+	}
+	
+	TaskPool::Task* TaskPool::take() {
+		for (std::size_t i = 0; i < queues.size(); ++ i) {
+			Queue& victim = queues[(queue + i) % queues.size()];
+			std::lock_guard<std::mutex> lock(victim.mutex);
+			if (!victim.tasks.empty()) {
+				Task* task;
+				if (i == 0) {
+					task = victim.tasks.back();
+					victim.tasks.pop_back();
+				} else {
+					task = victim.tasks.front();
+					victim.tasks.pop_front();
+				}
+				-- queued;
+				return task;
+			}
+		}
+		return nullptr;
+	}
+	
+	void TaskPool::run(Task& task) {
+		// Each thread keeps a runtime for each depth of nested tasks it is running, as a task may run other tasks while it waits for its own.
+		static thread_local std::vector<std::unique_ptr<Runtime>> runtimes;
+		static thread_local std::size_t depth = 0;
+		if (runtimes.size() <= depth) {
+			runtimes.emplace_back();
+		}
+		std::unique_ptr<Runtime>& cached = runtimes[depth];
+		if (cached == nullptr || cached->code != task.caller->code || cached->registers.size() < task.caller->registers.size()) {
+			cached.reset(new Runtime(*task.caller));
+		}
+		Runtime& runtime = *cached;
+		++ depth;
+		runtime.cancellation = task.cancellation;
+		try {
+			if (task.cancellation->isCancelled()) {
+				// The conjunction has already failed, so the goal is not run at all.
+				task.result = Task::Result::error;
+			} else {
+				runtime.heap.assign(task.heap->begin(), task.heap->end());
+				runtime.topEnvironment = -1UL;
+				runtime.topChoicePoint = -1UL;
+				runtime.trail.clear();
+				runtime.alternatives.clear();
+				runtime.answers.clear();
+				if (runtime.tables != nullptr) {
+					runtime.tables->reset();
+				}
+				while (!runtime.modifiers.empty()) {
+					runtime.modifiers.pop();
+				}
+				runtime.forcefulFailure = false;
+				runtime.output = &task.output;
+				// The arguments are held by an environment beneath the goal, which keeps them through garbage collection, and from which its bindings are read once it has succeeded.
+				// The goal returns to the fail label, which ends execution.
+				const std::vector<Cell>& arguments = *task.arguments;
+				runtime.nextGoal = Instruction::failLabel;
+				allocate(runtime, static_cast<int64_t>(arguments.size()));
+				std::copy(arguments.begin(), arguments.end(), runtime.currentEnvironment()->variables());
+				std::copy(arguments.begin(), arguments.end(), runtime.registers.begin());
+				runtime.currentNumberOfArguments = static_cast<int64_t>(arguments.size());
+				runtime.nextInstruction = *task.goal->label;
+				if (!AST::resumeInstructions(runtime, Instruction::failLabel, nullptr)) {
+					task.result = Task::Result::failed;
+				} else {
+					Environment* environment = reinterpret_cast<Environment*>(&runtime.stateStack[0]);
+					task.bindings.resize(arguments.size());
+					std::unordered_map<std::size_t, Cell> variables;
+					for (std::size_t argument : task.goal->arguments) {
+						task.bindings[argument] = copyTerm(runtime.heap, environment->variables()[argument], task.results, variables);
+					}
+					// A goal that leaves choice points may have another solution, which running the goals in turn could backtrack into.
+					// Whether it does is not searched for here, as that may take as long as the goal's whole search tree (or never finish), so the conjunction is then run in turn.
+					task.result = runtime.topChoicePoint == -1UL ? Task::Result::succeeded : Task::Result::nondeterminate;
+				}
+			}
+		} catch (...) {
+			// The conjunction is then run in turn, which reports the error as usual.
+			task.result = Task::Result::error;
+		}
+		-- depth;
+		runtime.output = &std::cout;
+		runtime.cancellation = nullptr;
+		task.finished = true;
+		// The goals are cancelled once the conjunction has failed as it would have when running them in turn: at a goal that failed, after goals that each succeeded with a single solution.
+		// This is checked by each task as it finishes, rather than by the caller, which may itself be running a goal that never finishes.
+		for (const std::unique_ptr<Task>& goal : *task.tasks) {
+			if (!goal->finished || goal->result == Task::Result::nondeterminate || goal->result == Task::Result::error) {
+				break;
+			}
+			if (goal->result == Task::Result::failed) {
+				task.cancellation->cancelled = true;
+				break;
+			}
+		}
+		// The caller may return as soon as its last task has finished, so the task is not used after this.
+		-- *task.remaining;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+		}
+		changed.notify_all();
+	}
+	
+	void TaskPool::work(unsigned queue) {
+		TaskPool::queue = queue;
+		while (true) {
+			if (Task* task = take()) {
+				run(*task);
+				continue;
+			}
+			std::unique_lock<std::mutex> lock(mutex);
+			changed.wait(lock, [this] { return stopping || queued > 0; });
+			if (stopping) {
+				return;
+			}
+		}
+	}
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "runtime.hh"
+
+namespace Epilog {
+	// Set once the goals of a conjunction being run in parallel need no longer be run, because one of them has failed after goals that each had a single solution, so that the conjunction has failed.
+	// The conjunctions run by its goals are cancelled along with it.
+	struct Cancellation {
+		std::atomic<bool> cancelled;
+		const Cancellation* parent;
+		
+		Cancellation(const Cancellation* parent) : cancelled(false), parent(parent) { }
+		
+		bool isCancelled() const {
+			for (const Cancellation* cancellation = this; cancellation != nullptr; cancellation = cancellation->parent) {
+				if (cancellation->cancelled) {
+					return true;
+				}
+			}
+			return false;
+		}
+	};
+	
+	// Runs the goals of a conjunction in parallel (independent AND-parallelism), as tasks on a pool of threads that steal tasks from each other.
+	// Each goal is run on a runtime of its own, from a copy of the terms it is called with, and its bindings are copied back once every goal has finished.
+	// A thread that creates tasks runs tasks of its own (or steals those of others) while it waits for them, so conjunctions may be nested.
+	class TaskPool {
+		public:
+		// Starts the given number of threads, including the thread that runs the program.
+		TaskPool(unsigned threads);
+		
+		~TaskPool();
+		
+		// Runs the goals of a conjunction, which is called with the argument registers of the given runtime, in parallel.
+		// Returns false, having done nothing, if the goals are not independent: if their arguments share an unbound variable, or if a goal leaves choice points, so that running the goals in turn might backtrack into it.
+		// Otherwise, succeeded is set if every goal succeeded, in which case their bindings have been made in the runtime.
+		// Once a goal fails after goals that each had a single solution, the goals still running are cancelled, so the conjunction fails as soon as it would have when running the goals in turn, even if a later goal would never finish.
+		bool execute(Runtime& runtime, const Conjunction& conjunction, bool& succeeded);
+		
+		private:
+		struct Task;
+		
+		struct Queue {
+			std::mutex mutex;
+			std::deque<Task*> tasks;
+		};
+		
+		// Takes the newest task of this thread's queue, or else the oldest task of another's, returning nullptr if there are none.
+		Task* take();
+		
+		void run(Task& task);
+		
+		void work(unsigned queue);
+		
+		// The queue of each thread of the pool. Threads outside the pool share the first.
+		std::vector<Queue> queues;
+		static thread_local unsigned queue;
+		std::vector<std::thread> workers;
+		std::atomic<std::size_t> queued;
+		
+		std::mutex mutex;
+		// Notified when a task is queued or finished, or when the pool is stopped.
+		std::condition_variable changed;
+		bool stopping = false;
+	};
+}
@@ -0,0 +1,115 @@
+#include <cerrno>
+#include <unistd.h>
+#include "consult.hh"
+#include "parser.hh"
+#include "reader.hh"
+
+namespace Epilog {
+	int ClauseStream::peek() {
+		while (position == size) {
+			ssize_t count = read(file, buffer, sizeof(buffer));
+			if (count < 0 && errno == EINTR) {
+				continue;
+			}
+			if (count <= 0) {
+				return -1;
+			}
+			position = 0;
+			size = static_cast<std::size_t>(count);
+		}
+		return static_cast<unsigned char>(buffer[position]);
+	}
+	
+	int ClauseStream::get() {
+		int character = peek();
+		if (character != -1) {
+			++ position;
+			lines += character == '\n';
+		}
+		return character;
+	}
+	
+	bool ClauseStream::next(std::string& text) {
+		text.clear();
+		first = lines;
+		for (int character; (character = get()) != -1; ) {
+			text += static_cast<char>(character);
+			switch (character) {
+				case '\'':
+				case '"':
+					// Quoted atoms and strings end at the next quote that is not escaped.
+					for (int quoted; (quoted = get()) != -1; ) {
+						text += static_cast<char>(quoted);
+						if (quoted == '\\' && peek() == character) {
+							text += static_cast<char>(get());
+						} else if (quoted == character) {
+							break;
+						}
+					}
+					break;
+				case '%':
+					for (int commented; (commented = get()) != -1; ) {
+						text += static_cast<char>(commented);
+						if (commented == '\n') {
+							break;
+						}
+					}
+					break;
+				case '/':
+					if (peek() == '*') {
+						text += static_cast<char>(get());
+						for (int previous = 0, commented; (commented = get()) != -1; previous = commented) {
+							text += static_cast<char>(commented);
+							if (previous == '*' && commented == '/') {
+								break;
+							}
+						}
+					}
+					break;
+				case '.': {
+					int following = peek();
+					if (following == -1 || following == ' ' || following == '\t' || following == '\n' || following == '\r' || following == '%') {
+						return true;
+					}
+					break;
+				}
+				default:
+					break;
+			}
+		}
+		return !text.empty();
+	}
+	
+	bool consult(Parser::EpilogParser* reference, int file, Interpreter::Context& context, bool& succeeded) {
+		ClauseStream stream(file);
+		Parser::Reader reader;
+		std::string text;
+		succeeded = true;
+		while (stream.next(text)) {
+			// Each clause is parsed on its own, so its syntax tree (and everything the parser memoised) is released once it has been interpreted.
+			std::unique_ptr<AST::Clauses> clauses;
+			if (reference != nullptr) {
+				pegmatite::StringInput input(text);
+				auto report = [&stream] (const pegmatite::InputRange&, const std::string& message) {
+					std::cerr << "Line " << stream.line() << ": " << message << std::endl;
+				};
+				if (!reference->parse(input, reference->grammar.clauses, reference->grammar.ignored, report, clauses)) {
+					return false;
+				}
+			} else {
+				std::string error;
+				std::size_t line;
+				clauses = reader.read(text, error, line);
+				if (clauses == nullptr) {
+					std::cerr << "Line " << stream.firstLine() + line - 1 << ": " << error << std::endl;
+					return false;
+				}
+			}
+			if (!clauses->interpret(context)) {
+				succeeded = false;
+				return true;
+			}
+		}
+		return true;
+	}
+}
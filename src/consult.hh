@@ -0,0 +1,52 @@
+#pragma once
+
+#include <string>
+
+namespace Epilog {
+	namespace Interpreter {
+		class Context;
+	}
+	
+	namespace Parser {
+		class EpilogParser;
+	}
+	
+	// Splits the text of a program into its clauses as it is read from a file, so that each may be parsed and compiled before the next is read.
+	// As in standard Prolog, a clause ends at a full stop followed by layout (or the end of the file), unless it is within a quoted atom, a string or a comment.
+	class ClauseStream {
+		public:
+		ClauseStream(int file) : file(file) { }
+		
+		// Reads the text of the next clause, along with any layout and comments before it. Returns false once the file is exhausted.
+		bool next(std::string& text);
+		
+		// The line on which the text of the last clause read begins.
+		std::size_t firstLine() const {
+			return first;
+		}
+		
+		// The line on which the last clause read ends.
+		std::size_t line() const {
+			return lines;
+		}
+		
+		private:
+		// Returns the next character of the file, or -1 at its end.
+		int peek();
+		
+		int get();
+		
+		int file;
+		char buffer[65536];
+		std::size_t position = 0;
+		std::size_t size = 0;
+		std::size_t lines = 1;
+		std::size_t first = 1;
+	};
+	
+	// Consults a program from a file a clause at a time: each is parsed and interpreted (so any query is executed), and its syntax tree released, before the next is read.
+	// Memory is then bounded by the largest clause rather than the whole program, and programs may be consulted from pipes.
+	// Clauses are read by Parser::Reader, unless a reference parser is given.
+	// Returns false if a clause could not be parsed. Otherwise, succeeded is cleared if a query failed, in which case the rest of the program is skipped.
+	bool consult(Parser::EpilogParser* reference, int file, Interpreter::Context& context, bool& succeeded);
+}
@@ -0,0 +1,476 @@
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include "datalog.hh"
+#include "parser.hh"
+#include "standardlibrary.hh"
+
+namespace Epilog {
+	// Hashes the columns of a tuple that are in the mask.
+	static uint64_t hashColumns(const Cell::word* tuple, std::size_t arity, uint64_t mask) {
+		uint64_t hash = UINT64_C(14695981039346656037);
+		for (std::size_t column = 0; column < arity; ++ column) {
+			if ((mask >> column) & 1) {
+				hash = (hash ^ tuple[column]) * UINT64_C(1099511628211);
+				hash ^= hash >> 32;
+			}
+		}
+		return hash;
+	}
+	
+	Datalog::Relation::Relation(std::size_t arity) : arity(arity), rows(0, RowHash { this }, RowEqual { this }) { }
+	
+	std::size_t Datalog::Relation::RowHash::operator()(std::size_t row) const {
+		return static_cast<std::size_t>(hashColumns(relation->row(row), relation->arity, ~UINT64_C(0)));
+	}
+	
+	bool Datalog::Relation::RowEqual::operator()(std::size_t a, std::size_t b) const {
+		return std::equal(relation->row(a), relation->row(a) + relation->arity, relation->row(b));
+	}
+	
+	bool Datalog::Relation::insert(const Cell::word* tuple) {
+		// The tuple is appended as the next row, so that it may be compared with the rest, and removed again if it is already held.
+		tuples.insert(tuples.end(), tuple, tuple + arity);
+		if (!rows.insert(count).second) {
+			tuples.resize(count * arity);
+			return false;
+		}
+		++ count;
+		return true;
+	}
+	
+	bool Datalog::Relation::contains(const Cell::word* tuple) {
+		tuples.insert(tuples.end(), tuple, tuple + arity);
+		bool found = rows.find(count) != rows.end();
+		tuples.resize(count * arity);
+		return found;
+	}
+	
+	const Datalog::Relation::rowList& Datalog::Relation::lookup(uint64_t mask, const Cell::word* key) {
+		Index& index = indexes[mask];
+		for (; index.indexed < count; ++ index.indexed) {
+			index.rows[hashColumns(row(index.indexed), arity, mask)].push_back(index.indexed);
+		}
+		auto rows = index.rows.find(hashColumns(key, arity, mask));
+		return rows != index.rows.end() ? rows->second : empty;
+	}
+	
+	Datalog::Atom Datalog::compile(const AST::CompoundTerm& term, bool negated, std::unordered_map<std::string, std::size_t>& slots, std::size_t& count) const {
+		const pegmatite::ASTList<AST::Term>& parameters = term.parameterList->parameters;
+		if (parameters.size() > 64) {
+			throw CompilationException("Datalog relations may have at most 64 arguments, but " + term.toString() + " has more.", __FILENAME__, __func__, __LINE__);
+		}
+		Atom atom;
+		atom.functor = SymbolTable::intern(term.name, parameters.size());
+		atom.negated = negated;
+		if (StandardLibrary::functions.find(atom.functor) != StandardLibrary::functions.end()) {
+			throw CompilationException("Datalog clauses may not use the built-in function " + SymbolTable::get(atom.functor).toString() + ".", __FILENAME__, __func__, __LINE__);
+		}
+		for (auto& parameter : parameters) {
+			if (AST::Variable* variable = dynamic_cast<AST::Variable*>(parameter.get())) {
+				// Each anonymous variable is distinct, having been given a unique name (beginning with an underscore) by the parser.
+				std::string name = variable->toString();
+				auto slot = slots.emplace(name, count);
+				if (slot.second) {
+					++ count;
+				}
+				atom.arguments.push_back(Atom::Argument { true, name[0] == '_', slot.first->second });
+			} else if (AST::Number* number = dynamic_cast<AST::Number*>(parameter.get())) {
+				atom.arguments.push_back(Atom::Argument { false, false, Cell::integer(number->value).value });
+			} else {
+				AST::CompoundTerm* constant = dynamic_cast<AST::CompoundTerm*>(parameter.get());
+				if (constant == nullptr || !constant->parameterList->parameters.empty()) {
+					throw CompilationException("Datalog clauses may only have constants and variables as arguments, unlike " + term.toString() + ".", __FILENAME__, __func__, __LINE__);
+				}
+				atom.arguments.push_back(Atom::Argument { false, false, Cell::constant(SymbolTable::intern(constant->name, 0)).value });
+			}
+		}
+		return atom;
+	}
+	
+	void Datalog::checkSafety(const Rule& rule, const std::string& clause) {
+		std::vector<bool> bound(rule.slots, false);
+		for (const Atom& atom : rule.body) {
+			for (const Atom::Argument& argument : atom.arguments) {
+				if (argument.variable && !atom.negated) {
+					bound[argument.value] = true;
+				}
+			}
+		}
+		auto check = [&] (const Atom& atom) {
+			for (const Atom::Argument& argument : atom.arguments) {
+				// An anonymous variable of a negated atom need not be bound, as the atom only asks whether any tuple matches its other columns.
+				if (argument.variable && !bound[argument.value] && !(atom.negated && argument.anonymous)) {
+					throw CompilationException("Datalog clauses must bind each variable of their head and negated goals in a goal that is not negated, unlike " + clause + ".", __FILENAME__, __func__, __LINE__);
+				}
+			}
+		};
+		if (rule.head != nullptr) {
+			check(*rule.head);
+		}
+		for (const Atom& atom : rule.body) {
+			if (atom.negated) {
+				check(atom);
+			}
+		}
+	}
+	
+	void Datalog::addClause(const AST::CompoundTerm& head, const std::vector<const AST::EnrichedCompoundTerm*>& goals) {
+		Rule rule;
+		std::unordered_map<std::string, std::size_t> slots;
+		std::size_t count = 0;
+		std::string clause = head.toString();
+		for (const AST::EnrichedCompoundTerm* goal : goals) {
+			if (goal->modifier != nullptr && *goal->modifier != "\\+") {
+				throw CompilationException("Datalog rules may only negate goals, unlike " + goal->toString() + ".", __FILENAME__, __func__, __LINE__);
+			}
+			rule.body.push_back(compile(*goal->compoundTerm, goal->modifier != nullptr, slots, count));
+			clause += (clause.size() > head.toString().size() ? ", " : " :- ") + goal->toString();
+		}
+		rule.head.reset(new Atom(compile(head, false, slots, count)));
+		rule.slots = count;
+		checkSafety(rule, clause);
+		if (goals.empty()) {
+			std::vector<Cell::word> tuple;
+			for (const Atom::Argument& argument : rule.head->arguments) {
+				tuple.push_back(argument.value);
+			}
+			addFact(rule.head->functor, tuple);
+		} else {
+			rules.push_back(std::move(rule));
+		}
+		evaluated = false;
+	}
+	
+	void Datalog::addFact(SymbolTable::symbolIndex functor, const std::vector<Cell::word>& tuple) {
+		std::unique_ptr<Relation>& relation = facts[functor];
+		if (relation == nullptr) {
+			relation.reset(new Relation(tuple.size()));
+		}
+		relation->insert(tuple.data());
+		evaluated = false;
+	}
+	
+	Datalog::Relation& Datalog::relation(SymbolTable::symbolIndex functor) {
+		std::unique_ptr<Relation>& relation = relations[functor];
+		if (relation == nullptr) {
+			relation.reset(new Relation(static_cast<std::size_t>(SymbolTable::get(functor).parameters)));
+		}
+		return *relation;
+	}
+	
+	Datalog::Plan Datalog::plan(const Rule& rule, std::size_t first, const std::vector<Literal::Range>& ranges) {
+		// Atoms are joined in order, except that the first is given, and that negated atoms are only checked once every other atom has bound their variables.
+		std::vector<std::size_t> order;
+		if (first != -1UL) {
+			order.push_back(first);
+		}
+		for (std::size_t i = 0; i < rule.body.size(); ++ i) {
+			if (i != first && !rule.body[i].negated) {
+				order.push_back(i);
+			}
+		}
+		for (std::size_t i = 0; i < rule.body.size(); ++ i) {
+			if (rule.body[i].negated) {
+				order.push_back(i);
+			}
+		}
+		Plan plan;
+		plan.rule = &rule;
+		std::vector<bool> bound(rule.slots, false);
+		for (std::size_t i : order) {
+			const Atom& atom = rule.body[i];
+			Literal literal;
+			literal.atom = &atom;
+			literal.relation = &relation(atom.functor);
+			literal.range = ranges[i];
+			literal.mask = 0;
+			std::vector<std::size_t> binds;
+			for (std::size_t column = 0; column < atom.arguments.size(); ++ column) {
+				const Atom::Argument& argument = atom.arguments[column];
+				Literal::Action action;
+				if (!argument.variable) {
+					action = Literal::Action::constant;
+				} else if (bound[argument.value]) {
+					action = Literal::Action::bound;
+				} else if (std::find(binds.begin(), binds.end(), argument.value) != binds.end()) {
+					action = Literal::Action::repeat;
+				} else {
+					action = Literal::Action::bind;
+					binds.push_back(argument.value);
+				}
+				if (action == Literal::Action::constant || action == Literal::Action::bound) {
+					literal.mask |= UINT64_C(1) << column;
+				}
+				literal.actions.push_back(action);
+			}
+			for (std::size_t slot : binds) {
+				bound[slot] = true;
+			}
+			plan.literals.push_back(std::move(literal));
+		}
+		return plan;
+	}
+	
+	template <typename Emit>
+	void Datalog::execute(const Plan& plan, Emit& emit) {
+		std::vector<Cell::word> slots(plan.rule->slots);
+		std::vector<std::vector<Cell::word>> keys;
+		for (const Literal& literal : plan.literals) {
+			keys.emplace_back(literal.atom->arguments.size());
+		}
+		join(plan, 0, slots, keys, emit);
+	}
+	
+	template <typename Emit>
+	void Datalog::join(const Plan& plan, std::size_t position, std::vector<Cell::word>& slots, std::vector<std::vector<Cell::word>>& keys, Emit& emit) {
+		if (position == plan.literals.size()) {
+			emit(slots);
+			return;
+		}
+		const Literal& literal = plan.literals[position];
+		const std::vector<Atom::Argument>& arguments = literal.atom->arguments;
+		Relation& relation = *literal.relation;
+		std::vector<Cell::word>& key = keys[position];
+		for (std::size_t column = 0; column < arguments.size(); ++ column) {
+			if (literal.actions[column] == Literal::Action::constant) {
+				key[column] = arguments[column].value;
+			} else if (literal.actions[column] == Literal::Action::bound) {
+				key[column] = slots[arguments[column].value];
+			}
+		}
+		if (literal.atom->negated) {
+			// The columns of anonymous variables are left out of the lookup, unless every column is known.
+			bool found;
+			if (literal.mask == (arguments.size() == 64 ? ~UINT64_C(0) : (UINT64_C(1) << arguments.size()) - 1)) {
+				found = relation.contains(key.data());
+			} else if (literal.mask == 0) {
+				found = relation.size() > 0;
+			} else {
+				// The rows looked up share the hash of the known columns, so each is compared with them.
+				const Relation::rowList& rows = relation.lookup(literal.mask, key.data());
+				found = std::any_of(rows.begin(), rows.end(), [&] (std::size_t row) {
+					const Cell::word* tuple = relation.row(row);
+					for (std::size_t column = 0; column < arguments.size(); ++ column) {
+						if ((literal.mask >> column & 1) != 0 && tuple[column] != key[column]) {
+							return false;
+						}
+					}
+					return true;
+				});
+			}
+			if (!found) {
+				join(plan, position + 1, slots, keys, emit);
+			}
+			return;
+		}
+		std::size_t begin = literal.range == Literal::Range::delta ? relation.delta : 0;
+		std::size_t end = literal.range == Literal::Range::old ? relation.delta : relation.size();
+		auto match = [&] (std::size_t row) {
+			const Cell::word* tuple = relation.row(row);
+			for (std::size_t column = 0; column < arguments.size(); ++ column) {
+				switch (literal.actions[column]) {
+					case Literal::Action::constant:
+					case Literal::Action::bound:
+						if (tuple[column] != key[column]) {
+							return;
+						}
+						break;
+					case Literal::Action::repeat:
+						if (tuple[column] != slots[arguments[column].value]) {
+							return;
+						}
+						break;
+					case Literal::Action::bind:
+						slots[arguments[column].value] = tuple[column];
+						break;
+				}
+			}
+			join(plan, position + 1, slots, keys, emit);
+		};
+		if (literal.mask == 0) {
+			for (std::size_t row = begin; row < end; ++ row) {
+				match(row);
+			}
+		} else {
+			const Relation::rowList& rows = relation.lookup(literal.mask, key.data());
+			for (auto row = std::lower_bound(rows.begin(), rows.end(), begin); row != rows.end() && *row < end; ++ row) {
+				match(*row);
+			}
+		}
+	}
+	
+	void Datalog::evaluate() {
+		if (evaluated) {
+			return;
+		}
+		relations.clear();
+		for (auto& fact : facts) {
+			Relation& derived = relation(fact.first);
+			for (std::size_t row = 0; row < fact.second->size(); ++ row) {
+				derived.insert(fact.second->row(row));
+			}
+		}
+		
+		// The predicates defined by rules are split into strata (the strongly connected components of their dependencies), each of which only depends on those before it.
+		std::unordered_map<SymbolTable::symbolIndex, std::vector<const Rule*>> definitions;
+		for (const Rule& rule : rules) {
+			definitions[rule.head->functor].push_back(&rule);
+		}
+		std::vector<std::vector<SymbolTable::symbolIndex>> strata;
+		std::unordered_map<SymbolTable::symbolIndex, std::pair<std::size_t, std::size_t>> visits;
+		std::vector<SymbolTable::symbolIndex> stack;
+		std::unordered_set<SymbolTable::symbolIndex> stacked;
+		std::function<void(SymbolTable::symbolIndex)> connect = [&] (SymbolTable::symbolIndex predicate) {
+			std::size_t index = visits.size();
+			visits[predicate] = std::make_pair(index, index);
+			stack.push_back(predicate);
+			stacked.insert(predicate);
+			for (const Rule* rule : definitions[predicate]) {
+				for (const Atom& atom : rule->body) {
+					if (definitions.find(atom.functor) == definitions.end()) {
+						continue;
+					}
+					if (visits.find(atom.functor) == visits.end()) {
+						connect(atom.functor);
+						visits[predicate].second = std::min(visits[predicate].second, visits[atom.functor].second);
+					} else if (stacked.find(atom.functor) != stacked.end()) {
+						visits[predicate].second = std::min(visits[predicate].second, visits[atom.functor].first);
+					}
+				}
+			}
+			if (visits[predicate].second == index) {
+				strata.emplace_back();
+				SymbolTable::symbolIndex member;
+				do {
+					member = stack.back();
+					stack.pop_back();
+					stacked.erase(member);
+					strata.back().push_back(member);
+				} while (member != predicate);
+			}
+		};
+		for (const Rule& rule : rules) {
+			if (visits.find(rule.head->functor) == visits.end()) {
+				connect(rule.head->functor);
+			}
+		}
+		
+		for (const std::vector<SymbolTable::symbolIndex>& stratum : strata) {
+			std::unordered_set<SymbolTable::symbolIndex> members(stratum.begin(), stratum.end());
+			// Each round joins the atoms of the stratum's own relations against the tuples derived by the last round, and the rules that depend on none of them are only joined by the first.
+			std::vector<Plan> initial;
+			std::vector<Plan> recursive;
+			for (const Rule& rule : rules) {
+				if (members.find(rule.head->functor) == members.end()) {
+					continue;
+				}
+				std::vector<std::size_t> positions;
+				for (std::size_t i = 0; i < rule.body.size(); ++ i) {
+					if (members.find(rule.body[i].functor) != members.end()) {
+						if (rule.body[i].negated) {
+							throw CompilationException("The program is not stratified, as " + SymbolTable::get(rule.head->functor).toString() + " depends on the negation of " + SymbolTable::get(rule.body[i].functor).toString() + ", which depends on it.", __FILENAME__, __func__, __LINE__);
+						}
+						positions.push_back(i);
+					}
+				}
+				std::vector<Literal::Range> ranges(rule.body.size(), Literal::Range::all);
+				if (positions.empty()) {
+					initial.push_back(plan(rule, -1UL, ranges));
+				}
+				// The tuples derived by each round are joined once for each atom they may match, against the older tuples of the atoms before it.
+				for (std::size_t position : positions) {
+					for (std::size_t other : positions) {
+						ranges[other] = other < position ? Literal::Range::old : other == position ? Literal::Range::delta : Literal::Range::all;
+					}
+					recursive.push_back(plan(rule, position, ranges));
+				}
+			}
+			for (SymbolTable::symbolIndex member : stratum) {
+				relation(member).delta = 0;
+			}
+			// The tuples derived by a round, and how many there are, which is counted separately, as the tuples of a relation without arguments take no words.
+			std::unordered_map<SymbolTable::symbolIndex, std::pair<std::vector<Cell::word>, std::size_t>> derived;
+			auto emit = [&derived] (const Rule& rule, const std::vector<Cell::word>& slots) {
+				auto& tuples = derived[rule.head->functor];
+				for (const Atom::Argument& argument : rule.head->arguments) {
+					tuples.first.push_back(argument.variable ? slots[argument.value] : argument.value);
+				}
+				++ tuples.second;
+			};
+			bool changed = true;
+			for (bool first = true; changed; first = false) {
+				for (const Plan& plan : recursive) {
+					auto emitRule = [&] (const std::vector<Cell::word>& slots) { emit(*plan.rule, slots); };
+					execute(plan, emitRule);
+				}
+				if (first) {
+					for (const Plan& plan : initial) {
+						auto emitRule = [&] (const std::vector<Cell::word>& slots) { emit(*plan.rule, slots); };
+						execute(plan, emitRule);
+					}
+				}
+				// The tuples are only added once the round is over, as the relations are read throughout it.
+				changed = false;
+				for (SymbolTable::symbolIndex member : stratum) {
+					Relation& derivedRelation = relation(member);
+					derivedRelation.delta = derivedRelation.size();
+					auto& tuples = derived[member];
+					for (std::size_t i = 0; i < tuples.second; ++ i) {
+						changed = derivedRelation.insert(tuples.first.data() + i * derivedRelation.arity) || changed;
+					}
+					tuples.first.clear();
+					tuples.second = 0;
+				}
+			}
+		}
+		evaluated = true;
+	}
+	
+	bool Datalog::query(const std::vector<const AST::EnrichedCompoundTerm*>& goals) {
+		evaluate();
+		Rule rule;
+		std::unordered_map<std::string, std::size_t> slots;
+		std::size_t count = 0;
+		std::string clause = "?- ";
+		for (const AST::EnrichedCompoundTerm* goal : goals) {
+			if (goal->modifier != nullptr && *goal->modifier != "\\+") {
+				throw CompilationException("Datalog queries may only negate goals, unlike " + goal->toString() + ".", __FILENAME__, __func__, __LINE__);
+			}
+			rule.body.push_back(compile(*goal->compoundTerm, goal->modifier != nullptr, slots, count));
+			clause += (clause.size() > 3 ? ", " : "") + goal->toString();
+		}
+		rule.slots = count;
+		checkSafety(rule, clause);
+		// The bindings of the named variables are written in the order in which the variables appear.
+		std::vector<std::pair<std::size_t, std::string>> variables;
+		for (auto& slot : slots) {
+			if (slot.first[0] != '_') {
+				variables.emplace_back(slot.second, slot.first);
+			}
+		}
+		std::sort(variables.begin(), variables.end());
+		
+		Plan query = plan(rule, -1UL, std::vector<Literal::Range>(rule.body.size(), Literal::Range::all));
+		Relation solutions(variables.size());
+		std::vector<Cell::word> solution(variables.size());
+		bool succeeded = false;
+		auto emit = [&] (const std::vector<Cell::word>& values) {
+			succeeded = true;
+			for (std::size_t i = 0; i < variables.size(); ++ i) {
+				solution[i] = values[variables[i].first];
+			}
+			if (!variables.empty() && solutions.insert(solution.data())) {
+				std::string bindings;
+				for (std::size_t i = 0; i < variables.size(); ++ i) {
+					Cell cell;
+					cell.value = solution[i];
+					bindings += (i > 0 ? ", " : "") + variables[i].second + " = " + cell.trace(*Runtime::currentRuntime);
+				}
+				*Runtime::currentRuntime->output << bindings << std::endl;
+			}
+		};
+		execute(query, emit);
+		return succeeded;
+	}
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "runtime.hh"
+
+namespace Epilog {
+	namespace AST {
+		class CompoundTerm;
+		class EnrichedCompoundTerm;
+	}
+	
+	// Evaluates pure Datalog programs (function-free facts and rules, with stratified negation) bottom-up, rather than by resolution.
+	// The rules are split into strata by their dependencies, and the relations of each stratum are derived to a fixpoint by semi-naive evaluation: each round joins only the tuples derived by the last round against the rest, using hash indexes on the columns that are bound.
+	// Queries are then answered from the derived relations.
+	class Datalog {
+		public:
+		// Adds a fact (if there are no goals) or a rule to the program. Throws a CompilationException if the clause is not Datalog.
+		void addClause(const AST::CompoundTerm& head, const std::vector<const AST::EnrichedCompoundTerm*>& goals);
+		
+		// Adds a fact whose arguments are the given constants and integers.
+		void addFact(SymbolTable::symbolIndex functor, const std::vector<Cell::word>& tuple);
+		
+		// Answers a query from the relations derived from the clauses added so far, writing the bindings of its variables for each distinct solution.
+		// Returns false if the query has no solutions.
+		bool query(const std::vector<const AST::EnrichedCompoundTerm*>& goals);
+		
+		private:
+		// The tuples of a relation, each of which is held once, in the order in which they were derived.
+		class Relation {
+			public:
+			typedef std::vector<std::size_t> rowList;
+			
+			const std::size_t arity;
+			// The first row derived by the last round of evaluation. The rows from here on are those that the next round joins against the rest.
+			std::size_t delta = 0;
+			
+			Relation(std::size_t arity);
+			
+			Relation(const Relation&) = delete;
+			Relation& operator=(const Relation&) = delete;
+			
+			std::size_t size() const {
+				return count;
+			}
+			
+			const Cell::word* row(std::size_t index) const {
+				return tuples.data() + index * arity;
+			}
+			
+			// Adds a tuple, returning false if the relation already holds it.
+			bool insert(const Cell::word* tuple);
+			
+			bool contains(const Cell::word* tuple);
+			
+			// Returns the rows (in ascending order) whose columns in the mask may equal those of the key. Rows whose columns merely share a hash are included, so they must still be compared.
+			const rowList& lookup(uint64_t mask, const Cell::word* key);
+			
+			private:
+			struct RowHash {
+				const Relation* relation;
+				std::size_t operator()(std::size_t row) const;
+			};
+			
+			struct RowEqual {
+				const Relation* relation;
+				bool operator()(std::size_t a, std::size_t b) const;
+			};
+			
+			struct Index {
+				std::unordered_map<uint64_t, rowList> rows;
+				std::size_t indexed = 0;
+			};
+			
+			std::vector<Cell::word> tuples;
+			std::size_t count = 0;
+			std::unordered_set<std::size_t, RowHash, RowEqual> rows;
+			// The index on each set of columns that has been looked up, which is extended with any rows added since.
+			std::unordered_map<uint64_t, Index> indexes;
+			const rowList empty;
+		};
+		
+		// A relation with arguments that are each a constant or a variable, which is numbered by its slot in the rule.
+		struct Atom {
+			struct Argument {
+				bool variable;
+				// Whether the variable is anonymous, so that it is existentially quantified in a negated atom.
+				bool anonymous;
+				Cell::word value;
+			};
+			
+			SymbolTable::symbolIndex functor;
+			bool negated;
+			std::vector<Argument> arguments;
+		};
+		
+		// A rule, or a query (which has no head).
+		struct Rule {
+			std::unique_ptr<Atom> head;
+			std::vector<Atom> body;
+			std::size_t slots;
+		};
+		
+		// An atom of a plan: the range of its relation that is joined, and how each of its columns is matched, given the atoms joined before it.
+		struct Literal {
+			enum class Range { all, old, delta };
+			enum class Action { constant, bound, repeat, bind };
+			
+			const Atom* atom;
+			Relation* relation;
+			Range range;
+			std::vector<Action> actions;
+			// The columns whose values are known before the atom is joined (by constants, or by variables bound by earlier atoms), by which its relation is looked up.
+			uint64_t mask;
+		};
+		
+		// The order in which the atoms of a rule are joined.
+		struct Plan {
+			const Rule* rule;
+			std::vector<Literal> literals;
+		};
+		
+		// Compiles a term into an atom, numbering its variables by the given slots, which are allocated for those not yet met.
+		Atom compile(const AST::CompoundTerm& term, bool negated, std::unordered_map<std::string, std::size_t>& slots, std::size_t& count) const;
+		
+		// Plans the joins of a rule over the given range of each atom's relation, with the atom at the given position of its body (if any) joined first.
+		Plan plan(const Rule& rule, std::size_t first, const std::vector<Literal::Range>& ranges);
+		
+		// Checks that every variable of the head and every named variable of the negated atoms of a rule (or query) is bound by an atom that is not negated, so that the relations it derives are finite.
+		static void checkSafety(const Rule& rule, const std::string& clause);
+		
+		Relation& relation(SymbolTable::symbolIndex functor);
+		
+		// Derives every relation of the program, from its facts, unless it is unchanged since it was last evaluated.
+		void evaluate();
+		
+		// Calls emit with the bindings of the variables of a plan's rule, for each solution of its joins.
+		template <typename Emit>
+		void execute(const Plan& plan, Emit& emit);
+		
+		// Joins the atoms of a plan from the given position, with the given bindings of its variables, and the given key for each atom.
+		template <typename Emit>
+		void join(const Plan& plan, std::size_t position, std::vector<Cell::word>& slots, std::vector<std::vector<Cell::word>>& keys, Emit& emit);
+		
+		std::vector<Rule> rules;
+		std::unordered_map<SymbolTable::symbolIndex, std::unique_ptr<Relation>> facts;
+		std::unordered_map<SymbolTable::symbolIndex, std::unique_ptr<Relation>> relations;
+		bool evaluated = false;
+	};
+}
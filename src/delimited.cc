@@ -0,0 +1,138 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "delimited.hh"
+#include "parser.hh"
+
+namespace Epilog {
+	DelimitedFile::DelimitedFile(const std::string& path) : path(path) {
+		int file = open(path.c_str(), O_RDONLY);
+		struct stat status;
+		if (file == -1 || fstat(file, &status) == -1) {
+			if (file != -1) {
+				close(file);
+			}
+			throw CompilationException("Could not read " + path + ": " + std::strerror(errno) + ".", __FILENAME__, __func__, __LINE__);
+		}
+		size = static_cast<std::size_t>(status.st_size);
+		// Empty files may not be mapped, but have no rows to read anyway.
+		void* mapping = size > 0 ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0) : nullptr;
+		int error = errno;
+		close(file);
+		if (mapping == MAP_FAILED) {
+			throw CompilationException("Could not map " + path + ": " + std::strerror(error) + ".", __FILENAME__, __func__, __LINE__);
+		}
+		if (mapping != nullptr) {
+			madvise(mapping, size, MADV_SEQUENTIAL);
+		}
+		data = static_cast<const char*>(mapping);
+		position = data;
+		end = data + size;
+		const char* newline = size > 0 ? static_cast<const char*>(std::memchr(data, '\n', size)) : nullptr;
+		if (size > 0 && std::memchr(data, '\t', static_cast<std::size_t>((newline != nullptr ? newline : end) - data)) != nullptr) {
+			delimiter = '\t';
+		}
+	}
+	
+	DelimitedFile::~DelimitedFile() {
+		if (data != nullptr) {
+			munmap(const_cast<char*>(data), size);
+		}
+	}
+	
+	bool DelimitedFile::next(std::vector<Cell>& fields) {
+		fields.clear();
+		while (position < end && (*position == '\n' || *position == '\r')) {
+			lines += *position == '\n';
+			++ position;
+		}
+		if (position == end) {
+			return false;
+		}
+		row = lines;
+		const char* newline = static_cast<const char*>(std::memchr(position, '\n', static_cast<std::size_t>(end - position)));
+		const char* lineEnd = newline != nullptr ? newline : end;
+		while (true) {
+			if (delimiter == ',' && position < end && *position == '"') {
+				text.clear();
+				const char* close = position;
+				do {
+					const char* first = close + 1;
+					close = static_cast<const char*>(std::memchr(first, '"', static_cast<std::size_t>(end - first)));
+					if (close == nullptr) {
+						throw CompilationException("The quoted field on line " + std::to_string(lines) + " of " + path + " is not closed.", __FILENAME__, __func__, __LINE__);
+					}
+					text.append(first, close);
+					// A doubled quote stands for a quote within the field.
+					if (close + 1 < end && close[1] == '"') {
+						text += '"';
+						++ close;
+					} else {
+						break;
+					}
+				} while (true);
+				lines += static_cast<std::size_t>(std::count(position, close, '\n'));
+				position = close + 1;
+				fields.push_back(atom(text));
+				newline = static_cast<const char*>(std::memchr(position, '\n', static_cast<std::size_t>(end - position)));
+				lineEnd = newline != nullptr ? newline : end;
+			} else {
+				const char* last = static_cast<const char*>(std::memchr(position, delimiter, static_cast<std::size_t>(lineEnd - position)));
+				if (last == nullptr) {
+					last = lineEnd;
+				}
+				// Lines may end with a carriage return, which is not part of their last field.
+				fields.push_back(field(position, last == lineEnd && last > position && last[-1] == '\r' ? last - 1 : last));
+				position = last;
+			}
+			if (position < lineEnd && *position == delimiter) {
+				++ position;
+				continue;
+			}
+			if (position < lineEnd && *position == '\r') {
+				++ position;
+			}
+			if (position != lineEnd) {
+				throw CompilationException("The quoted field on line " + std::to_string(lines) + " of " + path + " is not followed by a delimiter.", __FILENAME__, __func__, __LINE__);
+			}
+			if (position < end) {
+				++ position;
+				++ lines;
+			}
+			return true;
+		}
+	}
+	
+	Cell DelimitedFile::field(const char* first, const char* last) {
+		const char* digits = first < last && *first == '-' ? first + 1 : first;
+		// Integers of up to 18 digits may always be represented.
+		if (digits < last && last - digits <= 18 && std::all_of(digits, last, [] (char c) { return c >= '0' && c <= '9'; })) {
+			int64_t value = 0;
+			for (const char* digit = digits; digit < last; ++ digit) {
+				value = value * 10 + (*digit - '0');
+			}
+			return Cell::integer(digits == first ? value : -value);
+		}
+		text.assign(first, last);
+		return atom(text);
+	}
+	
+	Cell DelimitedFile::atom(const std::string& value) {
+		// An atom beginning with a lowercase letter is named by its text (as when it is quoted, so long as it has no quotes to escape), so it is interned directly.
+		if (!value.empty() && value[0] >= 'a' && value[0] <= 'z' && value.find('\'') == std::string::npos) {
+			return Cell::constant(SymbolTable::intern(value, 0));
+		}
+		std::string escaped;
+		for (char c : value) {
+			if (c == '\'') {
+				escaped += '\\';
+			}
+			escaped += c;
+		}
+		return Cell::constant(SymbolTable::intern(AST::normaliseIdentifierName("'" + escaped + "'"), 0));
+	}
+}
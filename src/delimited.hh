@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "runtime.hh"
+
+namespace Epilog {
+	// Reads the rows of a file of delimited values, which is mapped into memory rather than read through a buffer, so that database exports may be loaded as facts without being converted into clauses and parsed.
+	// Fields are separated by tabs if the first line has one, and by commas otherwise. As in RFC 4180, fields of comma-separated files may be quoted with double quotes (which are doubled within them). Blank lines are skipped.
+	// Each field is read as an integer if it is one (and is neither quoted nor too large to be represented), and otherwise as an atom, named as if the field had been written as a quoted atom.
+	class DelimitedFile {
+		public:
+		// Maps the file, throwing a CompilationException if it cannot be read.
+		DelimitedFile(const std::string& path);
+		
+		~DelimitedFile();
+		
+		DelimitedFile(const DelimitedFile&) = delete;
+		DelimitedFile& operator=(const DelimitedFile&) = delete;
+		
+		// Reads the fields of the next row, returning false at the end of the file.
+		bool next(std::vector<Cell>& fields);
+		
+		// The line on which the last row read begins.
+		std::size_t line() const {
+			return row;
+		}
+		
+		private:
+		Cell field(const char* first, const char* last);
+		
+		Cell atom(const std::string& value);
+		
+		const std::string path;
+		const char* data = nullptr;
+		std::size_t size = 0;
+		const char* position = nullptr;
+		const char* end = nullptr;
+		char delimiter = ',';
+		std::size_t lines = 1;
+		std::size_t row = 0;
+		std::string text;
+	};
+}
@@ -91,8 +91,17 @@ namespace Epilog {
 			// Query: a way by which we can invoke unification of rules without an interactive mode.
 			Rule query = "?-"_E >> compoundTerms;
 			
-			// Clause: either a fact, a rule, or a query.
-			Rule clause = (query | rule | fact) >> '.';
+			// Predicate indicator: the name and arity of a predicate, such as path/2.
+			Rule indicator = identifier >> '/' >> number;
+			
+			// Table directive: declares predicates whose calls are tabled, so that each variant of a call is only evaluated once.
+			Rule tableDirective = ":-"_E >> "table" >> indicator >> *(',' >> indicator);
+			
+			// Load directive: loads the rows of a file of comma- or tab-separated values as facts of a predicate, such as edge/2.
+			Rule loadDirective = ":-"_E >> "load_csv" >> '(' >> identifier >> ',' >> indicator >> ')';
+			
+			// Clause: either a fact, a rule, a query, or a directive.
+			Rule clause = (query | tableDirective | loadDirective | rule | fact) >> '.';
 			
 			// Clauses: a standard Epilog program is made up of a series of clauses.
 			Rule clauses = *clause;
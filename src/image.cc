@@ -0,0 +1,506 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <functional>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "image.hh"
+#include "interpreter.hh"
+#include "standardlibrary.hh"
+
+namespace Epilog {
+	// Images are only loaded by the version of Epilog that saved them, as the bytecode changes between versions.
+	static const Image::word magic = 0x45504c47494d4147;
+	// The version of the layout of the image itself, which is bumped whenever it changes.
+	static const Image::word format = 5;
+	
+	// Returns the version of the images saved by this build, which hashes the layout of the image along with the opcodes and the number of operands of each, so that images saved by a build whose bytecode differs are not loaded, even if the layout was not bumped.
+	static Image::word version() {
+		static const Image::word version = [] {
+			Image::word opcodes = static_cast<Image::word>(Opcode::native) + 1;
+			uint64_t hash = UINT64_C(14695981039346656037);
+			for (Image::word value : { format, opcodes }) {
+				hash = (hash ^ value) * UINT64_C(1099511628211);
+			}
+			for (Image::word opcode = 0; opcode < opcodes; ++ opcode) {
+				hash = (hash ^ Bytecode::operands[opcode]) * UINT64_C(1099511628211);
+			}
+			return hash;
+		}();
+		return version;
+	}
+	
+	void Image::addQuery(Instruction::instructionReference startAddress, Instruction::instructionReference endAddress) {
+		Query query { startAddress, endAddress, { } };
+		for (auto& label : Runtime::currentRuntime->labels) {
+			auto previous = labels.find(label.first);
+			if (previous == labels.end() || previous->second != label.second) {
+				query.labels.emplace_back(label.first, label.second);
+				labels[label.first] = label.second;
+			}
+		}
+		queries.push_back(query);
+	}
+	
+	void Image::addFile(const std::string& path) {
+		// The file is recorded by its absolute path, so that it is found again whatever the working directory of a later run.
+		char* absolute = realpath(path.c_str(), nullptr);
+		struct stat status;
+		if (absolute == nullptr || stat(absolute, &status) == -1) {
+			std::free(absolute);
+			throw RuntimeException("Could not read " + path + ": " + std::strerror(errno) + ".", __FILENAME__, __func__, __LINE__);
+		}
+		files.push_back(File { absolute, static_cast<word>(status.st_mtime) });
+		std::free(absolute);
+	}
+	
+	std::vector<Image::word> Image::save() {
+		Bytecode& code = *Runtime::currentRuntime->code;
+		std::vector<word> image { magic, version(), Runtime::currentRuntime->registers.size() };
+		
+		image.push_back(SymbolTable::size());
+		for (SymbolTable::symbolIndex symbol = 0; symbol < SymbolTable::size(); ++ symbol) {
+			const HeapFunctor& functor = SymbolTable::get(symbol);
+			image.push_back(static_cast<word>(functor.parameters));
+			image.push_back(functor.name.size());
+			for (std::string::size_type i = 0; i < functor.name.size(); i += sizeof(word)) {
+				word characters = 0;
+				functor.name.copy(reinterpret_cast<char*>(&characters), sizeof(word), i);
+				image.push_back(characters);
+			}
+		}
+		
+		// Pointer operands are replaced by the index of what they point to, in the order it is first referred to, or by 0 if they are resolved again when loading.
+		std::vector<std::pair<Opcode, const std::unordered_map<word, Instruction::instructionReference>*>> tables;
+		std::vector<const ArgumentIndex*> argumentIndexes;
+		std::vector<const PredicateProfile*> profiles;
+		image.push_back(code.size());
+		std::vector<word>::size_type start = image.size();
+		image.insert(image.end(), code.words.begin(), code.words.end());
+		for (Instruction::instructionReference address = 0; address < code.size(); address = code.next(address)) {
+			word& operand = image[start + address + 1];
+			switch (code.opcode(address)) {
+				case Opcode::call:
+				case Opcode::execute:
+					(&operand)[3] = 0;
+					break;
+				case Opcode::switch_on_constant:
+				case Opcode::switch_on_structure:
+					tables.emplace_back(code.opcode(address), reinterpret_cast<const std::unordered_map<word, Instruction::instructionReference>*>(operand));
+					operand = tables.size() - 1;
+					break;
+				case Opcode::index_arguments:
+					argumentIndexes.push_back(reinterpret_cast<const ArgumentIndex*>(operand));
+					operand = argumentIndexes.size() - 1;
+					break;
+				case Opcode::command:
+					(&operand)[1] = 0;
+					break;
+				case Opcode::profile:
+					profiles.push_back(reinterpret_cast<const PredicateProfile*>(operand));
+					operand = profiles.size() - 1;
+					break;
+				case Opcode::parallel_call:
+					throw CompilationException("Parallel conjunctions may not be saved in an image.", __FILENAME__, __func__, __LINE__);
+				case Opcode::native:
+					throw CompilationException("Native code may not be saved in an image.", __FILENAME__, __func__, __LINE__);
+				default:
+					break;
+			}
+		}
+		
+		image.push_back(tables.size());
+		for (auto& table : tables) {
+			image.push_back(static_cast<word>(table.first));
+			image.push_back(table.second->size());
+			for (auto& entry : *table.second) {
+				image.push_back(entry.first);
+				image.push_back(entry.second);
+			}
+		}
+		
+		image.push_back(argumentIndexes.size());
+		for (const ArgumentIndex* index : argumentIndexes) {
+			image.push_back(index->functor);
+			image.push_back(index->clauses.size());
+			image.insert(image.end(), index->clauses.begin(), index->clauses.end());
+			image.push_back(index->keys.size());
+			for (auto& keys : index->keys) {
+				for (const Cell& key : keys) {
+					image.push_back(key.value);
+				}
+			}
+		}
+		
+		image.push_back(profiles.size());
+		for (const PredicateProfile* profile : profiles) {
+			image.insert(image.end(), { profile->functor, profile->start, profile->end, profile->entry });
+		}
+		
+		image.push_back(queries.size());
+		for (auto& query : queries) {
+			image.insert(image.end(), { query.startAddress, query.endAddress, query.labels.size() });
+			for (auto& label : query.labels) {
+				image.push_back(label.first);
+				image.push_back(label.second);
+			}
+		}
+		
+		image.push_back(files.size());
+		for (const File& file : files) {
+			image.push_back(file.modified);
+			image.push_back(file.path.size());
+			for (std::string::size_type i = 0; i < file.path.size(); i += sizeof(word)) {
+				word characters = 0;
+				file.path.copy(reinterpret_cast<char*>(&characters), sizeof(word), i);
+				image.push_back(characters);
+			}
+		}
+		return image;
+	}
+	
+	void Image::save(const std::string& path) {
+		std::vector<word> image = save();
+		// The image is written beside the file, and then moved over it.
+		std::string partial = path + ".partial";
+		std::ofstream file(partial, std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char*>(image.data()), static_cast<std::streamsize>(image.size() * sizeof(word)));
+		file.close();
+		if (!file || std::rename(partial.c_str(), path.c_str()) != 0) {
+			std::remove(partial.c_str());
+			throw RuntimeException("Could not write the image " + path + ".", __FILENAME__, __func__, __LINE__);
+		}
+	}
+	
+	void Image::load(const word* words, std::size_t size) {
+		Bytecode& code = *Runtime::currentRuntime->code;
+		std::size_t position = 0;
+		auto next = [&] () {
+			if (position >= size) {
+				throw RuntimeException("The image is truncated.", __FILENAME__, __func__, __LINE__);
+			}
+			return words[position ++];
+		};
+		if (next() != magic || next() != version()) {
+			throw RuntimeException("The image was not saved by this version of Epilog.", __FILENAME__, __func__, __LINE__);
+		}
+		if (code.size() > 0) {
+			throw RuntimeException("Tried to load an image after code has been linked.", __FILENAME__, __func__, __LINE__);
+		}
+		
+		word registers = next();
+		while (Runtime::currentRuntime->registers.size() < registers) {
+			Runtime::currentRuntime->registers.push_back(Cell());
+		}
+		
+		// The symbols of the image are interned in this process, which may have assigned them different indices.
+		std::vector<SymbolTable::symbolIndex> symbols(next());
+		for (auto& symbol : symbols) {
+			int64_t parameters = static_cast<int64_t>(next());
+			std::string name(next(), '\0');
+			for (std::string::size_type i = 0; i < name.size(); i += sizeof(word)) {
+				word characters = next();
+				name.replace(i, sizeof(word), reinterpret_cast<const char*>(&characters), std::min(sizeof(word), name.size() - i));
+			}
+			symbol = SymbolTable::intern(name, parameters);
+		}
+		auto symbol = [&symbols] (word symbol) {
+			if (symbol >= symbols.size()) {
+				throw RuntimeException("The image refers to an unknown symbol.", __FILENAME__, __func__, __LINE__);
+			}
+			return symbols[symbol];
+		};
+		auto cell = [&symbol] (word value) {
+			Cell cell;
+			cell.value = value;
+			switch (cell.tag()) {
+				case Cell::Tag::constant:
+					return Cell::constant(symbol(cell.symbol()));
+				case Cell::Tag::functor:
+					return Cell::functor(symbol(cell.symbol()));
+				default:
+					return cell;
+			}
+		};
+		
+		word codeSize = next();
+		if (codeSize > size - position) {
+			throw RuntimeException("The image is truncated.", __FILENAME__, __func__, __LINE__);
+		}
+		code.words.assign(words + position, words + position + codeSize);
+		position += codeSize;
+		
+		std::vector<std::unordered_map<word, Instruction::instructionReference>*> tables(next());
+		for (auto& table : tables) {
+			bool structures = static_cast<Opcode>(next()) == Opcode::switch_on_structure;
+			code.tables.emplace_back();
+			table = &code.tables.back();
+			for (word entries = next(); entries > 0; -- entries) {
+				word key = next();
+				table->emplace(structures ? symbol(key) : cell(key).value, next());
+			}
+		}
+		
+		std::vector<ArgumentIndex*> argumentIndexes(next());
+		for (auto& index : argumentIndexes) {
+			std::shared_ptr<ArgumentIndex> argumentIndex = std::make_shared<ArgumentIndex>(symbol(next()));
+			std::vector<Instruction::instructionReference> clauses(next());
+			for (auto& clause : clauses) {
+				clause = next();
+			}
+			std::vector<std::vector<Cell>> keys(next(), std::vector<Cell>(clauses.size()));
+			for (auto& argument : keys) {
+				for (Cell& key : argument) {
+					key = cell(next());
+				}
+			}
+			argumentIndex->update(clauses, keys);
+			code.argumentIndexes.push_back(argumentIndex);
+			// Each index replaces any earlier one for the same functor, as when the predicate is relinked.
+			Runtime::currentRuntime->argumentIndexes[argumentIndex->functor] = argumentIndex;
+			index = argumentIndex.get();
+		}
+		
+		std::vector<PredicateProfile*> profiles(next());
+		for (auto& profile : profiles) {
+			SymbolTable::symbolIndex functor = symbol(next());
+			Instruction::instructionReference start = next(), end = next(), entry = next();
+			code.profiles.emplace_back(functor, start, end, entry);
+			profile = &code.profiles.back();
+		}
+		
+		// Any operand that refers to a symbol or pointer is resolved, now that everything it may refer to has been loaded.
+		auto index = [] (word index, std::size_t size) {
+			if (index >= size) {
+				throw RuntimeException("The image refers to an unknown operand.", __FILENAME__, __func__, __LINE__);
+			}
+			return index;
+		};
+		// Integer registers are held in a fixed array, so every register an instruction names must be within it.
+		auto integers = [&code] (Instruction::instructionReference address, std::initializer_list<std::size_t> operands) {
+			for (std::size_t operand : operands) {
+				if (code.operand(address, operand) >= Runtime::integerRegisters) {
+					throw RuntimeException("The image contains invalid code.", __FILENAME__, __func__, __LINE__);
+				}
+			}
+		};
+		std::vector<bool> starts(code.size(), false);
+		for (Instruction::instructionReference address = 0; address < code.size(); address = code.next(address)) {
+			if (code.opcode(address) > Opcode::native || code.next(address) > code.size()) {
+				throw RuntimeException("The image contains invalid code.", __FILENAME__, __func__, __LINE__);
+			}
+			starts[address] = true;
+			switch (code.opcode(address)) {
+				case Opcode::put_structure:
+				case Opcode::get_structure:
+				case Opcode::table:
+					code.operand(address, 0) = symbol(code.operand(address, 0));
+					break;
+				case Opcode::call:
+				case Opcode::execute: {
+					code.operand(address, 0) = symbol(code.operand(address, 0));
+					const Instruction::instructionReference* label = &Runtime::currentRuntime->labels.emplace(code.operand(address, 0), Instruction::failLabel).first->second;
+					code.operand(address, 3) = reinterpret_cast<word>(label);
+					break;
+				}
+				case Opcode::switch_on_constant:
+				case Opcode::switch_on_structure:
+					code.operand(address, 0) = reinterpret_cast<word>(tables[index(code.operand(address, 0), tables.size())]);
+					break;
+				case Opcode::index_arguments:
+					code.operand(address, 0) = reinterpret_cast<word>(argumentIndexes[index(code.operand(address, 0), argumentIndexes.size())]);
+					break;
+				case Opcode::command: {
+					code.operand(address, 0) = symbol(code.operand(address, 0));
+					auto command = StandardLibrary::commands.find(code.operand(address, 0));
+					code.operand(address, 1) = reinterpret_cast<word>(command != StandardLibrary::commands.end() ? &command->second : nullptr);
+					break;
+				}
+				case Opcode::load_integer:
+				case Opcode::load_constant:
+					integers(address, { 1 });
+					break;
+				case Opcode::add:
+				case Opcode::subtract:
+				case Opcode::multiply:
+				case Opcode::divide:
+				case Opcode::modulo:
+					integers(address, { 0, 1, 2 });
+					break;
+				case Opcode::less_than:
+				case Opcode::less_or_equal:
+				case Opcode::greater_than:
+				case Opcode::greater_or_equal:
+					integers(address, { 0, 1 });
+					break;
+				case Opcode::store_integer:
+				case Opcode::unify_integer:
+					integers(address, { 0 });
+					break;
+				case Opcode::profile:
+					code.operand(address, 0) = reinterpret_cast<word>(profiles[index(code.operand(address, 0), profiles.size())]);
+					break;
+				case Opcode::parallel_call:
+					throw RuntimeException("The image contains a parallel conjunction.", __FILENAME__, __func__, __LINE__);
+				case Opcode::native:
+					throw RuntimeException("The image contains native code.", __FILENAME__, __func__, __LINE__);
+				default:
+					break;
+			}
+		}
+		
+		queries.clear();
+		labels.clear();
+		for (word count = next(); count > 0; -- count) {
+			Query query;
+			query.startAddress = next();
+			query.endAddress = next();
+			for (word labels = next(); labels > 0; -- labels) {
+				SymbolTable::symbolIndex functor = symbol(next());
+				query.labels.emplace_back(functor, next());
+			}
+			queries.push_back(query);
+		}
+		
+		// Labels are jumped to without being checked while the code is executed, so each must be the start of an instruction (or the fail label).
+		auto target = [&starts] (Instruction::instructionReference label) {
+			if (label != Instruction::failLabel && (label >= starts.size() || !starts[label])) {
+				throw RuntimeException("The image contains a label that is not the start of an instruction.", __FILENAME__, __func__, __LINE__);
+			}
+		};
+		for (Instruction::instructionReference address = 0; address < code.size(); address = code.next(address)) {
+			switch (code.opcode(address)) {
+				case Opcode::try_me_else:
+				case Opcode::retry_me_else:
+				case Opcode::try_clause:
+				case Opcode::retry_clause:
+				case Opcode::trust_clause:
+					target(code.operand(address, 0));
+					break;
+				case Opcode::switch_on_term:
+					for (word operand = 0; operand < 4; ++ operand) {
+						target(code.operand(address, operand));
+					}
+					break;
+				case Opcode::switch_on_constant:
+				case Opcode::switch_on_structure:
+				case Opcode::index_arguments:
+				case Opcode::table:
+					target(code.operand(address, 1));
+					break;
+				default:
+					break;
+			}
+		}
+		for (auto& table : code.tables) {
+			for (auto& entry : table) {
+				target(entry.second);
+			}
+		}
+		for (auto& index : code.argumentIndexes) {
+			for (Instruction::instructionReference clause : index->clauses) {
+				target(clause);
+			}
+		}
+		for (const PredicateProfile& profile : code.profiles) {
+			target(profile.start);
+			target(profile.entry);
+			if (profile.end > code.size()) {
+				throw RuntimeException("The image contains a label that is not the start of an instruction.", __FILENAME__, __func__, __LINE__);
+			}
+		}
+		for (const Query& query : queries) {
+			target(query.startAddress);
+			target(query.endAddress);
+			for (auto& label : query.labels) {
+				target(label.second);
+			}
+		}
+		
+		files.clear();
+		for (word count = next(); count > 0; -- count) {
+			File file;
+			file.modified = next();
+			file.path.assign(next(), '\0');
+			for (std::string::size_type i = 0; i < file.path.size(); i += sizeof(word)) {
+				word characters = next();
+				file.path.replace(i, sizeof(word), reinterpret_cast<const char*>(&characters), std::min(sizeof(word), file.path.size() - i));
+			}
+			files.push_back(file);
+		}
+	}
+	
+	bool Image::load(const std::string& path) {
+		int file = open(path.c_str(), O_RDONLY);
+		struct stat status;
+		if (file == -1 || fstat(file, &status) == -1) {
+			if (file != -1) {
+				close(file);
+			}
+			throw RuntimeException("Could not read the image " + path + ": " + std::strerror(errno) + ".", __FILENAME__, __func__, __LINE__);
+		}
+		std::size_t size = static_cast<std::size_t>(status.st_size) / sizeof(word);
+		void* mapping = size >= 2 ? mmap(nullptr, static_cast<std::size_t>(status.st_size), PROT_READ, MAP_PRIVATE, file, 0) : MAP_FAILED;
+		close(file);
+		if (mapping == MAP_FAILED) {
+			return false;
+		}
+		const word* words = static_cast<const word*>(mapping);
+		bool current = words[0] == magic && words[1] == version();
+		bool linked = Runtime::currentRuntime->code->size() > 0;
+		try {
+			if (current) {
+				load(words, size);
+			}
+		} catch (...) {
+			munmap(mapping, static_cast<std::size_t>(status.st_size));
+			if (linked) {
+				throw;
+			}
+			// An image is only a cache of the program, so one that is corrupt or truncated (even if its counts are so large that they cannot be allocated) is treated as though it were stale.
+			discard();
+			return false;
+		}
+		munmap(mapping, static_cast<std::size_t>(status.st_size));
+		// The image is also stale once any file that the program loaded has changed (or gone), as their contents are held in the image.
+		for (const File& file : files) {
+			struct stat modified;
+			if (stat(file.path.c_str(), &modified) == -1 || static_cast<word>(modified.st_mtime) != file.modified) {
+				discard();
+				return false;
+			}
+		}
+		return current;
+	}
+	
+	void Image::discard() {
+		Runtime& runtime = *Runtime::currentRuntime;
+		Bytecode& code = *runtime.code;
+		code.words.clear();
+		code.tables.clear();
+		code.argumentIndexes.clear();
+		code.profiles.clear();
+		runtime.labels.clear();
+		runtime.argumentIndexes.clear();
+		queries.clear();
+		labels.clear();
+		files.clear();
+	}
+	
+	bool Image::execute() {
+		Runtime& runtime = *Runtime::currentRuntime;
+		for (auto& query : queries) {
+			for (auto& label : query.labels) {
+				runtime.labels[label.first] = label.second;
+			}
+			if (!AST::executeInstructions(runtime, query.startAddress, query.endAddress, nullptr)) {
+				return false;
+			}
+		}
+		return true;
+	}
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "runtime.hh"
+
+namespace Epilog {
+	// The linked code of a program, along with the queries to execute, in a form that may be saved and executed later, without parsing or compiling the program again.
+	// Pointer operands are saved as indices into the image, and symbols are interned again when the image is loaded, as their indices may differ between processes.
+	class Image {
+		public:
+		typedef uint64_t word;
+		
+		// Records a query of the current runtime, along with any labels that have changed since the last query.
+		void addQuery(Instruction::instructionReference startAddress, Instruction::instructionReference endAddress);
+		
+		// Records a file that the program was compiled from, other than the program itself (such as one loaded by load_csv), so that the image is stale once the file changes.
+		void addFile(const std::string& path);
+		
+		// Returns the words of an image of the current runtime's code, and of the recorded queries.
+		std::vector<word> save();
+		
+		// Saves an image of the current runtime to a file, which is replaced at once, so that it is never read while partly written.
+		void save(const std::string& path);
+		
+		// Loads an image into the current runtime, replacing any recorded queries with those of the image.
+		void load(const word* words, std::size_t size);
+		
+		// Loads an image from a file, which is mapped into memory rather than read.
+		// Returns false, having loaded nothing, if the file is not an image saved by this version of Epilog, is corrupt or truncated, or if a file recorded by addFile has changed since it was saved.
+		bool load(const std::string& path);
+		
+		// Executes each recorded query in turn, stopping at the first to fail.
+		bool execute();
+		
+		private:
+		struct Query {
+			Instruction::instructionReference startAddress;
+			Instruction::instructionReference endAddress;
+			// The labels that are set before the query is executed.
+			std::vector<std::pair<SymbolTable::symbolIndex, Instruction::instructionReference>> labels;
+		};
+		
+		struct File {
+			std::string path;
+			word modified;
+		};
+		
+		// Discards everything loaded from an image that turned out to be stale.
+		void discard();
+		
+		std::vector<Query> queries;
+		std::vector<File> files;
+		// The labels as of the last recorded query.
+		std::unordered_map<SymbolTable::symbolIndex, Instruction::instructionReference> labels;
+	};
+}
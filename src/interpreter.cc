@@ -1,9 +1,15 @@
+#include <algorithm>
+#include <map>
+#include <numeric>
 #include <queue>
 #include <stack>
 #include <unordered_map>
 #include <unordered_set>
+#include "conjunction.hh"
+#include "delimited.hh"
 #include "parser.hh"
 #include "standardlibrary.hh"
+#include "tabling.hh"
 
 #ifndef DEBUG
 	#define DEBUG false
@@ -11,160 +17,142 @@
 
 namespace Epilog {
 	Instruction::instructionReference pushInstruction(Interpreter::Context& context, Instruction* instruction) {
-		Instruction::instructionReference instructionAddress = context.insertionAddress;
+		// Returns the address of the instruction relative to the start of the block.
+		Instruction::instructionReference instructionAddress = context.block.size();
 		if (instruction != nullptr) {
-			Runtime::currentRuntime->instructions->insert(Runtime::currentRuntime->instructions->begin() + (context.insertionAddress ++), std::unique_ptr<Instruction>(instruction));
+			context.block.push_back(std::shared_ptr<Instruction>(instruction));
 		}
 		return instructionAddress;
 	}
 	
-	std::unordered_map<std::string, std::function<void(Interpreter::Context& context, HeapReference::heapIndex& registers)>> StandardLibrary::functions = {
-		{ "./2", [] (Interpreter::Context& context, HeapReference::heapIndex& registers) {
+	Instruction::instructionReference linkInstruction(Instruction* instruction) {
+		std::unique_ptr<Instruction> owner(instruction);
+		return Runtime::currentRuntime->code->append(*instruction);
+	}
+	
+	Instruction::instructionReference linkBlock(const Interpreter::CodeBlock& block) {
+		Instruction::instructionReference address = Runtime::currentRuntime->code->size();
+		for (auto& instruction : block) {
+			Runtime::currentRuntime->code->append(*instruction);
+		}
+		return address;
+	}
+	
+	std::unordered_map<SymbolTable::symbolIndex, std::function<void(Interpreter::Context& context, HeapReference::heapIndex& registers)>> StandardLibrary::functions = {
+		{ SymbolTable::intern(".", 2), [] (Interpreter::Context& context, HeapReference::heapIndex& registers) {
 			pushInstruction(context, new CommandInstruction("exception"));
 		} },
-		{ "[]/0", [] (Interpreter::Context& context, HeapReference::heapIndex& registers) {
+		{ SymbolTable::intern("[]", 0), [] (Interpreter::Context& context, HeapReference::heapIndex& registers) {
 			pushInstruction(context, new CommandInstruction("exception"));
 		} },
-		{ "is/2", [] (Interpreter::Context& context, HeapReference::heapIndex& registers) {
-			pushInstruction(context, new CommandInstruction("evaluate"));
-			pushInstruction(context, new PushNumberInstruction(HeapNumber(0), HeapReference(StorageArea::reg, 1)));
-			pushInstruction(context, new UnifyRegisterAndArgumentInstruction(HeapReference(StorageArea::reg, 0), HeapReference(StorageArea::reg, 1)));
+		{ SymbolTable::intern("is", 2), [] (Interpreter::Context& context, HeapReference::heapIndex& registers) {
+			pushInstruction(context, new LoadIntegerInstruction(HeapReference(StorageArea::reg, 1), 0));
+			pushInstruction(context, new UnifyIntegerInstruction(0, HeapReference(StorageArea::reg, 0)));
 			pushInstruction(context, new ProceedInstruction());
 			registers = 2;
 		} },
-		{ "nl/0", [] (Interpreter::Context& context, HeapReference::heapIndex& registers) {
+		{ SymbolTable::intern("nl", 0), [] (Interpreter::Context& context, HeapReference::heapIndex& registers) {
 			pushInstruction(context, new CommandInstruction("nl"));
 			pushInstruction(context, new ProceedInstruction());
 		} },
-		{ "write/1", [] (Interpreter::Context& context, HeapReference::heapIndex& registers) {
+		{ SymbolTable::intern("statistics", 0), [] (Interpreter::Context& context, HeapReference::heapIndex& registers) {
+			pushInstruction(context, new CommandInstruction("statistics"));
+			pushInstruction(context, new ProceedInstruction());
+		} },
+		{ SymbolTable::intern("garbage_collect", 0), [] (Interpreter::Context& context, HeapReference::heapIndex& registers) {
+			pushInstruction(context, new CommandInstruction("garbage_collect"));
+			pushInstruction(context, new ProceedInstruction());
+		} },
+		{ SymbolTable::intern("write", 1), [] (Interpreter::Context& context, HeapReference::heapIndex& registers) {
 			pushInstruction(context, new CommandInstruction("print"));
 			pushInstruction(context, new ProceedInstruction());
 		} },
-		{ "writeln/1", [] (Interpreter::Context& context, HeapReference::heapIndex& registers) {
+		{ SymbolTable::intern("writeln", 1), [] (Interpreter::Context& context, HeapReference::heapIndex& registers) {
 			pushInstruction(context, new CommandInstruction("print"));
 			pushInstruction(context, new CommandInstruction("nl"));
 			pushInstruction(context, new ProceedInstruction());
 		} },
-		{ "true/0", [] (Interpreter::Context& context, HeapReference::heapIndex& registers) {
+		{ SymbolTable::intern("true", 0), [] (Interpreter::Context& context, HeapReference::heapIndex& registers) {
 			pushInstruction(context, new ProceedInstruction());
 		} },
-		{ "fail/0", [] (Interpreter::Context& context, HeapReference::heapIndex& registers) {
+		{ SymbolTable::intern("fail", 0), [] (Interpreter::Context& context, HeapReference::heapIndex& registers) {
 			// This call instruction will always fail, so there is no need for a following proceed instruction.
 			pushInstruction(context, new CallInstruction(HeapFunctor("", 0)));
 		} },
-		{ "=/2", [] (Interpreter::Context& context, HeapReference::heapIndex& registers) {
+		{ SymbolTable::intern("=", 2), [] (Interpreter::Context& context, HeapReference::heapIndex& registers) {
 			pushInstruction(context, new UnifyRegisterAndArgumentInstruction(HeapReference(StorageArea::reg, 0), HeapReference(StorageArea::reg, 1)));
 			pushInstruction(context, new ProceedInstruction());
 			registers = 2;
 		} },
-		{ "=</2", [] (Interpreter::Context& context, HeapReference::heapIndex& registers) {
-			pushInstruction(context, new CommandInstruction("<="));
+		{ SymbolTable::intern("=<", 2), [] (Interpreter::Context& context, HeapReference::heapIndex& registers) {
+			pushInstruction(context, new LoadIntegerInstruction(HeapReference(StorageArea::reg, 0), 0));
+			pushInstruction(context, new LoadIntegerInstruction(HeapReference(StorageArea::reg, 1), 1));
+			pushInstruction(context, new ComparisonInstruction(Opcode::less_or_equal, 0, 1));
 			pushInstruction(context, new ProceedInstruction());
 			registers = 2;
 		} },
-		{ "=>/2", [] (Interpreter::Context& context, HeapReference::heapIndex& registers) {
-			pushInstruction(context, new CommandInstruction(">="));
+		{ SymbolTable::intern("=>", 2), [] (Interpreter::Context& context, HeapReference::heapIndex& registers) {
+			pushInstruction(context, new LoadIntegerInstruction(HeapReference(StorageArea::reg, 0), 0));
+			pushInstruction(context, new LoadIntegerInstruction(HeapReference(StorageArea::reg, 1), 1));
+			pushInstruction(context, new ComparisonInstruction(Opcode::greater_or_equal, 0, 1));
 			pushInstruction(context, new ProceedInstruction());
 			registers = 2;
 		} },
-		{ "</2", [] (Interpreter::Context& context, HeapReference::heapIndex& registers) {
-			pushInstruction(context, new CommandInstruction("<"));
+		{ SymbolTable::intern("<", 2), [] (Interpreter::Context& context, HeapReference::heapIndex& registers) {
+			pushInstruction(context, new LoadIntegerInstruction(HeapReference(StorageArea::reg, 0), 0));
+			pushInstruction(context, new LoadIntegerInstruction(HeapReference(StorageArea::reg, 1), 1));
+			pushInstruction(context, new ComparisonInstruction(Opcode::less_than, 0, 1));
 			pushInstruction(context, new ProceedInstruction());
 			registers = 2;
 		} },
-		{ ">/2", [] (Interpreter::Context& context, HeapReference::heapIndex& registers) {
-			pushInstruction(context, new CommandInstruction(">"));
+		{ SymbolTable::intern(">", 2), [] (Interpreter::Context& context, HeapReference::heapIndex& registers) {
+			pushInstruction(context, new LoadIntegerInstruction(HeapReference(StorageArea::reg, 0), 0));
+			pushInstruction(context, new LoadIntegerInstruction(HeapReference(StorageArea::reg, 1), 1));
+			pushInstruction(context, new ComparisonInstruction(Opcode::greater_than, 0, 1));
 			pushInstruction(context, new ProceedInstruction());
 			registers = 2;
 		} }
 	};
 	
-	int64_t evaluateCompoundTerm(HeapReference reference) {
-		HeapContainer* container = reference.getPointer();
-		if (HeapTuple* tuple = dynamic_cast<HeapTuple*>(container)) {
-			if (tuple->type == HeapTuple::Type::compoundTerm) {
-				return evaluateCompoundTerm(HeapReference(StorageArea::heap, tuple->reference));
-			} else {
-				throw RuntimeException("Tried to evaluate an unbound variable.", __FILENAME__, __func__, __LINE__);
-			}
-		} else if (HeapFunctor* functor = dynamic_cast<HeapFunctor*>(container)) {
-			std::string& name = functor->name;
-			if (name == "+" && functor->parameters > 1) {
-				int64_t sum = 0;
-				for (int64_t i = 0; i < functor->parameters; ++ i) {
-					sum += evaluateCompoundTerm(dereference(HeapReference(StorageArea::heap, reference.index + (i + 1))));
-				}
-				return sum;
-			}
-			if (name == "-" && functor->parameters == 2) {
-				return evaluateCompoundTerm(dereference(HeapReference(StorageArea::heap, reference.index + 1))) - evaluateCompoundTerm(dereference(HeapReference(StorageArea::heap, reference.index + 2)));
-			}
-			if (name == "*" && functor->parameters > 1) {
-				int64_t product = 1;
-				for (int64_t i = 0; i < functor->parameters; ++ i) {
-					product *= evaluateCompoundTerm(dereference(HeapReference(StorageArea::heap, reference.index + (i + 1))));
+	std::unordered_map<SymbolTable::symbolIndex, std::function<bool(Runtime&)>> StandardLibrary::commands = {
+		{ SymbolTable::intern("exception", 0), [] (Runtime& runtime) -> bool {
+			throw RuntimeException("Tried to call a non-callable term.", __FILENAME__, __func__, __LINE__);
+		} },
+		{ SymbolTable::intern("nl", 0), [] (Runtime& runtime) {
+			*runtime.output << std::endl;
+			return true;
+		} },
+		{ SymbolTable::intern("statistics", 0), [] (Runtime& runtime) {
+			std::vector<std::string> indexes;
+			for (auto& pair : runtime.argumentIndexes) {
+				if (std::any_of(pair.second->tables.begin(), pair.second->tables.end(), [] (const std::unique_ptr<ArgumentIndex::Table>& table) { return table != nullptr; })) {
+					indexes.push_back(pair.second->toString());
 				}
-				return product;
 			}
-			if (name == "/" && functor->parameters == 2) {
-				return evaluateCompoundTerm(dereference(HeapReference(StorageArea::heap, reference.index + 1))) / evaluateCompoundTerm(dereference(HeapReference(StorageArea::heap, reference.index + 2)));
+			std::sort(indexes.begin(), indexes.end());
+			std::cerr << "Argument indexes:" << (indexes.size() > 0 ? "" : " (None)") << std::endl;
+			for (auto& index : indexes) {
+				std::cerr << "\t" << index << std::endl;
 			}
-			if (name == "mod" && functor->parameters == 2) {
-				int64_t x = evaluateCompoundTerm(dereference(HeapReference(StorageArea::heap, reference.index + 1)));
-				int64_t y = evaluateCompoundTerm(dereference(HeapReference(StorageArea::heap, reference.index + 2)));
-				return ((x % y) + y) % y;
+			std::cerr << "Garbage collection: " << runtime.collector.toString() << std::endl;
+			std::cerr << "\theap: " << runtime.heap.size() << " cells" << std::endl;
+			if (runtime.tables != nullptr) {
+				std::cerr << "Tables: " << runtime.tables->toString() << std::endl;
 			}
-			throw RuntimeException("Tried to evaluate a functor (" + functor->toString() + ") that is not a recognised operation.", __FILENAME__, __func__, __LINE__);
-		} else if (HeapNumber* number = dynamic_cast<HeapNumber*>(container)) {
-			return number->value;
-		} else {
-			throw RuntimeException("Tried to evaluate an unknown container.", __FILENAME__, __func__, __LINE__);
-		}
-	}
-	
-	void compareOperands(std::function<bool(int64_t, int64_t)> comparison) {
-		if (!comparison(evaluateCompoundTerm(dereference(HeapReference(StorageArea::reg, 0))), evaluateCompoundTerm(dereference(HeapReference(StorageArea::reg, 1))))) {
-			throw UnificationError("Arithmetic comparison was not satisfied.", __FILENAME__, __func__, __LINE__);
-		}
-	}
-	
-	std::unordered_map<std::string, std::function<void()>> StandardLibrary::commands = {
-		{ "exception", [] {
-			throw RuntimeException("Tried to call a non-callable term.", __FILENAME__, __func__, __LINE__);
+			return true;
 		} },
-		{ "nl", [] {
-			std::cout << std::endl;
+		{ SymbolTable::intern("garbage_collect", 0), [] (Runtime& runtime) {
+			// The command is the whole of its predicate, which has no arguments.
+			runtime.collector.collect(runtime, 0);
+			return true;
 		} },
-		{ "print", [] {
-			if (Runtime::currentRuntime->registers[0] != nullptr) {
-				std::cout << Runtime::currentRuntime->registers[0]->trace() << std::flush;
+		{ SymbolTable::intern("print", 0), [] (Runtime& runtime) -> bool {
+			if (runtime.registers[0].tag() != Cell::Tag::empty) {
+				*runtime.output << runtime.registers[0].trace(runtime) << std::flush;
+				return true;
 			} else {
 				throw RuntimeException("Tried to print the contents of an unset register.", __FILENAME__, __func__, __LINE__);
 			}
-		} },
-		{ "evaluate", [] {
-			if (dynamic_cast<HeapTuple*>(Runtime::currentRuntime->registers[1].get()) || dynamic_cast<HeapNumber*>(Runtime::currentRuntime->registers[1].get())) {
-				if (PushNumberInstruction* instruction = dynamic_cast<PushNumberInstruction*>((*Runtime::currentRuntime->instructions)[Runtime::currentRuntime->nextInstruction + 1].get())) {
-					instruction->number.value = evaluateCompoundTerm(dereference(HeapReference(StorageArea::reg, 1)));
-					return;
-				} else {
-					throw ::Epilog::RuntimeException("Tried to evaluate a compound term without then pushing it to a register.", __FILENAME__, __func__, __LINE__);
-				}
-			} else {
-				throw RuntimeException("Tried to evaluate the value of a non-tuple address.", __FILENAME__, __func__, __LINE__);
-			}
-		} },
-		{ "<=", [] {
-			compareOperands(std::less_equal<int64_t>());
-		} },
-		{ ">=", [] {
-			compareOperands(std::greater_equal<int64_t>());
-		} },
-		{ "<", [] {
-			compareOperands(std::less<int64_t>());
-		} },
-		{ ">", [] {
-			compareOperands(std::greater<int64_t>());
 		} }
 	};
 	
@@ -172,17 +160,18 @@ namespace Epilog {
 		// Set up the built-in functions
 		HeapReference::heapIndex maximumRegisters = 0;
 		for (auto& pair : StandardLibrary::functions) {
-			const std::string& symbol = pair.first;
+			SymbolTable::symbolIndex symbol = pair.first;
 			if (DEBUG) {
-				std::cerr << "Register built-in function: " << symbol << std::endl;
+				std::cerr << "Register built-in function: " << SymbolTable::get(symbol).toString() << std::endl;
 			}
-			Runtime::currentRuntime->labels[symbol] = context.insertionAddress;
 			HeapReference::heapIndex registers = 0;
+			context.block.clear();
 			pair.second(context, registers);
+			Runtime::currentRuntime->labels[symbol] = linkBlock(context.block);
 			maximumRegisters = std::max(maximumRegisters, registers);
 		}
 		while (Runtime::currentRuntime->registers.size() < maximumRegisters) {
-			Runtime::currentRuntime->registers.push_back(nullptr);
+			Runtime::currentRuntime->registers.push_back(Cell());
 		}
 		if (DEBUG) {
 			std::cerr << std::endl;
@@ -190,7 +179,7 @@ namespace Epilog {
 	}
 	
 	namespace AST {
-		int64_t DynamicTerm::dynamicID = 0;
+		std::atomic<int64_t> DynamicTerm::dynamicID(0);
 		
 		struct CompoundTermWrapper: Printable {
 			CompoundTerm* compoundTerm;
@@ -212,8 +201,11 @@ namespace Epilog {
 			}
 		}
 		
-		std::pair<std::unordered_set<std::string>, std::unordered_map<std::string, HeapReference>> findVariablePermanence(CompoundTerm* head, pegmatite::ASTList<EnrichedCompoundTerm>* goals, bool forcePermanence) {
+		// Permanent variables are numbered in order of their last appearance, latest first, so that those no longer needed after each goal are at the end of the environment, from which they may be trimmed.
+		// The number of permanent variables still needed after each goal is returned in retained, and the variables of each clause (the head, and then each goal) in clauseVariables, if it is given.
+		std::pair<std::unordered_set<std::string>, std::unordered_map<std::string, HeapReference>> findVariablePermanence(CompoundTerm* head, pegmatite::ASTList<EnrichedCompoundTerm>* goals, bool forcePermanence, std::vector<HeapReference::heapIndex>& retained, std::vector<std::unordered_set<std::string>>* clauseVariables = nullptr) {
 			std::unordered_map<std::string, int64_t> appearances;
+			std::unordered_map<std::string, int64_t> lastAppearances;
 			std::queue<CompoundTerm*> clauses;
 			std::queue<Term*> terms;
 			if (head != nullptr) {
@@ -224,7 +216,7 @@ namespace Epilog {
 					clauses.push(goal->compoundTerm.get());
 				}
 			}
-			while (!clauses.empty()) {
+			for (int64_t clause = 0; !clauses.empty(); ++ clause) {
 				std::unordered_set<std::string> variables;
 				terms.push(clauses.front()); clauses.pop();
 				while (!terms.empty()) {
@@ -242,18 +234,40 @@ namespace Epilog {
 						appearances[symbol] = 0;
 					}
 					++ appearances[symbol];
+					lastAppearances[symbol] = clause;
+				}
+				if (clauseVariables != nullptr) {
+					clauseVariables->push_back(variables);
 				}
 			}
 			std::unordered_set<std::string> temporaries;
-			std::unordered_map<std::string, HeapReference> permanents;
-			HeapReference::heapIndex index = 0;
+			std::vector<std::string> permanentSymbols;
 			for (auto& appearance : appearances) {
 				if (appearance.second > 1 || forcePermanence) {
-					permanents[appearance.first] = HeapReference(StorageArea::environment, index ++);
+					permanentSymbols.push_back(appearance.first);
 				} else {
 					temporaries.insert(appearance.first);
 				}
 			}
+			std::sort(permanentSymbols.begin(), permanentSymbols.end(), [&lastAppearances] (const std::string& a, const std::string& b) {
+				return lastAppearances[a] != lastAppearances[b] ? lastAppearances[a] > lastAppearances[b] : a < b;
+			});
+			std::unordered_map<std::string, HeapReference> permanents;
+			HeapReference::heapIndex index = 0;
+			for (auto& symbol : permanentSymbols) {
+				permanents[symbol] = HeapReference(StorageArea::environment, index ++);
+			}
+			retained.clear();
+			if (goals != nullptr) {
+				int64_t clause = head != nullptr ? 1 : 0;
+				for (auto it = goals->begin(); it != goals->end(); ++ it, ++ clause) {
+					HeapReference::heapIndex variables = 0;
+					while (variables < permanentSymbols.size() && lastAppearances[permanentSymbols[variables]] > clause) {
+						++ variables;
+					}
+					retained.push_back(variables);
+				}
+			}
 			return std::make_pair(temporaries, permanents);
 		}
 		
@@ -347,6 +361,16 @@ namespace Epilog {
 			return atom;
 		}
 		
+		std::unique_ptr<CompoundTerm> createTermWithVariables(std::string name, const std::vector<std::string>& variables) {
+			std::unique_ptr<CompoundTerm> term = createAtomWithName(name);
+			for (auto& symbol : variables) {
+				std::unique_ptr<Variable> variable(new Variable());
+				variable->name.std::string::operator=(symbol);
+				term->parameterList->parameters.push_back(std::move(variable));
+			}
+			return term;
+		}
+		
 		std::unique_ptr<CompoundTerm> createListWrapper(bool empty = false) {
 			return createAtomWithName(!empty ? "." : "[]"); // Special symbols for lists.
 		}
@@ -441,11 +465,11 @@ namespace Epilog {
 				}
 			}
 			
-			Instruction::instructionReference startAddress = Runtime::currentRuntime->instructions->size();
+			Instruction::instructionReference startAddress = context.block.size();
 			
 			// Use the runtime instructions to build this structure on the heap
 			while (Runtime::currentRuntime->registers.size() < registers.size()) {
-				Runtime::currentRuntime->registers.push_back(nullptr);
+				Runtime::currentRuntime->registers.push_back(Cell());
 			}
 			std::deque<std::pair<std::shared_ptr<TermNode>, bool>> terms;
 			std::stack<std::pair<std::shared_ptr<TermNode>, bool>> reverse;
@@ -520,21 +544,48 @@ namespace Epilog {
 				} else {
 					throw CompilationException("Found a modifier of an unknown type in the query.", __FILENAME__, __func__, __LINE__);
 				}
-				
+			
 			}
 			pushInstruction(context, conclusionInstruction);
 			
+			// The nodes refer to their parents, so the tree is released explicitly, lest it be leaked with each clause (as by a server, which compiles every query it is sent).
+			std::stack<std::shared_ptr<TermNode>> nodes;
+			nodes.push(root);
+			while (!nodes.empty()) {
+				std::shared_ptr<TermNode> node(nodes.top()); nodes.pop();
+				for (std::shared_ptr<TermNode>& child : node->children) {
+					nodes.push(child);
+				}
+				node->children.clear();
+			}
 			
 			return std::make_pair(startAddress, allocations);
 		}
 		
-		void Clauses::interpret(Interpreter::Context& context) {
-			initialiseBuiltins(context);
+		bool Clauses::interpret(Interpreter::Context& context) {
+			// The built-in functions are linked along with the first file to be interpreted.
+			if (!context.builtins) {
+				initialiseBuiltins(context);
+				context.builtins = true;
+			}
 			
-			// Interpret each of the clauses in turn
+			// Interpret each of the clauses in turn, stopping at the first query that fails.
 			for (auto& clause : clauses) {
-				clause->interpret(context);
+				if (!clause->interpret(context)) {
+					return false;
+				}
+			}
+			return true;
+		}
+		
+		bool Clauses::isQuery() const {
+			std::size_t count = 0;
+			for (auto& clause : clauses) {
+				if (++ count > 1 || dynamic_cast<const Query*>(clause.get()) == nullptr) {
+					return false;
+				}
 			}
+			return count == 1;
 		}
 		
 		std::pair<Instruction::instructionReference, std::unordered_map<std::string, HeapReference>> generateHeadInstructionsForClause(Interpreter::Context& context, std::pair<std::unordered_set<std::string>, std::unordered_map<std::string, HeapReference>> permanence, std::unordered_set<std::string>& encounters, CompoundTerm* head, bool proceedAtEnd) {
@@ -568,7 +619,375 @@ namespace Epilog {
 			return generateInstructionsForClause(context, true, permanence, encounters, wrapper, unseenArgumentVariable, unseenRegisterVariable, seenArgumentVariable, seenRegisterVariable, compoundTerm, number, conclusion);
 		}
 		
-		std::pair<Instruction::instructionReference, std::unordered_map<std::string, HeapReference>> generateInstructionsForRule(Interpreter::Context& context, CompoundTerm* head, pegmatite::ASTList<EnrichedCompoundTerm>* goals) {
+		std::vector<Cell> argumentKeys(CompoundTerm* head) {
+			std::vector<Cell> keys;
+			for (auto& parameter : head->parameterList->parameters) {
+				if (CompoundTerm* compoundTerm = dynamic_cast<CompoundTerm*>(parameter.get())) {
+					SymbolTable::symbolIndex symbol = SymbolTable::intern(compoundTerm->name, compoundTerm->parameterList->parameters.size());
+					keys.push_back(compoundTerm->parameterList->parameters.empty() ? Cell::constant(symbol) : Cell::functor(symbol));
+				} else if (Number* number = dynamic_cast<Number*>(parameter.get())) {
+					keys.push_back(Cell::integer(number->value));
+				} else {
+					// Variables (and dynamic terms, whose form is not known until they are executed) match any argument.
+					keys.push_back(Cell());
+				}
+			}
+			return keys;
+		}
+		
+		Instruction::instructionReference generateClauseSelection(const Interpreter::FunctorClause& functorClause, const std::vector<std::vector<Cell>::size_type>& candidates, std::map<std::vector<std::vector<Cell>::size_type>, Instruction::instructionReference>& selections) {
+			// Returns the address that selects between the given candidate clauses: the clause itself, if there is only one, or a try/retry/trust block otherwise.
+			if (candidates.empty()) {
+				return Instruction::failLabel;
+			}
+			// Every clause is preceded by its clause-chaining instruction, which is skipped when it is selected by an index.
+			auto clauseAddress = [&functorClause] (std::vector<Cell>::size_type clause) { return functorClause.clauseAddresses[clause]; };
+			if (candidates.size() == 1) {
+				return clauseAddress(candidates.front());
+			}
+			auto selection = selections.find(candidates);
+			if (selection != selections.end()) {
+				return selection->second;
+			}
+			Instruction::instructionReference address = linkInstruction(new TryClauseInstruction(clauseAddress(candidates.front())));
+			for (auto it = candidates.begin() + 1; it != candidates.end() - 1; ++ it) {
+				linkInstruction(new RetryClauseInstruction(clauseAddress(*it)));
+			}
+			linkInstruction(new TrustClauseInstruction(clauseAddress(candidates.back())));
+			selections[candidates] = address;
+			return address;
+		}
+		
+		Instruction::instructionReference generateFirstArgumentIndex(const Interpreter::FunctorClause& functorClause) {
+			// Returns the address of a switch on the first argument, so that calls only try the clauses that could match.
+			// The candidates for each key are the clauses with that key, along with every clause with a variable first argument, in the original order.
+			std::vector<std::vector<Cell>::size_type> variables;
+			std::map<Cell::word, std::vector<std::vector<Cell>::size_type>> constants;
+			std::map<SymbolTable::symbolIndex, std::vector<std::vector<Cell>::size_type>> structures;
+			for (std::vector<Cell>::size_type i = 0; i < functorClause.keys.size(); ++ i) {
+				const Cell& key = functorClause.keys[i].front();
+				if (key.tag() == Cell::Tag::functor) {
+					structures[key.symbol()];
+				} else if (key.tag() != Cell::Tag::empty) {
+					constants[key.value];
+				}
+			}
+			for (std::vector<Cell>::size_type i = 0; i < functorClause.keys.size(); ++ i) {
+				const Cell& key = functorClause.keys[i].front();
+				if (key.tag() == Cell::Tag::empty) {
+					variables.push_back(i);
+					for (auto& constant : constants) {
+						constant.second.push_back(i);
+					}
+					for (auto& structure : structures) {
+						structure.second.push_back(i);
+					}
+				} else if (key.tag() == Cell::Tag::functor) {
+					structures[key.symbol()].push_back(i);
+				} else {
+					constants[key.value].push_back(i);
+				}
+			}
+			std::map<std::vector<std::vector<Cell>::size_type>, Instruction::instructionReference> selections;
+			Instruction::instructionReference otherwise = generateClauseSelection(functorClause, variables, selections);
+			Instruction::instructionReference constantLabel = otherwise;
+			if (!constants.empty()) {
+				std::unordered_map<Cell::word, Instruction::instructionReference> labels;
+				for (auto& constant : constants) {
+					labels[constant.first] = generateClauseSelection(functorClause, constant.second, selections);
+				}
+				constantLabel = linkInstruction(new SwitchOnConstantInstruction(labels, otherwise));
+			}
+			Instruction::instructionReference listLabel = otherwise;
+			Instruction::instructionReference structureLabel = otherwise;
+			auto list = structures.find(SymbolTable::intern(".", 2));
+			if (list != structures.end()) {
+				listLabel = generateClauseSelection(functorClause, list->second, selections);
+				structures.erase(list);
+			}
+			if (!structures.empty()) {
+				std::unordered_map<SymbolTable::symbolIndex, Instruction::instructionReference> labels;
+				for (auto& structure : structures) {
+					labels[structure.first] = generateClauseSelection(functorClause, structure.second, selections);
+				}
+				structureLabel = linkInstruction(new SwitchOnStructureInstruction(labels, otherwise));
+			}
+			return linkInstruction(new SwitchOnTermInstruction(functorClause.startAddresses.front(), constantLabel, listLabel, structureLabel));
+		}
+		
+		void linkFunctorClauses(Interpreter::Context& context) {
+			// Link the clauses of each functor that has changed into the code area, along with their indexes.
+			// The previously linked code for those functors is simply left unused.
+			if (!context.unlinkedFunctors.empty()) {
+				++ Runtime::currentRuntime->code->links;
+			}
+			for (SymbolTable::symbolIndex symbol : context.unlinkedFunctors) {
+				Interpreter::FunctorClause& functorClause = context.functorClauses.find(symbol)->second;
+				auto arity = SymbolTable::get(symbol).parameters;
+				Bytecode& code = *Runtime::currentRuntime->code;
+				auto startAddress = code.size();
+				functorClause.startAddresses.clear();
+				functorClause.clauseAddresses.clear();
+				if (functorClause.clauses.size() == 1) {
+					functorClause.startAddresses.push_back(linkBlock(functorClause.clauses.front()));
+					functorClause.clauseAddresses.push_back(functorClause.startAddresses.back());
+				} else {
+					// Chain the clauses together, so that each is tried in turn.
+					// The label of each chaining instruction is the address of the next, which is filled in once it is known.
+					for (std::vector<Interpreter::CodeBlock>::size_type i = 0; i < functorClause.clauses.size(); ++ i) {
+						if (i > 0) {
+							code.operand(functorClause.startAddresses.back(), 0) = code.size();
+						}
+						if (i == 0) {
+							functorClause.startAddresses.push_back(linkInstruction(new TryInitialClauseInstruction(Instruction::failLabel)));
+						} else if (i < functorClause.clauses.size() - 1) {
+							functorClause.startAddresses.push_back(linkInstruction(new TryIntermediateClauseInstruction(Instruction::failLabel)));
+						} else {
+							functorClause.startAddresses.push_back(linkInstruction(new TryFinalClauseInstruction()));
+						}
+						functorClause.clauseAddresses.push_back(linkBlock(functorClause.clauses[i]));
+					}
+				}
+				functorClause.linked = true;
+				Runtime::currentRuntime->labels[symbol] = functorClause.startAddresses.front();
+				
+				if (functorClause.clauses.size() > 1 && arity > 0) {
+					if (!std::all_of(functorClause.keys.begin(), functorClause.keys.end(), [] (const std::vector<Cell>& keys) { return keys.front().tag() == Cell::Tag::empty; })) {
+						Runtime::currentRuntime->labels[symbol] = generateFirstArgumentIndex(functorClause);
+					}
+					if (arity > 1) {
+						// The indexes on the other arguments are only built once calls have shown that they are worthwhile.
+						std::shared_ptr<ArgumentIndex>& argumentIndex = Runtime::currentRuntime->argumentIndexes[symbol];
+						if (argumentIndex == nullptr) {
+							argumentIndex = std::make_shared<ArgumentIndex>(symbol);
+						}
+						std::vector<Instruction::instructionReference> clauses;
+						std::vector<std::vector<Cell>> keys(arity);
+						for (std::vector<Cell>::size_type i = 0; i < functorClause.clauseAddresses.size(); ++ i) {
+							clauses.push_back(functorClause.clauseAddresses[i]);
+							for (int64_t argument = 0; argument < arity; ++ argument) {
+								keys[argument].push_back(functorClause.keys[i][argument]);
+							}
+						}
+						argumentIndex->update(clauses, keys);
+						Runtime::currentRuntime->labels[symbol] = linkInstruction(new IndexArgumentsInstruction(argumentIndex, Runtime::currentRuntime->labels[symbol]));
+						linkInstruction(new RetryAlternativeInstruction());
+					}
+				}
+				if (context.tabled.find(symbol) != context.tabled.end()) {
+					// Calls to a tabled predicate are made through its table, which only runs the clauses for a call that it has not completed. It is not profiled, as native code would be entered directly.
+					Runtime::currentRuntime->labels[symbol] = linkInstruction(new TableInstruction(symbol, Runtime::currentRuntime->labels[symbol]));
+					linkInstruction(new RetryAnswerInstruction());
+					linkInstruction(new CompleteTableInstruction());
+					linkInstruction(new NewAnswerInstruction());
+				} else if (Runtime::currentRuntime->jit != nullptr) {
+					// Calls are counted, so that the predicate may be compiled to native code once it is called often enough.
+					code.profiles.emplace_back(symbol, startAddress, code.size(), Runtime::currentRuntime->labels[symbol]);
+					Runtime::currentRuntime->labels[symbol] = linkInstruction(new ProfileInstruction(&code.profiles.back()));
+				}
+				
+				if (DEBUG) {
+					std::cerr << "Link " << SymbolTable::get(symbol).toString() << " (entry " << Runtime::currentRuntime->labels[symbol] << "):" << std::endl;
+					for (auto i = startAddress; i < code.size(); i = code.next(i)) {
+						std::cerr << "\t" << i << ": " << code.decode(i)->toString() << std::endl;
+					}
+					std::cerr << std::endl;
+				}
+			}
+			context.unlinkedFunctors.clear();
+		}
+		
+		// Arithmetic goals are compiled into instructions on the integer registers, rather than building the expression on the heap and calling the built-in predicate, when each of their variables is a permanent one that has already been bound.
+		// Returns false if the goal must instead be called as usual.
+		bool generateArithmeticForGoal(Interpreter::Context& context, std::unordered_map<std::string, HeapReference>& permanents, std::unordered_set<std::string>& encounters, EnrichedCompoundTerm* goal) {
+			static const std::unordered_map<std::string, Opcode> comparisons = {
+				{ "<", Opcode::less_than }, { "=<", Opcode::less_or_equal }, { ">", Opcode::greater_than }, { "=>", Opcode::greater_or_equal }
+			};
+			static const std::map<Arithmetic, Opcode> operations = {
+				{ Arithmetic::add, Opcode::add }, { Arithmetic::subtract, Opcode::subtract }, { Arithmetic::multiply, Opcode::multiply }, { Arithmetic::divide, Opcode::divide }, { Arithmetic::modulo, Opcode::modulo }
+			};
+			CompoundTerm* term = goal->compoundTerm.get();
+			pegmatite::ASTList<Term>& parameters = term->parameterList->parameters;
+			auto comparison = comparisons.find(term->name);
+			if (goal->modifier != nullptr || parameters.size() != 2 || (term->name != "is" && comparison == comparisons.end())) {
+				return false;
+			}
+			
+			// Subexpressions of numbers alone are evaluated now, unless they would divide by zero, which is left to fail at runtime.
+			std::function<bool(Term*, int64_t&)> fold = [&fold] (Term* term, int64_t& value) {
+				if (Number* number = dynamic_cast<Number*>(term)) {
+					value = number->value;
+					return true;
+				}
+				CompoundTerm* compoundTerm = dynamic_cast<CompoundTerm*>(term);
+				if (compoundTerm == nullptr) {
+					return false;
+				}
+				std::vector<int64_t> values;
+				for (auto& parameter : compoundTerm->parameterList->parameters) {
+					values.emplace_back();
+					if (!fold(parameter.get(), values.back())) {
+						return false;
+					}
+				}
+				switch (arithmeticOperation(compoundTerm->name, values.size())) {
+					case Arithmetic::add:
+						value = std::accumulate(values.begin(), values.end(), INT64_C(0));
+						return true;
+					case Arithmetic::subtract:
+						value = values[0] - values[1];
+						return true;
+					case Arithmetic::multiply:
+						value = std::accumulate(values.begin(), values.end(), INT64_C(1), std::multiplies<int64_t>());
+						return true;
+					case Arithmetic::divide:
+						value = values[1] != 0 ? values[0] / values[1] : 0;
+						return values[1] != 0;
+					case Arithmetic::modulo:
+						value = values[1] != 0 ? ((values[0] % values[1]) + values[1]) % values[1] : 0;
+						return values[1] != 0;
+					default:
+						return false;
+				}
+			};
+			// Each subexpression is evaluated into the integer register given by its depth, so an expression needs as many registers as it is deep.
+			Interpreter::CodeBlock instructions;
+			std::function<bool(Term*, std::size_t)> generate = [&] (Term* term, std::size_t integer) {
+				int64_t value;
+				if (fold(term, value)) {
+					instructions.push_back(std::make_shared<LoadConstantInstruction>(value, integer));
+					return true;
+				}
+				if (Variable* variable = dynamic_cast<Variable*>(term)) {
+					auto permanent = permanents.find(variable->toString());
+					if (permanent == permanents.end() || encounters.find(variable->toString()) == encounters.end()) {
+						return false;
+					}
+					instructions.push_back(std::make_shared<LoadIntegerInstruction>(permanent->second, integer));
+					return true;
+				}
+				CompoundTerm* compoundTerm = dynamic_cast<CompoundTerm*>(term);
+				if (compoundTerm == nullptr || integer + 1 >= Runtime::integerRegisters) {
+					return false;
+				}
+				pegmatite::ASTList<Term>& parameters = compoundTerm->parameterList->parameters;
+				auto operation = operations.find(arithmeticOperation(compoundTerm->name, parameters.size()));
+				if (operation == operations.end() || !generate(parameters.front().get(), integer)) {
+					return false;
+				}
+				for (auto parameter = std::next(parameters.begin()); parameter != parameters.end(); ++ parameter) {
+					if (!generate(parameter->get(), integer + 1)) {
+						return false;
+					}
+					instructions.push_back(std::make_shared<ArithmeticInstruction>(operation->second, integer, integer, integer + 1));
+				}
+				return true;
+			};
+			
+			if (comparison != comparisons.end()) {
+				if (!generate(parameters.front().get(), 0) || !generate(parameters.back().get(), 1)) {
+					return false;
+				}
+				instructions.push_back(std::make_shared<ComparisonInstruction>(comparison->second, 0, 1));
+			} else {
+				// The result is only compiled into a permanent variable, as any other term would have to be built on the heap anyway.
+				Variable* result = dynamic_cast<Variable*>(parameters.front().get());
+				if (result == nullptr || permanents.find(result->toString()) == permanents.end() || !generate(parameters.back().get(), 0)) {
+					return false;
+				}
+				HeapReference reference = permanents[result->toString()];
+				if (encounters.insert(result->toString()).second) {
+					instructions.push_back(std::make_shared<StoreIntegerInstruction>(0, reference));
+				} else {
+					instructions.push_back(std::make_shared<UnifyIntegerInstruction>(0, reference));
+				}
+			}
+			context.block.insert(context.block.end(), instructions.begin(), instructions.end());
+			return true;
+		}
+		
+		std::pair<Instruction::instructionReference, std::unordered_map<std::string, HeapReference>> generateInstructionsForRule(Interpreter::Context& context, CompoundTerm* head, pegmatite::ASTList<EnrichedCompoundTerm>* goals, bool parallel = true);
+		
+		// Consecutive goals that share no variables, other than those that may already be bound when the first of them is called, are grouped into conjunctions that may be run in parallel.
+		// Whether the terms that those variables are bound to share any unbound variables is only known when the goals are called, so each conjunction is replaced by a goal that calls a hidden predicate running the goals in turn, unless they turn out to be independent.
+		std::unordered_map<EnrichedCompoundTerm*, std::shared_ptr<Conjunction>> generateParallelConjunctions(Interpreter::Context& context, CompoundTerm* head, pegmatite::ASTList<EnrichedCompoundTerm>& goals) {
+			std::unordered_map<EnrichedCompoundTerm*, std::shared_ptr<Conjunction>> conjunctions;
+			std::vector<HeapReference::heapIndex> retained;
+			std::vector<std::unordered_set<std::string>> clauseVariables;
+			findVariablePermanence(head, &goals, false, retained, &clauseVariables);
+			// Built-in predicates are never run as tasks, as they are cheap, and some (such as those that write) must be run in order. Nor are goals with modifiers, which depend on the frames of the goals before them.
+			auto parallelisable = [] (const std::unique_ptr<EnrichedCompoundTerm>& goal) {
+				CompoundTerm* term = goal->compoundTerm.get();
+				return goal->modifier == nullptr && StandardLibrary::functions.find(SymbolTable::intern(term->name, term->parameterList->parameters.size())) == StandardLibrary::functions.end();
+			};
+			auto label = [] (SymbolTable::symbolIndex symbol) {
+				return &Runtime::currentRuntime->labels.emplace(symbol, Instruction::failLabel).first->second;
+			};
+			// The variables that may be bound before each goal: those of the head, and of the goals before it.
+			std::vector<std::unordered_set<std::string>>::size_type clause = 0;
+			std::unordered_set<std::string> bound;
+			if (head != nullptr) {
+				bound = clauseVariables[clause ++];
+			}
+			for (auto start = goals.begin(); start != goals.end(); ) {
+				std::unordered_set<std::string> variables(clauseVariables[clause]);
+				auto end = std::next(start);
+				auto endClause = clause + 1;
+				while (parallelisable(*start) && end != goals.end() && parallelisable(*end) && std::all_of(clauseVariables[endClause].begin(), clauseVariables[endClause].end(), [&] (const std::string& symbol) { return variables.find(symbol) == variables.end() || bound.find(symbol) != bound.end(); })) {
+					variables.insert(clauseVariables[endClause].begin(), clauseVariables[endClause].end());
+					++ end;
+					++ endClause;
+				}
+				if (endClause - clause < 2) {
+					bound.insert(clauseVariables[clause].begin(), clauseVariables[clause].end());
+					++ start;
+					++ clause;
+					continue;
+				}
+				
+				// The conjunction takes the variables that it shares with the rest of the clause. Every variable of a query is taken, so that its bindings may be reported.
+				std::unordered_set<std::string> shared(bound);
+				for (auto later = endClause; later < clauseVariables.size(); ++ later) {
+					shared.insert(clauseVariables[later].begin(), clauseVariables[later].end());
+				}
+				std::vector<std::string> parameters;
+				for (auto& symbol : variables) {
+					if (head == nullptr || shared.find(symbol) != shared.end()) {
+						parameters.push_back(symbol);
+					}
+				}
+				std::sort(parameters.begin(), parameters.end());
+				std::string name = "$conjunction" + std::to_string(++ context.conjunctions);
+				SymbolTable::symbolIndex symbol = SymbolTable::intern(name, parameters.size());
+				std::shared_ptr<Conjunction> conjunction = std::make_shared<Conjunction>(symbol, parameters.size(), label(symbol));
+				pegmatite::ASTList<EnrichedCompoundTerm> body;
+				body.splice(body.end(), goals, start, end);
+				generateInstructionsForRule(context, createTermWithVariables(name, parameters).get(), &body, false);
+				for (; clause < endClause; ++ clause) {
+					pegmatite::ASTList<EnrichedCompoundTerm> goal;
+					goal.splice(goal.end(), body, body.begin());
+					Conjunction::Goal task;
+					SymbolTable::symbolIndex taskSymbol = SymbolTable::intern(name + "$" + std::to_string(conjunction->goals.size() + 1), parameters.size());
+					task.label = label(taskSymbol);
+					for (std::vector<std::string>::size_type i = 0; i < parameters.size(); ++ i) {
+						if (clauseVariables[clause].find(parameters[i]) != clauseVariables[clause].end()) {
+							task.arguments.push_back(i);
+						}
+					}
+					conjunction->goals.push_back(task);
+					generateInstructionsForRule(context, createTermWithVariables(SymbolTable::get(taskSymbol).name, parameters).get(), &goal, false);
+				}
+				std::unique_ptr<EnrichedCompoundTerm> call(new EnrichedCompoundTerm());
+				call->compoundTerm.reset(createTermWithVariables(name, parameters).release());
+				conjunctions.emplace(call.get(), conjunction);
+				goals.insert(end, std::move(call));
+				bound.insert(variables.begin(), variables.end());
+				start = end;
+			}
+			return conjunctions;
+		}
+		
+		std::pair<Instruction::instructionReference, std::unordered_map<std::string, HeapReference>> generateInstructionsForRule(Interpreter::Context& context, CompoundTerm* head, pegmatite::ASTList<EnrichedCompoundTerm>* goals, bool parallel) {
 			// Replace syntactic sugar in each of the clauses with its expanded form.
 			removeSyntacticSugar(head);
 			if (goals != nullptr) {
@@ -577,8 +996,14 @@ namespace Epilog {
 				}
 			}
 			
-			auto permanence = findVariablePermanence(head, goals, head == nullptr);
-			auto startAddress = context.insertionAddress = Runtime::currentRuntime->instructions->size();
+			std::unordered_map<EnrichedCompoundTerm*, std::shared_ptr<Conjunction>> conjunctions;
+			if (parallel && context.parallelConjunctions && goals != nullptr) {
+				conjunctions = generateParallelConjunctions(context, head, *goals);
+			}
+			
+			std::vector<HeapReference::heapIndex> retained;
+			auto permanence = findVariablePermanence(head, goals, head == nullptr, retained);
+			context.block.clear();
 			
 			if (DEBUG) {
 				std::cerr << "Permanent register allocation:" << (permanence.second.size() > 0 ? "" : " (None)") << std::endl;
@@ -590,32 +1015,11 @@ namespace Epilog {
 			}
 			
 			if (head != nullptr) {
-				std::string symbol = head->name + "/" + std::to_string(head->parameterList->parameters.size());
+				SymbolTable::symbolIndex symbol = SymbolTable::intern(head->name, head->parameterList->parameters.size());
 				
 				// Check to see if there is already a function in the standard library with this functor, as this is disallowed.
 				if (StandardLibrary::functions.find(symbol) != StandardLibrary::functions.end()) {
-					throw CompilationException("Tried to redeclare the built-in function " + symbol + ".", __FILENAME__, __func__, __LINE__);
-				}
-				
-				auto previous = context.functorClauses.find(symbol);
-				if (previous == context.functorClauses.end()) {
-					Runtime::currentRuntime->labels[symbol] = context.insertionAddress;
-					context.functorClauses.emplace(symbol, Interpreter::FunctorClause(startAddress, startAddress));
-				} else {
-					auto& functorClause = previous->second;
-					if (functorClause.startAddresses.size() == 1) {
-						// A single clause with this functor has been defined.
-						context.insertionAddress = functorClause.endAddress + 1;
-						Runtime::currentRuntime->instructions->insert(Runtime::currentRuntime->instructions->begin() + functorClause.startAddresses.front(), std::unique_ptr<Instruction>(new TryInitialClauseInstruction(context.insertionAddress)));
-					} else {
-						// Functors with this clause have already been defined.
-						context.insertionAddress = functorClause.endAddress;
-						(*Runtime::currentRuntime->instructions)[functorClause.startAddresses.back()] = std::unique_ptr<Instruction>(new TryIntermediateClauseInstruction(context.insertionAddress));
-					}
-					// Change the insertion position
-					startAddress = context.insertionAddress;
-					functorClause.startAddresses.push_back(startAddress);
-					pushInstruction(context, new TryFinalClauseInstruction());
+					throw CompilationException("Tried to redeclare the built-in function " + SymbolTable::get(symbol).toString() + ".", __FILENAME__, __func__, __LINE__);
 				}
 			}
 			if (goals != nullptr) {
@@ -626,142 +1030,345 @@ namespace Epilog {
 				generateHeadInstructionsForClause(context, permanence, encounters, head, goals == nullptr);
 			}
 			if (goals != nullptr) {
-				for (auto& goal : *goals) {
-					generateBodyInstructionsForClause(context, permanence, encounters, goal.get());
-				}
-				pushInstruction(context, new DeallocateInstruction());
-			}
-			
-			if (head != nullptr) {
-				std::string symbol = head->name + "/" + std::to_string(head->parameterList->parameters.size());
-				context.functorClauses.find(symbol)->second.endAddress = context.insertionAddress;
-				// Offset labels and start addresses of any clauses whose instructions were displaced by inserting this new clause
-				if (context.insertionAddress != Runtime::currentRuntime->instructions->size()) {
-					auto offset = context.insertionAddress - startAddress;
-					for (auto& label : Runtime::currentRuntime->labels) {
-						if (label.second > startAddress) {
-							label.second += offset;
+				HeapReference::heapIndex variables = permanence.second.size();
+				std::vector<HeapReference::heapIndex>::size_type goal = 0;
+				for (auto& body : *goals) {
+					std::shared_ptr<Instruction> call;
+					if (!generateArithmeticForGoal(context, permanence.second, encounters, body.get())) {
+						generateBodyInstructionsForClause(context, permanence, encounters, body.get());
+						call = context.block.back();
+						context.block.pop_back();
+						auto conjunction = conjunctions.find(body.get());
+						if (conjunction != conjunctions.end()) {
+							call = std::make_shared<ParallelCallInstruction>(conjunction->second, false);
 						}
 					}
-					for (auto& functorClause : context.functorClauses) {
-						if (functorClause.first == symbol) {
-							continue;
-						}
-						for (auto& clauseStartAddress : functorClause.second.startAddresses) {
-							if (clauseStartAddress > startAddress) {
-								clauseStartAddress += offset;
-							}
+					++ goal;
+					if (head != nullptr && goal == goals->size()) {
+						// The environment of a rule is discarded before its last goal, which then returns directly to the rule's caller, so that iteration by recursion runs in constant space.
+						pushInstruction(context, new DeallocateInstruction());
+						if (ParallelCallInstruction* parallelCall = dynamic_cast<ParallelCallInstruction*>(call.get())) {
+							pushInstruction(context, new ParallelCallInstruction(parallelCall->conjunction, true));
+						} else {
+							pushInstruction(context, call != nullptr ? static_cast<Instruction*>(new ExecuteInstruction(*static_cast<CallInstruction*>(call.get()))) : new ProceedInstruction());
 						}
+						break;
+					}
+					// Permanent variables that are not used after a goal are trimmed from the environment once its arguments have been built.
+					if (head != nullptr && retained[goal - 1] < variables) {
+						variables = retained[goal - 1];
+						pushInstruction(context, new TrimInstruction(variables));
+					}
+					if (call != nullptr) {
+						context.block.push_back(call);
 					}
 				}
+				if (head == nullptr) {
+					pushInstruction(context, new DeallocateInstruction());
+				}
 			}
 			
 			if (DEBUG) {
-				std::cerr << "Instructions:" << (context.insertionAddress - startAddress > 0 ? "" : " (None)") << std::endl;
-				for (auto i = startAddress; i < context.insertionAddress; ++ i) {
-					std::shared_ptr<Instruction>& instruction = (*Runtime::currentRuntime->instructions)[i]; 
+				std::cerr << "Instructions:" << (context.block.size() > 0 ? "" : " (None)") << std::endl;
+				for (auto& instruction : context.block) {
 					std::cerr << "\t" << instruction->toString() << std::endl;
 				}
 				std::cerr << std::endl;
 			}
 			
+			Instruction::instructionReference startAddress = 0;
+			if (head != nullptr) {
+				// Clauses are only linked once they are needed by a query, as there may be more clauses with the same functor.
+				SymbolTable::symbolIndex symbol = SymbolTable::intern(head->name, head->parameterList->parameters.size());
+				Interpreter::FunctorClause& functorClause = context.functorClauses[symbol];
+				functorClause.clauses.push_back(std::move(context.block));
+				functorClause.keys.push_back(argumentKeys(head));
+				if (functorClause.clauses.size() == 1 || functorClause.linked) {
+					functorClause.linked = false;
+					context.unlinkedFunctors.push_back(symbol);
+				}
+			} else {
+				startAddress = linkBlock(context.block);
+			}
+			context.block.clear();
+			
 			return std::make_pair(startAddress, permanence.second);
 		}
 		
-		bool modifyUnificationCondition(::Epilog::Modifier::Type type) {
-			while (!Runtime::currentRuntime->modifiers.empty()) {
-				auto modifier(Runtime::currentRuntime->modifiers.top());
-				Runtime::currentRuntime->modifiers.pop();
+		bool modifyUnificationCondition(Runtime& runtime, ::Epilog::Modifier::Type type) {
+			while (!runtime.modifiers.empty()) {
+				auto modifier(runtime.modifiers.top());
+				runtime.modifiers.pop();
 				if (modifier.type == type) {
 					while (true) {
-						StateReference::stateIndex topEnvironment = Runtime::currentRuntime->topEnvironment;
-						StateReference::stateIndex topChoicePoint = Runtime::currentRuntime->topChoicePoint;
+						StateReference::stateIndex topEnvironment = runtime.topEnvironment;
+						StateReference::stateIndex topChoicePoint = runtime.topChoicePoint;
 						if (topEnvironment != -1UL && (topChoicePoint == -1UL || topEnvironment > topChoicePoint) && topEnvironment != modifier.topEnvironment) {
-							Runtime::currentRuntime->topEnvironment = modifier.topEnvironment;
+							runtime.topEnvironment = modifier.topEnvironment;
 						} else if (topChoicePoint != -1UL && topChoicePoint != modifier.topChoicePoint) {
-							Runtime::currentRuntime->topChoicePoint = modifier.topChoicePoint;
+							runtime.topChoicePoint = modifier.topChoicePoint;
 						} else {
 							break;
 						}
 					}
-					Runtime::currentRuntime->compressStateStack();
-					Runtime::currentRuntime->nextInstruction = modifier.nextInstruction;
+					runtime.nextInstruction = modifier.nextInstruction;
 					return true;
 				}
 			}
 			return false;
 		}
 		
-		void executeInstructions(Instruction::instructionReference startAddress, Instruction::instructionReference endAddress, std::unordered_map<std::string, HeapReference>* allocations) {
+		bool executeInstructions(Runtime& runtime, Instruction::instructionReference startAddress, Instruction::instructionReference endAddress, std::unordered_map<std::string, HeapReference>* allocations) {
+			// Each query starts with an empty frame stack, so that it never backtracks into the choice points left by an earlier query.
+			runtime.topEnvironment = -1UL;
+			runtime.topChoicePoint = -1UL;
+			runtime.trail.clear();
+			runtime.alternatives.clear();
+			runtime.answers.clear();
+			if (runtime.tables != nullptr) {
+				runtime.tables->reset();
+			}
+			while (!runtime.modifiers.empty()) {
+				runtime.modifiers.pop();
+			}
 			// Execute the instructions
-			Runtime::currentRuntime->nextInstruction = startAddress;
-			Runtime::currentRuntime->nextGoal = Runtime::currentRuntime->instructions->size();
+			runtime.nextInstruction = startAddress;
+			runtime.nextGoal = endAddress;
+			return resumeInstructions(runtime, endAddress, allocations);
+		}
+		
+		std::vector<std::pair<std::string, Cell>> queryBindings(Runtime& runtime, const std::unordered_map<std::string, HeapReference>& variables) {
+			std::vector<std::pair<std::string, HeapReference>> named;
+			for (auto& variable : variables) {
+				if (variable.first[0] != '_') {
+					named.push_back(variable);
+				}
+			}
+			std::sort(named.begin(), named.end(), [] (const std::pair<std::string, HeapReference>& a, const std::pair<std::string, HeapReference>& b) { return a.second.index < b.second.index; });
+			// Each query starts with an empty frame stack, so its environment is the first frame, which is kept (though it has been deallocated) until the query is backtracked out of.
+			std::vector<std::pair<std::string, Cell>> bindings;
+			Environment* environment = reinterpret_cast<Environment*>(&runtime.stateStack[0]);
+			for (auto& variable : named) {
+				bindings.emplace_back(variable.first, variable.second.index < environment->size ? environment->variables()[variable.second.index] : Cell());
+			}
+			return bindings;
+		}
+		
+		bool resumeInstructions(Runtime& runtime, Instruction::instructionReference endAddress, std::unordered_map<std::string, HeapReference>* allocations) {
+			Bytecode& code = *runtime.code;
 			if (DEBUG) {
-				std::cerr << "Execute:" << (Runtime::currentRuntime->nextInstruction < Runtime::currentRuntime->instructions->size() ? "" : " (None)") << std::endl;
+				std::cerr << "Execute:" << (runtime.nextInstruction < code.size() ? "" : " (None)") << std::endl;
 			}
-			while (Runtime::currentRuntime->nextInstruction < Runtime::currentRuntime->instructions->size()) {
-				if (Runtime::currentRuntime->nextInstruction == endAddress) {
+			while (runtime.nextInstruction < code.size()) {
+				if (runtime.nextInstruction == endAddress) {
 					break;
 				}
-				std::shared_ptr<Instruction>& instruction = (*Runtime::currentRuntime->instructions)[Runtime::currentRuntime->nextInstruction];
 				if (DEBUG) {
-					std::cerr << "\t" << instruction->toString() << std::endl;
-					if (allocations != nullptr && Runtime::currentRuntime->nextInstruction == Runtime::currentRuntime->instructions->size() - 1) {
+					std::cerr << "\t" << code.decode(runtime.nextInstruction)->toString() << std::endl;
+					if (allocations != nullptr && runtime.nextInstruction == endAddress - 1) {
 						// The last instruction is always a deallocate.
 						// We want to print the bindings before they are removed from the stack.
 						std::cerr << "Bindings:" << (allocations->size() > 0 ? "" : " (None)") << std::endl;
 						for (auto& allocation : *allocations) {
-							std::cerr << "\t" << allocation.first << " = " << allocation.second.get()->trace() << std::endl;
+							std::cerr << "\t" << allocation.first << " = " << allocation.second.get(runtime).trace(runtime) << std::endl;
 						}
 					}
 				}
+				bool succeeded;
 				try {
-					instruction->execute();
-				} catch (const UnificationError& error) {
+					// Instructions are executed one at a time when debugging, so that each may be traced.
+					succeeded = code.execute(runtime, endAddress, DEBUG);
+				} catch (const RuntimeException& exception) {
+					// The catch modifier causes successful unification if a runtime error is thrown.
+					if (exception.forceful || !modifyUnificationCondition(runtime, ::Epilog::Modifier::Type::intercept)) {
+						throw;
+					}
+					continue;
+				}
+				if (!succeeded) {
+					bool forceful = runtime.forcefulFailure;
+					runtime.forcefulFailure = false;
+					if (runtime.cancellation != nullptr && runtime.cancellation->isCancelled()) {
+						// A goal of a cancelled conjunction is neither backtracked into nor rescued by a modifier.
+						return false;
+					}
 					if (DEBUG) {
-						error.print();
+						std::cerr << "\t" << "fail" << (forceful ? " (forceful)" : "") << std::endl;
 					}
-					if (Runtime::currentRuntime->topChoicePoint != -1UL) {
+					if (runtime.topChoicePoint != -1UL) {
 						// Backtrack to the previous choice point.
-						Runtime::currentRuntime->nextInstruction = Runtime::currentRuntime->currentChoicePoint()->nextClause;
-					} else {
+						runtime.nextInstruction = runtime.currentChoicePoint()->nextClause;
+					} else if (forceful || !modifyUnificationCondition(runtime, ::Epilog::Modifier::Type::negate)) {
 						// Check that there is not a modifier that might alter execution flow: for example, inverting unification (in the case of the \+ operator).
-						if (error.forceful || !modifyUnificationCondition(::Epilog::Modifier::Type::negate)) {
-							throw;
-						}
-					}
-				} catch (const RuntimeException& exception) {
-					// The catch modifier causes successful unification if a runtime error is thrown.
-					if (exception.forceful || !modifyUnificationCondition(::Epilog::Modifier::Type::intercept)) {
-						throw;
+						return false;
 					}
 				}
 			}
+			return true;
 		}
 		
-		void Fact::interpret(Interpreter::Context& context) {
+		// Returns the goals of a body, as a Datalog program takes them.
+		static std::vector<const EnrichedCompoundTerm*> datalogGoals(const Body& body) {
+			std::vector<const EnrichedCompoundTerm*> goals;
+			for (auto& goal : body.goals) {
+				goals.push_back(goal.get());
+			}
+			return goals;
+		}
+		
+		bool Fact::interpret(Interpreter::Context& context) {
 			if (DEBUG) {
 				std::cerr << "Register fact: " << head->toString() << std::endl;
 			}
+			if (context.datalog != nullptr) {
+				context.datalog->addClause(*head, std::vector<const EnrichedCompoundTerm*>());
+				return true;
+			}
 			generateInstructionsForRule(context, head.get(), nullptr);
+			return true;
 		}
 		
-		void Rule::interpret(Interpreter::Context& context) {
+		bool Rule::interpret(Interpreter::Context& context) {
 			if (DEBUG) {
 				std::cerr << "Register rule: " << head->toString() << " :- " << body->toString() << std::endl;
 			}
+			if (context.datalog != nullptr) {
+				context.datalog->addClause(*head, datalogGoals(*body));
+				return true;
+			}
 			generateInstructionsForRule(context, head.get(), &body->goals);
+			return true;
 		}
 		
-		void Query::interpret(Interpreter::Context& context) {
+		bool TableDirective::interpret(Interpreter::Context& context) {
+			for (auto& predicate : predicates) {
+				if (predicate->arity->value < 0) {
+					throw CompilationException("Tried to table a predicate with a negative arity.", __FILENAME__, __func__, __LINE__);
+				}
+				SymbolTable::symbolIndex symbol = SymbolTable::intern(predicate->name, predicate->arity->value);
+				if (DEBUG) {
+					std::cerr << "Table: " << SymbolTable::get(symbol).toString() << std::endl;
+				}
+				if (StandardLibrary::functions.find(symbol) != StandardLibrary::functions.end()) {
+					throw CompilationException("Tried to table the built-in function " + SymbolTable::get(symbol).toString() + ".", __FILENAME__, __func__, __LINE__);
+				}
+				// A predicate that has already been linked is linked again, so that it is called through its table.
+				auto functorClause = context.functorClauses.find(symbol);
+				if (context.tabled.insert(symbol).second && functorClause != context.functorClauses.end() && functorClause->second.linked) {
+					functorClause->second.linked = false;
+					context.unlinkedFunctors.push_back(symbol);
+				}
+			}
+			return true;
+		}
+		
+		bool LoadDirective::interpret(Interpreter::Context& context) {
+			if (predicate->arity->value < 0) {
+				throw CompilationException("Tried to load facts into a predicate with a negative arity.", __FILENAME__, __func__, __LINE__);
+			}
+			SymbolTable::symbolIndex symbol = SymbolTable::intern(predicate->name, predicate->arity->value);
+			if (StandardLibrary::functions.find(symbol) != StandardLibrary::functions.end()) {
+				throw CompilationException("Tried to redeclare the built-in function " + SymbolTable::get(symbol).toString() + ".", __FILENAME__, __func__, __LINE__);
+			}
+			// The path is usually quoted, in which case its quotes (and the escapes within them) are removed.
+			std::string path(file);
+			if (path.length() >= 2 && path[0] == '\'') {
+				path = path.substr(1, path.length() - 2);
+				std::string::size_type position = 0;
+				while ((position = path.find("\\'", position)) != std::string::npos) {
+					path.replace(position, 2, "'");
+					position += 1;
+				}
+			}
+			if (!path.empty() && path[0] != '/') {
+				path = context.directory + path;
+			}
+			DelimitedFile rows(path);
+			if (context.image != nullptr) {
+				// The rows are held in the image, which is only as current as the file.
+				context.image->addFile(path);
+			}
+			std::size_t arity = static_cast<std::size_t>(predicate->arity->value);
+			while (Runtime::currentRuntime->registers.size() < arity) {
+				Runtime::currentRuntime->registers.push_back(Cell());
+			}
+			// Each row is compiled directly into the instructions of a fact, which all end with the same proceed instruction.
+			Interpreter::FunctorClause* functorClause = context.datalog == nullptr ? &context.functorClauses[symbol] : nullptr;
+			std::size_t previous = functorClause != nullptr ? functorClause->clauses.size() : 0;
+			std::shared_ptr<Instruction> proceed = std::make_shared<ProceedInstruction>();
+			std::vector<Cell> fields;
+			std::vector<Cell::word> tuple;
+			std::size_t count = 0;
+			for (; rows.next(fields); ++ count) {
+				if (fields.size() != arity) {
+					throw CompilationException("Line " + std::to_string(rows.line()) + " of " + path + " has " + std::to_string(fields.size()) + " fields, but " + SymbolTable::get(symbol).toString() + " has " + std::to_string(arity) + " arguments.", __FILENAME__, __func__, __LINE__);
+				}
+				if (functorClause == nullptr) {
+					tuple.clear();
+					for (const Cell& field : fields) {
+						tuple.push_back(field.value);
+					}
+					context.datalog->addFact(symbol, tuple);
+					continue;
+				}
+				Interpreter::CodeBlock block;
+				block.reserve(arity + 1);
+				for (std::size_t argument = 0; argument < arity; ++ argument) {
+					HeapReference reference(StorageArea::reg, static_cast<HeapReference::heapIndex>(argument));
+					if (fields[argument].tag() == Cell::Tag::integer) {
+						block.push_back(std::make_shared<UnifyNumberInstruction>(HeapNumber(fields[argument].integer()), reference));
+					} else {
+						block.push_back(std::make_shared<UnifyCompoundTermInstruction>(fields[argument].symbol(), reference));
+					}
+				}
+				block.push_back(proceed);
+				functorClause->clauses.push_back(std::move(block));
+				functorClause->keys.push_back(fields);
+			}
+			if (DEBUG) {
+				std::cerr << "Load " << count << " facts of " << SymbolTable::get(symbol).toString() << " from " << path << std::endl;
+			}
+			if (functorClause != nullptr && functorClause->clauses.size() > previous && (previous == 0 || functorClause->linked)) {
+				functorClause->linked = false;
+				context.unlinkedFunctors.push_back(symbol);
+			}
+			return true;
+		}
+		
+		bool Query::interpret(Interpreter::Context& context) {
 			if (DEBUG) {
 				std::cerr << "Register query: " << body->toString() << std::endl;
 			}
+			if (context.datalog != nullptr) {
+				return context.datalog->query(datalogGoals(*body));
+			}
+			linkFunctorClauses(context);
 			auto pair = generateInstructionsForRule(context, nullptr, &body->goals);
 			auto startAddress = pair.first;
 			auto allocations = pair.second;
-			// When queries are executed, they're always the last set of instructions on the stack, so the endAddress is equal to the last instruction.
-			executeInstructions(startAddress, Runtime::currentRuntime->instructions->size(), &allocations);
+			// The query returns to the instruction following it, which is never executed, but reserves its address, so that code linked while the query is executed (such as native code) is not mistaken for its end.
+			auto endAddress = linkInstruction(new ProceedInstruction());
+			// The hidden predicates of any conjunctions of the query that may be run in parallel are linked after it.
+			linkFunctorClauses(context);
+			if (context.image != nullptr) {
+				context.image->addQuery(startAddress, endAddress);
+				return true;
+			}
+			if (context.batch != nullptr) {
+				context.batch->addQuery(startAddress, endAddress);
+				return true;
+			}
+			if (context.parallelConjunctions) {
+				Runtime::currentRuntime->code->shareIndexes();
+			}
+			if (context.server != nullptr) {
+				context.server->answer(startAddress, endAddress, allocations);
+				return true;
+			}
+			if (context.search != nullptr) {
+				return context.search->execute(*Runtime::currentRuntime, startAddress, endAddress, allocations);
+			}
+			return executeInstructions(*Runtime::currentRuntime, startAddress, endAddress, &allocations);
 		}
 	}
 }
@@ -1,27 +1,70 @@
+#include <unordered_set>
+#include "batch.hh"
+#include "datalog.hh"
+#include "image.hh"
 #include "runtime.hh"
+#include "search.hh"
+#include "server.hh"
 
 namespace Epilog {
 	namespace Interpreter {
+		// A block of instructions that does not refer to any absolute address, so that it may be linked anywhere in the code area.
+		typedef std::vector<std::shared_ptr<Instruction>> CodeBlock;
+		
 		struct FunctorClause {
-			// A structure entailing a block of instructions containing the definition for each clause with a certain functor.
+			// The compiled code for each clause with a certain functor, which is linked into the code area before a query is executed.
+			std::vector<CodeBlock> clauses;
+			// The principal functor of each argument of each clause (as a constant, integer or functor cell), or an empty cell if it is a variable.
+			std::vector<std::vector<Cell>> keys;
+			// The address of each clause in the code area (of its clause-chaining instruction, if there is more than one clause), as of the last time the clauses were linked.
 			std::vector<Instruction::instructionReference> startAddresses;
-			Instruction::instructionReference endAddress;
-			
-			FunctorClause(Instruction::instructionReference startAddress, Instruction::instructionReference endAddress) : endAddress(endAddress) {
-				startAddresses.push_back(startAddress);
-			}
+			// The address of the code of each clause (after its clause-chaining instruction), to which indexes jump directly.
+			std::vector<Instruction::instructionReference> clauseAddresses;
+			bool linked = false;
 		};
 		
 		class Context {
 			public:
-			std::unordered_map<std::string, FunctorClause> functorClauses;
-			Instruction::instructionReference insertionAddress = 0;
+			std::unordered_map<SymbolTable::symbolIndex, FunctorClause> functorClauses;
+			// The block to which instructions are currently being generated
+			CodeBlock block;
+			// Functors that have had clauses added since they were last linked, in the order they were first added.
+			std::vector<SymbolTable::symbolIndex> unlinkedFunctors;
+			// Whether the built-in functions have been linked.
+			bool builtins = false;
+			// When compiling a program ahead of time, queries are recorded in an image, rather than being executed.
+			Image* image = nullptr;
+			// When running a batch of queries, they are likewise recorded, to be executed once every query has been compiled.
+			Batch* batch = nullptr;
+			// When searching in parallel, each query is searched for all of its solutions across several threads.
+			ParallelSearch* search = nullptr;
+			// When evaluating bottom-up, clauses are added to a Datalog program instead, which answers queries from the relations it derives.
+			Datalog* datalog = nullptr;
+			// When serving queries over a socket, each query received is answered by the server, which discards its code afterwards.
+			Server* server = nullptr;
+			// When the goals of conjunctions may be run in parallel, rules are compiled so that independent goals may be run as parallel tasks.
+			bool parallelConjunctions = false;
+			// The number of conjunctions compiled to be run in parallel, by which their hidden predicates are named.
+			uint64_t conjunctions = 0;
+			// The predicates declared by table directives, whose calls are made through their tables.
+			std::unordered_set<SymbolTable::symbolIndex> tabled;
+			// The directory of the program being consulted (ending with a slash), against which the relative paths of files it loads are resolved, or empty for the working directory.
+			std::string directory;
 		};
 	}
 	
 	// These functions are made visible to external classes so that dynamic instruction generation is possible.
 	namespace AST {
-		void executeInstructions(Instruction::instructionReference startAddress, Instruction::instructionReference endAddress, std::unordered_map<std::string, HeapReference>* allocations);
+		bool executeInstructions(Runtime& runtime, Instruction::instructionReference startAddress, Instruction::instructionReference endAddress, std::unordered_map<std::string, HeapReference>* allocations);
+		
+		// Executes from the runtime's next instruction, with the frames it already has, backtracking until the end address is reached, or execution fails.
+		bool resumeInstructions(Runtime& runtime, Instruction::instructionReference endAddress, std::unordered_map<std::string, HeapReference>* allocations);
+		
+		// The bindings of the named variables (those not beginning with an underscore) of a query that has succeeded, in the order in which they appear in it. Each is empty if the variable was never bound.
+		std::vector<std::pair<std::string, Cell>> queryBindings(Runtime& runtime, const std::unordered_map<std::string, HeapReference>& variables);
+		
+		// Restores the frames of the innermost modifier of the given type, returning false if there is none.
+		bool modifyUnificationCondition(Runtime& runtime, ::Epilog::Modifier::Type type);
 	}
 	
 	Instruction::instructionReference pushInstruction(Interpreter::Context& context, Instruction* instruction);
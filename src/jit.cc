@@ -0,0 +1,360 @@
+#include <iostream>
+#include <map>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+#include "jit.hh"
+
+#ifndef DEBUG
+	#define DEBUG false
+#endif
+
+namespace Epilog {
+	typedef Bytecode::word word;
+	
+	// Native code performs each instruction by calling the operation for its opcode, passing the runtime it was entered with and the operands, followed by the address of the next instruction for those that refer to it.
+	typedef bool (*Operation)(Runtime&, word, word, word, word, word);
+	
+	static const Operation operations[] = {
+		// put_structure
+		[] (Runtime& runtime, word functor, word parameters, word registerReference, word, word) { return pushCompoundTerm(runtime, functor, static_cast<int64_t>(parameters), Bytecode::decodeReference(registerReference)); },
+		// set_variable
+		[] (Runtime& runtime, word registerReference, word, word, word, word) { return pushVariable(runtime, Bytecode::decodeReference(registerReference)); },
+		// set_value
+		[] (Runtime& runtime, word registerReference, word, word, word, word) { return pushValue(runtime, Bytecode::decodeReference(registerReference)); },
+		// put_integer
+		[] (Runtime& runtime, word number, word registerReference, word, word, word) { return pushNumber(runtime, HeapNumber(static_cast<int64_t>(number)), Bytecode::decodeReference(registerReference)); },
+		// get_structure
+		[] (Runtime& runtime, word functor, word parameters, word registerReference, word, word) { return unifyCompoundTerm(runtime, functor, static_cast<int64_t>(parameters), Bytecode::decodeReference(registerReference)); },
+		// unify_variable
+		[] (Runtime& runtime, word registerReference, word, word, word, word) { return unifyVariable(runtime, Bytecode::decodeReference(registerReference)); },
+		// unify_value
+		[] (Runtime& runtime, word registerReference, word, word, word, word) { return unifyValue(runtime, Bytecode::decodeReference(registerReference)); },
+		// get_integer
+		[] (Runtime& runtime, word number, word registerReference, word, word, word) { return unifyNumber(runtime, HeapNumber(static_cast<int64_t>(number)), Bytecode::decodeReference(registerReference)); },
+		// put_variable
+		[] (Runtime& runtime, word registerReference, word argumentReference, word, word, word) { return pushVariableToAll(runtime, Bytecode::decodeReference(registerReference), Bytecode::decodeReference(argumentReference)); },
+		// put_value
+		[] (Runtime& runtime, word registerReference, word argumentReference, word, word, word) { return copyRegisterToArgument(runtime, Bytecode::decodeReference(registerReference), Bytecode::decodeReference(argumentReference)); },
+		// get_variable
+		[] (Runtime& runtime, word registerReference, word argumentReference, word, word, word) { return copyArgumentToRegister(runtime, Bytecode::decodeReference(registerReference), Bytecode::decodeReference(argumentReference)); },
+		// get_value
+		[] (Runtime& runtime, word registerReference, word argumentReference, word, word, word) { return unifyRegisterAndArgument(runtime, Bytecode::decodeReference(registerReference), Bytecode::decodeReference(argumentReference)); },
+		// call
+		[] (Runtime& runtime, word functor, word parameters, word modifier, word label, word continuation) -> bool {
+			const Instruction::instructionReference* target = reinterpret_cast<const Instruction::instructionReference*>(label);
+			return call(runtime, functor, static_cast<int64_t>(parameters), static_cast<Modifier::Type>(modifier), target, continuation);
+		},
+		// execute
+		[] (Runtime& runtime, word functor, word parameters, word modifier, word label, word) -> bool {
+			const Instruction::instructionReference* target = reinterpret_cast<const Instruction::instructionReference*>(label);
+			return call(runtime, functor, static_cast<int64_t>(parameters), static_cast<Modifier::Type>(modifier), target, runtime.nextGoal);
+		},
+		// proceed
+		[] (Runtime& runtime, word, word, word, word, word) { return proceed(runtime); },
+		// allocate
+		[] (Runtime& runtime, word variables, word, word, word, word) { return allocate(runtime, static_cast<int64_t>(variables)); },
+		// deallocate
+		[] (Runtime& runtime, word, word, word, word, word) { return deallocate(runtime); },
+		// trim
+		[] (Runtime& runtime, word variables, word, word, word, word) { return trim(runtime, variables); },
+		// try_me_else
+		[] (Runtime& runtime, word label, word, word, word, word) { return tryInitialClause(runtime, label); },
+		// retry_me_else
+		[] (Runtime& runtime, word label, word, word, word, word) { return tryIntermediateClause(runtime, label); },
+		// trust_me
+		[] (Runtime& runtime, word, word, word, word, word) { return tryFinalClause(runtime); },
+		// try
+		[] (Runtime& runtime, word label, word continuation, word, word, word) { return tryClause(runtime, label, continuation); },
+		// retry
+		[] (Runtime& runtime, word label, word continuation, word, word, word) { return retryClause(runtime, label, continuation); },
+		// trust
+		[] (Runtime& runtime, word label, word, word, word, word) { return trustClause(runtime, label); },
+		// switch_on_term
+		[] (Runtime& runtime, word variableLabel, word constantLabel, word listLabel, word structureLabel, word) { return switchOnTerm(runtime, variableLabel, constantLabel, listLabel, structureLabel); },
+		// switch_on_constant
+		[] (Runtime& runtime, word labels, word defaultLabel, word, word, word) { return switchOnConstant(runtime, *reinterpret_cast<const std::unordered_map<word, Instruction::instructionReference>*>(labels), defaultLabel); },
+		// switch_on_structure
+		[] (Runtime& runtime, word labels, word defaultLabel, word, word, word) { return switchOnStructure(runtime, *reinterpret_cast<const std::unordered_map<word, Instruction::instructionReference>*>(labels), defaultLabel); },
+		// index_arguments
+		[] (Runtime& runtime, word index, word fallbackLabel, word continuation, word, word) { return indexArguments(runtime, reinterpret_cast<ArgumentIndex*>(index), fallbackLabel, continuation); },
+		// retry_alternative
+		[] (Runtime& runtime, word, word, word, word, word) { return retryAlternative(runtime); },
+		// load_integer
+		[] (Runtime& runtime, word registerReference, word integer, word, word, word) { return loadInteger(runtime, Bytecode::decodeReference(registerReference), integer); },
+		// load_constant
+		[] (Runtime& runtime, word value, word integer, word, word, word) { return loadConstant(runtime, static_cast<int64_t>(value), integer); },
+		// add
+		[] (Runtime& runtime, word destination, word left, word right, word, word) { return addIntegers(runtime, destination, left, right); },
+		// subtract
+		[] (Runtime& runtime, word destination, word left, word right, word, word) { return subtractIntegers(runtime, destination, left, right); },
+		// multiply
+		[] (Runtime& runtime, word destination, word left, word right, word, word) { return multiplyIntegers(runtime, destination, left, right); },
+		// divide
+		[] (Runtime& runtime, word destination, word left, word right, word, word) { return divideIntegers(runtime, destination, left, right); },
+		// modulo
+		[] (Runtime& runtime, word destination, word left, word right, word, word) { return moduloIntegers(runtime, destination, left, right); },
+		// less_than
+		[] (Runtime& runtime, word left, word right, word, word, word) { return lessThan(runtime, left, right); },
+		// less_or_equal
+		[] (Runtime& runtime, word left, word right, word, word, word) { return lessOrEqual(runtime, left, right); },
+		// greater_than
+		[] (Runtime& runtime, word left, word right, word, word, word) { return greaterThan(runtime, left, right); },
+		// greater_or_equal
+		[] (Runtime& runtime, word left, word right, word, word, word) { return greaterOrEqual(runtime, left, right); },
+		// store_integer
+		[] (Runtime& runtime, word integer, word registerReference, word, word, word) { return storeInteger(runtime, integer, Bytecode::decodeReference(registerReference)); },
+		// unify_integer
+		[] (Runtime& runtime, word integer, word registerReference, word, word, word) { return unifyInteger(runtime, integer, Bytecode::decodeReference(registerReference)); },
+		// Tables, parallel conjunctions, commands, and the instructions of the JIT itself, are left to the interpreter.
+		nullptr, nullptr, nullptr, nullptr,
+		nullptr, nullptr, nullptr, nullptr
+	};
+	
+	static bool interpret(Runtime& runtime, word address, word, word, word, word) {
+		runtime.nextInstruction = address;
+		return true;
+	}
+	
+	static bool transfersControl(Opcode opcode) {
+		switch (opcode) {
+			case Opcode::call:
+			case Opcode::execute:
+			case Opcode::proceed:
+			case Opcode::try_clause:
+			case Opcode::retry_clause:
+			case Opcode::trust_clause:
+			case Opcode::switch_on_term:
+			case Opcode::switch_on_constant:
+			case Opcode::switch_on_structure:
+			case Opcode::index_arguments:
+			case Opcode::retry_alternative:
+				return true;
+			default:
+				return false;
+		}
+	}
+	
+	static bool referencesContinuation(Opcode opcode) {
+		return opcode == Opcode::call || opcode == Opcode::try_clause || opcode == Opcode::retry_clause || opcode == Opcode::index_arguments;
+	}
+	
+	struct JIT::Engine {
+		std::unique_ptr<llvm::orc::LLJIT> jit;
+	};
+	
+	JIT::JIT(std::unique_ptr<Engine> engine, uint64_t threshold) : threshold(threshold), engine(std::move(engine)) { }
+	
+	JIT::~JIT() = default;
+	
+	std::shared_ptr<JIT> JIT::create(uint64_t threshold) {
+		static bool initialised = !llvm::InitializeNativeTarget() && !llvm::InitializeNativeTargetAsmPrinter();
+		if (!initialised) {
+			return nullptr;
+		}
+		auto jit = llvm::orc::LLJITBuilder().create();
+		if (!jit) {
+			llvm::consumeError(jit.takeError());
+			return nullptr;
+		}
+		std::unique_ptr<Engine> engine(new Engine());
+		engine->jit = std::move(*jit);
+		return std::shared_ptr<JIT>(new JIT(std::move(engine), threshold));
+	}
+	
+	bool JIT::compile(Runtime& runtime, const PredicateProfile& profile) {
+		Bytecode& code = *runtime.code;
+		std::unique_ptr<llvm::LLVMContext> context(new llvm::LLVMContext());
+		std::unique_ptr<llvm::Module> module(new llvm::Module(SymbolTable::get(profile.functor).toString(), *context));
+		module->setDataLayout(engine->jit->getDataLayout());
+		module->setTargetTriple(engine->jit->getTargetTriple().str());
+		llvm::IRBuilder<> builder(*context);
+		llvm::Type* wordType = builder.getInt64Ty();
+		llvm::Type* runtimeType = llvm::PointerType::getUnqual(builder.getInt8Ty());
+		llvm::FunctionType* operationType = llvm::FunctionType::get(builder.getInt8Ty(), { runtimeType, wordType, wordType, wordType, wordType, wordType }, false);
+		llvm::FunctionType* nativeType = llvm::FunctionType::get(builder.getInt8Ty(), { runtimeType }, false);
+		
+		// Every address within the predicate to which control may be transferred is given a native instruction, through which the native code compiled from that address is entered.
+		// Their code is filled in once it has been compiled, at which point the bytecode itself is only used when native code hands back to the interpreter.
+		std::map<Instruction::instructionReference, Instruction::instructionReference> entries;
+		// Everything added to the code is discarded if the predicate cannot be compiled, and its indexes are only replaced by those of the native code once it has been.
+		Instruction::instructionReference linked = code.size();
+		std::size_t tables = code.tables.size();
+		std::size_t argumentIndexes = code.argumentIndexes.size();
+		std::vector<std::pair<ArgumentIndex*, std::shared_ptr<ArgumentIndex>>> nativeIndexes;
+		auto discard = [&] {
+			code.truncate(linked);
+			code.tables.resize(tables);
+			code.argumentIndexes.resize(argumentIndexes);
+			return false;
+		};
+		std::vector<Instruction::instructionReference> uncompiled;
+		auto enter = [&] (Instruction::instructionReference address) {
+			if (address < profile.start || address >= profile.end) {
+				return address;
+			}
+			auto entry = entries.find(address);
+			if (entry != entries.end()) {
+				return entry->second;
+			}
+			Instruction::instructionReference native = code.append(NativeInstruction(nullptr, address));
+			entries.emplace(address, native);
+			uncompiled.push_back(address);
+			return native;
+		};
+		// The runtime that entered the native function being compiled, which is passed on to each operation.
+		llvm::Value* runtimeArgument = nullptr;
+		auto perform = [&] (Operation operation, std::vector<word> operands) -> llvm::Value* {
+			std::vector<llvm::Value*> arguments { runtimeArgument };
+			for (word operand : operands) {
+				arguments.push_back(builder.getInt64(operand));
+			}
+			arguments.resize(operationType->getNumParams(), builder.getInt64(0));
+			llvm::Value* callee = builder.CreateIntToPtr(builder.getInt64(reinterpret_cast<word>(operation)), operationType->getPointerTo());
+			return builder.CreateCall(operationType, callee, arguments);
+		};
+		
+		Instruction::instructionReference entry = enter(profile.entry);
+		while (!uncompiled.empty()) {
+			Instruction::instructionReference address = uncompiled.back();
+			uncompiled.pop_back();
+			llvm::Function* function = llvm::Function::Create(nativeType, llvm::Function::ExternalLinkage, "native" + std::to_string(address), module.get());
+			// Runtime exceptions thrown by an operation are propagated through the native code.
+			function->setHasUWTable();
+			runtimeArgument = &*function->arg_begin();
+			builder.SetInsertPoint(llvm::BasicBlock::Create(*context, "", function));
+			llvm::BasicBlock* failure = llvm::BasicBlock::Create(*context, "fail", function);
+			
+			// Each sequence of instructions is compiled up to the first that transfers control, or that must be interpreted.
+			for (Instruction::instructionReference instruction = address; ; instruction = code.next(instruction)) {
+				if (instruction >= profile.end) {
+					builder.CreateRet(perform(interpret, { instruction }));
+					break;
+				}
+				Opcode opcode = code.opcode(instruction);
+				Operation operation = operations[static_cast<word>(opcode)];
+				if (operation == nullptr) {
+					builder.CreateRet(perform(interpret, { instruction }));
+					break;
+				}
+				std::vector<word> operands;
+				for (word i = 0; i < Bytecode::operands[static_cast<word>(opcode)]; ++ i) {
+					operands.push_back(code.operand(instruction, i));
+				}
+				// Any labels within the predicate are replaced by their native entries.
+				switch (opcode) {
+					case Opcode::try_me_else:
+					case Opcode::retry_me_else:
+					case Opcode::try_clause:
+					case Opcode::retry_clause:
+					case Opcode::trust_clause:
+						operands[0] = enter(operands[0]);
+						break;
+					case Opcode::switch_on_term:
+						for (word& label : operands) {
+							label = enter(label);
+						}
+						break;
+					case Opcode::switch_on_constant:
+					case Opcode::switch_on_structure: {
+						const std::unordered_map<word, Instruction::instructionReference>& labels = *reinterpret_cast<const std::unordered_map<word, Instruction::instructionReference>*>(operands[0]);
+						std::unordered_map<word, Instruction::instructionReference> nativeLabels;
+						for (auto& label : labels) {
+							nativeLabels.emplace(label.first, enter(label.second));
+						}
+						code.tables.push_back(nativeLabels);
+						operands[0] = reinterpret_cast<word>(&code.tables.back());
+						operands[1] = enter(operands[1]);
+						break;
+					}
+					case Opcode::index_arguments: {
+						// The native code selects between the native entries of the clauses, using its own copy of the index, which takes over its statistics.
+						ArgumentIndex* index = reinterpret_cast<ArgumentIndex*>(operands[0]);
+						std::shared_ptr<ArgumentIndex> nativeIndex = std::make_shared<ArgumentIndex>(index->functor);
+						std::vector<Instruction::instructionReference> clauses;
+						for (Instruction::instructionReference clause : index->clauses) {
+							clauses.push_back(enter(clause));
+						}
+						nativeIndex->update(clauses, index->keys);
+						nativeIndex->boundCalls = index->boundCalls;
+						nativeIndex->calls = index->calls;
+						nativeIndex->indexedCalls = index->indexedCalls;
+						code.argumentIndexes.push_back(nativeIndex);
+						nativeIndexes.emplace_back(index, nativeIndex);
+						operands[0] = reinterpret_cast<word>(nativeIndex.get());
+						operands[1] = enter(operands[1]);
+						break;
+					}
+					default:
+						break;
+				}
+				if (referencesContinuation(opcode)) {
+					operands.push_back(enter(code.next(instruction)));
+				}
+				llvm::Value* succeeded = perform(operation, operands);
+				if (transfersControl(opcode)) {
+					builder.CreateRet(succeeded);
+					break;
+				}
+				llvm::BasicBlock* next = llvm::BasicBlock::Create(*context, "", function);
+				builder.CreateCondBr(builder.CreateICmpNE(succeeded, builder.getInt8(0)), next, failure);
+				builder.SetInsertPoint(next);
+			}
+			builder.SetInsertPoint(failure);
+			builder.CreateRet(builder.getInt8(0));
+		}
+		
+		// Each operation is an opaque call, but the native code may still be simplified.
+		llvm::LoopAnalysisManager loopAnalyses;
+		llvm::FunctionAnalysisManager functionAnalyses;
+		llvm::CGSCCAnalysisManager cgsccAnalyses;
+		llvm::ModuleAnalysisManager moduleAnalyses;
+		llvm::PassBuilder passBuilder;
+		passBuilder.registerModuleAnalyses(moduleAnalyses);
+		passBuilder.registerCGSCCAnalyses(cgsccAnalyses);
+		passBuilder.registerFunctionAnalyses(functionAnalyses);
+		passBuilder.registerLoopAnalyses(loopAnalyses);
+		passBuilder.crossRegisterProxies(loopAnalyses, functionAnalyses, cgsccAnalyses, moduleAnalyses);
+		#if LLVM_MAJOR >= 14
+			llvm::ModulePassManager passes = passBuilder.buildPerModuleDefaultPipeline(llvm::OptimizationLevel::O2);
+		#else
+			llvm::ModulePassManager passes = passBuilder.buildPerModuleDefaultPipeline(llvm::PassBuilder::OptimizationLevel::O2);
+		#endif
+		passes.run(*module, moduleAnalyses);
+		if (DEBUG) {
+			std::cerr << "Compile " << SymbolTable::get(profile.functor).toString() << " (entry " << entry << "):" << std::endl;
+			module->print(llvm::errs(), nullptr);
+		}
+		
+		if (llvm::Error error = engine->jit->addIRModule(llvm::orc::ThreadSafeModule(std::move(module), std::move(context)))) {
+			llvm::consumeError(std::move(error));
+			return discard();
+		}
+		std::vector<word> addresses;
+		for (auto& native : entries) {
+			auto symbol = engine->jit->lookup("native" + std::to_string(native.first));
+			if (!symbol) {
+				llvm::consumeError(symbol.takeError());
+				return discard();
+			}
+			addresses.push_back(symbol->getAddress());
+		}
+		auto address = addresses.begin();
+		for (auto& native : entries) {
+			code.operand(native.second, 0) = *address;
+			++ address;
+		}
+		for (auto& nativeIndex : nativeIndexes) {
+			std::shared_ptr<ArgumentIndex>& currentIndex = runtime.argumentIndexes[nativeIndex.first->functor];
+			if (currentIndex.get() == nativeIndex.first) {
+				currentIndex = nativeIndex.second;
+			}
+		}
+		runtime.labels[profile.functor] = entry;
+		return true;
+	}
+}
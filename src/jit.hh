@@ -0,0 +1,32 @@
+#pragma once
+
+#include <memory>
+#include "runtime.hh"
+
+namespace Epilog {
+	// Compiles the linked code of frequently called predicates to native code, using LLVM.
+	// Calls to a compiled predicate (and any jumps into it) enter the native code, but its bytecode is kept, so that the interpreter may take over at any instruction that is not compiled.
+	// The native code is only call-threaded: each instruction is a call to the interpreter's operation for it, which the optimiser cannot see into, so it runs no faster than the interpreter.
+	// It is therefore only scaffolding for lowering instructions to IR, and is not enabled unless asked for (by --jit).
+	class JIT {
+		public:
+		// The number of calls to a predicate after which it is compiled.
+		const uint64_t threshold;
+		
+		// Returns nullptr if native code may not be generated for this machine, in which case every predicate is interpreted.
+		static std::shared_ptr<JIT> create(uint64_t threshold);
+		
+		~JIT();
+		
+		// Compiles a predicate of the given runtime, and redirects its calls to the native code.
+		// Returns false if it could not be compiled, in which case it continues to be interpreted.
+		bool compile(Runtime& runtime, const PredicateProfile& profile);
+		
+		private:
+		struct Engine;
+		
+		std::unique_ptr<Engine> engine;
+		
+		JIT(std::unique_ptr<Engine> engine, uint64_t threshold);
+	};
+}
@@ -1,42 +1,216 @@
 #include <fcntl.h>
+#include <sys/stat.h>
 #include <iostream>
 #include <stdexcept>
+#include <string>
+#include <thread>
 #include <unistd.h>
+#include "batch.hh"
+#include "compiler.hh"
+#include "conjunction.hh"
+#include "consult.hh"
+#include "datalog.hh"
+#include "image.hh"
+#include "jit.hh"
 #include "parser.hh"
 #include "runtime.hh"
+#include "search.hh"
+#include "server.hh"
 
 using namespace Epilog;
 
 void usage(const char command[]) {
-	std::cerr << "usage: " << command << " <file>" << std::endl;
+	std::cerr << "usage: " << command << " [--gc-threshold <cells>] [--gc-growth <factor>] [--or-parallel <threads>] [--and-parallel <threads>] [--jit <calls>] [--cache <image>] [--parser pegmatite] <file>" << std::endl;
+	std::cerr << "       " << command << " --compile <file> -o <output>" << std::endl;
+	std::cerr << "       " << command << " [--gc-threshold <cells>] [--gc-growth <factor>] --batch <file> <queries> [-j <threads>]" << std::endl;
+	std::cerr << "       " << command << " --datalog <file>" << std::endl;
+	std::cerr << "       " << command << " [--gc-threshold <cells>] [--gc-growth <factor>] --serve <file> --socket <path>" << std::endl;
+}
+
+// Opens a program to be consulted, which is read from the standard input if its path is -.
+int openProgram(const char path[]) {
+	int file = std::string(path) == "-" ? STDIN_FILENO : open(path, O_RDONLY);
+	if (file == -1) {
+		std::cerr << "Could not open " << path << "." << std::endl;
+	}
+	return file;
+}
+
+// Returns whether a file was modified after another, and so was derived from it since it last changed.
+bool newer(const char path[], const char than[]) {
+	struct stat file, other;
+	return stat(path, &file) == 0 && stat(than, &other) == 0 && file.st_mtime > other.st_mtime;
 }
 
 int main(int argc, char* argv[]) {
-	if (argc < 2) {
+	// The garbage collector may be tuned before the program is given: the heap size (in cells) below which it is never collected (0 to disable collection), and how far it may grow past the cells that survive a collection.
+	GarbageCollector collector;
+	// Each query may instead be searched for all of its solutions, with its alternatives explored across the given number of threads.
+	unsigned searchThreads = 0;
+	// The independent goals of each conjunction may also be run in parallel, across the given number of threads.
+	unsigned conjunctionThreads = 0;
+	// Predicates may be compiled to native code once they have been called the given number of times. This is off by default, as the native code is only call-threaded, so it is no faster than the interpreter.
+	uint64_t jitThreshold = 0;
+	// The compiled program may be cached in an image, which is loaded in place of the program while it is newer than it.
+	std::string cache;
+	// Programs are read by the hand-written reader, unless the Pegmatite parser, from which it was derived, is chosen as a reference.
+	bool reference = false;
+	int first = 1;
+	try {
+		for (; first + 1 < argc; first += 2) {
+			std::string option(argv[first]);
+			if (option == "--gc-threshold") {
+				collector.threshold = std::stoull(argv[first + 1]);
+			} else if (option == "--gc-growth") {
+				collector.growth = std::stod(argv[first + 1]);
+			} else if (option == "--or-parallel") {
+				searchThreads = std::stoul(argv[first + 1]);
+				if (searchThreads == 0) {
+					throw std::invalid_argument(option);
+				}
+			} else if (option == "--jit") {
+				jitThreshold = std::stoull(argv[first + 1]);
+				if (jitThreshold == 0) {
+					throw std::invalid_argument(option);
+				}
+			} else if (option == "--cache") {
+				cache = argv[first + 1];
+			} else if (option == "--parser") {
+				reference = std::string(argv[first + 1]) == "pegmatite";
+				if (!reference && std::string(argv[first + 1]) != "reader") {
+					throw std::invalid_argument(option);
+				}
+			} else if (option == "--and-parallel") {
+				conjunctionThreads = std::stoul(argv[first + 1]);
+				if (conjunctionThreads == 0) {
+					throw std::invalid_argument(option);
+				}
+			} else {
+				break;
+			}
+		}
+	} catch (const std::logic_error&) {
+		usage(argv[0]);
+		
+		return EXIT_FAILURE;
+	}
+	// The options are skipped, so that the remaining arguments follow the name of the command as usual.
+	argv[first - 1] = argv[0];
+	argc -= first - 1;
+	argv += first - 1;
+	// Programs may be compiled ahead of time into an executable, rather than being interpreted.
+	bool compile = argc > 1 && std::string(argv[1]) == "--compile";
+	// Alternatively, a program may be consulted once, and then queried by a file of independent queries, each of which is executed by one of several threads.
+	bool batch = argc > 1 && std::string(argv[1]) == "--batch";
+	// A pure Datalog program may also be evaluated bottom-up, rather than by resolution.
+	bool datalog = argc > 1 && std::string(argv[1]) == "--datalog";
+	// Or it may be consulted once, and then serve queries over a socket for as long as it runs.
+	bool serve = argc > 1 && std::string(argv[1]) == "--serve";
+	unsigned threads = std::thread::hardware_concurrency();
+	if (batch && argc == 6 && std::string(argv[4]) == "-j") {
+		try {
+			threads = std::stoul(argv[5]);
+		} catch (const std::logic_error&) {
+			threads = 0;
+		}
+		argc -= 2;
+	}
+	// Images may not hold parallel conjunctions, and are not searched in parallel, so only programs that are interpreted as usual are cached.
+	bool cacheable = !compile && !batch && !datalog && !serve && searchThreads == 0 && conjunctionThreads == 0;
+	// Native code is not generated while running conjunctions in parallel, as the argument indexes it builds are not shared between the tasks that would use them.
+	if ((!cache.empty() && !cacheable) || (jitThreshold > 0 && conjunctionThreads > 0)) {
+		usage(argv[0]);
+		
+		return EXIT_FAILURE;
+	} else if (compile ? argc != 5 || std::string(argv[3]) != "-o" : batch ? argc != 4 || threads == 0 || collector.growth < 1 : datalog ? argc != 3 : serve ? argc != 5 || std::string(argv[3]) != "--socket" || collector.growth < 1 : argc < 2 || collector.growth < 1) {
 		usage(argv[0]);
 		
 		return EXIT_FAILURE;
 	} else {
-		Parser::EpilogParser parser;
-		std::unique_ptr<AST::Clauses> root;
-		pegmatite::AsciiFileInput input(open(argv[1], O_RDONLY));
-		if (parser.parse(input, parser.grammar.clauses, parser.grammar.ignored, pegmatite::defaultErrorReporter, root)) {
-			try {
-				Interpreter::Context context;
-				Runtime mainRuntime;
-				Runtime::currentRuntime = &mainRuntime;
-				root->interpret(context);
-				std::cout << "true." << std::endl;
-			} catch (const Epilog::UnificationError& error) {
-				std::cout << "false." << std::endl;
+		Parser::EpilogParser referenceParser;
+		Parser::EpilogParser* parser = reference ? &referenceParser : nullptr;
+		const char* path = argv[compile || batch || datalog || serve ? 2 : 1];
+		int file = openProgram(path);
+		if (file == -1) {
+			return EXIT_FAILURE;
+		}
+		// A cached program is neither parsed nor compiled.
+		bool cached = !cache.empty() && newer(cache.c_str(), path);
+		try {
+			Interpreter::Context context;
+			// Files loaded by the program are found relative to it, wherever Epilog is run from, unless it is read from the standard input.
+			std::string program(path);
+			if (program != "-") {
+				context.directory = program.substr(0, program.find_last_of('/') + 1);
+			}
+			Runtime mainRuntime;
+			Runtime::currentRuntime = &mainRuntime;
+			mainRuntime.collector = collector;
+			bool succeeded;
+			if (compile) {
+				// The program is linked, but its queries are only recorded, to be executed when the compiled program is run.
+				Image image;
+				context.image = &image;
+				if (!consult(parser, file, context, succeeded)) {
+					return EXIT_FAILURE;
+				}
+				Compiler::compile(image.save(), argv[4]);
+				return EXIT_SUCCESS;
+			}
+			Datalog program;
+			if (datalog) {
+				context.datalog = &program;
+			}
+			std::unique_ptr<TaskPool> tasks;
+			if (conjunctionThreads > 0) {
+				tasks.reset(new TaskPool(conjunctionThreads));
+				mainRuntime.tasks = tasks.get();
+				context.parallelConjunctions = true;
+			} else if (jitThreshold > 0) {
+				mainRuntime.jit = JIT::create(jitThreshold);
+			}
+			ParallelSearch search(searchThreads);
+			if (searchThreads > 0) {
+				context.search = &search;
+			}
+			if (!cache.empty()) {
+				// The program is compiled into an image, as when compiling it ahead of time, unless it is loaded from the cache.
+				Image image;
+				if (!cached || !image.load(cache)) {
+					context.image = &image;
+					if (!consult(parser, file, context, succeeded)) {
+						return EXIT_FAILURE;
+					}
+					context.image = nullptr;
+					image.save(cache);
+				}
+				succeeded = image.execute();
+			} else if (!consult(parser, file, context, succeeded)) {
 				return EXIT_FAILURE;
-			} catch (const Epilog::Exception& exception) {
-				exception.print();
+			}
+			if (!succeeded) {
+				std::cout << "false." << std::endl;
 				return EXIT_FAILURE;
 			}
-			return EXIT_SUCCESS;
-		} else {
+			if (serve) {
+				Server server;
+				server.serve(parser, context, argv[4]);
+			}
+			if (batch) {
+				// Every query is compiled before any is executed, as the code is shared by the threads that execute them.
+				Batch queries;
+				int queryFile = openProgram(argv[3]);
+				context.batch = &queries;
+				if (queryFile == -1 || !consult(parser, queryFile, context, succeeded)) {
+					return EXIT_FAILURE;
+				}
+				return queries.execute(threads) ? EXIT_SUCCESS : EXIT_FAILURE;
+			}
+			std::cout << "true." << std::endl;
+		} catch (const Epilog::Exception& exception) {
+			exception.print();
 			return EXIT_FAILURE;
 		}
+		return EXIT_SUCCESS;
 	}
 }
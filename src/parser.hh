@@ -21,6 +21,9 @@ namespace Epilog {
 			BindAST<AST::Fact> fact = EpilogGrammar::get().fact;
 			BindAST<AST::Rule> rule = EpilogGrammar::get().rule;
 			BindAST<AST::Query> query = EpilogGrammar::get().query;
+			BindAST<AST::PredicateIndicator> indicator = EpilogGrammar::get().indicator;
+			BindAST<AST::TableDirective> tableDirective = EpilogGrammar::get().tableDirective;
+			BindAST<AST::LoadDirective> loadDirective = EpilogGrammar::get().loadDirective;
 			public:
 			EpilogGrammar& grammar = EpilogGrammar::get();
 		};
@@ -0,0 +1,303 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include "reader.hh"
+#include "parser.hh"
+
+namespace Epilog {
+	namespace Parser {
+		// The classes of characters, as the grammar distinguishes them.
+		enum CharacterClass : uint8_t {
+			lowercase = 1 << 0,
+			uppercase = 1 << 1,
+			digit = 1 << 2,
+			// Characters that may follow the first of a name or variable.
+			character = 1 << 3,
+			// Whitespace.
+			layout = 1 << 4,
+			// Characters that are operators on their own.
+			symbol = 1 << 5,
+		};
+		
+		struct CharacterTable {
+			uint8_t classes[256] = {};
+			
+			CharacterTable() {
+				for (int c = 'a'; c <= 'z'; ++ c) {
+					classes[c] = lowercase | character;
+				}
+				for (int c = 'A'; c <= 'Z'; ++ c) {
+					classes[c] = uppercase | character;
+				}
+				for (int c = '0'; c <= '9'; ++ c) {
+					classes[c] = digit | character;
+				}
+				classes['_'] = character;
+				for (unsigned char c : std::string(" \t\n")) {
+					classes[c] = layout;
+				}
+				for (unsigned char c : std::string("<>.+-*/=")) {
+					classes[c] = symbol;
+				}
+			}
+		};
+		
+		static const CharacterTable characters;
+		
+		static inline bool is(char c, uint8_t classes) {
+			return (characters.classes[static_cast<unsigned char>(c)] & classes) != 0;
+		}
+		
+		std::unique_ptr<AST::Clauses> Reader::read(const std::string& text, std::string& error, std::size_t& line) {
+			start = position = text.data();
+			end = start + text.size();
+			try {
+				return clauses();
+			} catch (const SyntaxError& syntaxError) {
+				error = syntaxError.message;
+				line = 1 + static_cast<std::size_t>(std::count(start, syntaxError.position, '\n'));
+				return nullptr;
+			}
+		}
+		
+		void Reader::skipLayout() {
+			while (position < end) {
+				if (is(*position, layout)) {
+					++ position;
+				} else if (*position == '%') {
+					// Line comments must be ended by a newline.
+					const char* newline = static_cast<const char*>(std::memchr(position, '\n', static_cast<std::size_t>(end - position)));
+					if (newline == nullptr) {
+						fail("Unterminated comment.");
+					}
+					position = newline + 1;
+				} else if (*position == '/' && peek(1) == '*') {
+					const char* close = position + 2;
+					while ((close = static_cast<const char*>(std::memchr(close, '*', static_cast<std::size_t>(end - close)))) != nullptr && close + 1 < end && close[1] != '/') {
+						++ close;
+					}
+					if (close == nullptr || close + 1 >= end) {
+						fail("Unterminated comment.");
+					}
+					position = close + 2;
+				} else {
+					return;
+				}
+			}
+		}
+		
+		bool Reader::accept(const char* token) {
+			skipLayout();
+			std::size_t length = std::strlen(token);
+			if (static_cast<std::size_t>(end - position) >= length && std::memcmp(position, token, length) == 0) {
+				position += length;
+				return true;
+			}
+			return false;
+		}
+		
+		void Reader::expect(const char* token, const char* description) {
+			if (!accept(token)) {
+				fail(std::string("Expected ") + description + ".");
+			}
+		}
+		
+		void Reader::fail(const std::string& message) const {
+			throw SyntaxError { position, message };
+		}
+		
+		const char* Reader::closingQuote(const char* from, char quote, const char* description) const {
+			for (const char* close = from; (close = static_cast<const char*>(std::memchr(close, quote, static_cast<std::size_t>(end - close)))) != nullptr; ++ close) {
+				// Only quotes may be escaped, so a backslash before a quote cannot itself have been escaped.
+				if (close == from || close[-1] != '\\') {
+					return close;
+				}
+			}
+			fail(std::string("Unterminated ") + description + ".");
+		}
+		
+		std::unique_ptr<AST::Clauses> Reader::clauses() {
+			std::unique_ptr<AST::Clauses> clauses(new AST::Clauses());
+			for (skipLayout(); position < end; skipLayout()) {
+				if (accept("?-")) {
+					std::unique_ptr<AST::Query> query(new AST::Query());
+					query->body.reset(body().release());
+					clauses->clauses.push_back(std::move(query));
+				} else if (accept(":-")) {
+					if (accept("table")) {
+						std::unique_ptr<AST::TableDirective> directive(new AST::TableDirective());
+						do {
+							directive->predicates.push_back(indicator());
+						} while (accept(","));
+						clauses->clauses.push_back(std::move(directive));
+					} else if (accept("load_csv")) {
+						std::unique_ptr<AST::LoadDirective> directive(new AST::LoadDirective());
+						expect("(", "an opening bracket");
+						directive->file.std::string::operator=(identifier());
+						expect(",", "a comma");
+						directive->predicate.reset(indicator().release());
+						expect(")", "a closing bracket");
+						clauses->clauses.push_back(std::move(directive));
+					} else {
+						fail("Expected a directive.");
+					}
+				} else {
+					std::unique_ptr<AST::CompoundTerm> head = compoundTerm();
+					if (accept(":-")) {
+						std::unique_ptr<AST::Rule> rule(new AST::Rule());
+						rule->head.reset(head.release());
+						rule->body.reset(body().release());
+						clauses->clauses.push_back(std::move(rule));
+					} else {
+						std::unique_ptr<AST::Fact> fact(new AST::Fact());
+						fact->head.reset(head.release());
+						clauses->clauses.push_back(std::move(fact));
+					}
+				}
+				expect(".", "a full stop");
+			}
+			return clauses;
+		}
+		
+		std::unique_ptr<AST::CompoundTerm> Reader::compoundTerm() {
+			std::unique_ptr<AST::CompoundTerm> compoundTerm(new AST::CompoundTerm());
+			compoundTerm->name.std::string::operator=(identifier());
+			compoundTerm->parameterList.reset(new AST::ParameterList());
+			if (accept("(") && !accept(")")) {
+				do {
+					compoundTerm->parameterList->parameters.push_back(term());
+				} while (accept(","));
+				expect(")", "a closing bracket");
+			}
+			return compoundTerm;
+		}
+		
+		std::unique_ptr<AST::EnrichedCompoundTerm> Reader::enrichedCompoundTerm() {
+			std::unique_ptr<AST::EnrichedCompoundTerm> goal(new AST::EnrichedCompoundTerm());
+			skipLayout();
+			if (peek() == '\\' && (peek(1) == '+' || peek(1) == ':')) {
+				goal->modifier.reset(new AST::Modifier());
+				goal->modifier->std::string::operator=(std::string(position, 2));
+				position += 2;
+			}
+			goal->compoundTerm.reset(compoundTerm().release());
+			return goal;
+		}
+		
+		std::unique_ptr<AST::Body> Reader::body() {
+			std::unique_ptr<AST::Body> body(new AST::Body());
+			do {
+				body->goals.push_back(enrichedCompoundTerm());
+			} while (accept(","));
+			return body;
+		}
+		
+		std::unique_ptr<AST::Term> Reader::term() {
+			skipLayout();
+			char c = peek();
+			if (is(c, digit) || (c == '-' && is(peek(1), digit))) {
+				std::unique_ptr<AST::Number> number(new AST::Number());
+				number->value = this->number();
+				return std::move(number);
+			}
+			if (is(c, lowercase | symbol) || c == '\'' || (c == '[' && peek(1) == ']')) {
+				return compoundTerm();
+			}
+			if (is(c, uppercase) || c == '_') {
+				const char* first = position;
+				// An underscore on its own is an anonymous variable, and may not begin a longer name.
+				do {
+					++ position;
+				} while (c != '_' && position < end && is(*position, character));
+				std::unique_ptr<AST::Variable> variable(new AST::Variable());
+				variable->name.std::string::operator=(AST::normaliseIdentifierName(std::string(first, position)));
+				return std::move(variable);
+			}
+			if (c == '[') {
+				++ position;
+				std::unique_ptr<AST::List> list(new AST::List());
+				list->elementList.reset(new AST::ElementList());
+				do {
+					list->elementList->elements.push_back(term());
+				} while (accept(","));
+				if (accept("|")) {
+					list->tail.reset(term().release());
+				}
+				expect("]", "a closing square bracket");
+				return std::move(list);
+			}
+			if (c == '"') {
+				const char* close = closingQuote(position + 1, '"', "string");
+				// The grammar skips layout before each character of a string, so layout at either end is not part of its content.
+				const char* first = position + 1;
+				const char* last = close;
+				while (first < last && is(*first, layout)) {
+					++ first;
+				}
+				while (last > first && is(last[-1], layout)) {
+					-- last;
+				}
+				position = close + 1;
+				std::unique_ptr<AST::String> string(new AST::String());
+				string->text.std::string::operator=(std::string(first, last));
+				return std::move(string);
+			}
+			fail("Expected a term.");
+		}
+		
+		std::unique_ptr<AST::PredicateIndicator> Reader::indicator() {
+			std::unique_ptr<AST::PredicateIndicator> indicator(new AST::PredicateIndicator());
+			indicator->name.std::string::operator=(identifier());
+			expect("/", "a slash");
+			indicator->arity.reset(new AST::Number());
+			indicator->arity->value = number();
+			return indicator;
+		}
+		
+		std::string Reader::identifier() {
+			skipLayout();
+			const char* first = position;
+			char c = peek();
+			if (is(c, lowercase)) {
+				do {
+					++ position;
+				} while (position < end && is(*position, character));
+			} else if (c == '=' && (peek(1) == '<' || peek(1) == '>')) {
+				position += 2;
+			} else if (is(c, symbol)) {
+				++ position;
+			} else if (c == '[' && peek(1) == ']') {
+				position += 2;
+			} else if (c == '\'') {
+				position = closingQuote(position + 1, '\'', "quoted atom") + 1;
+				return AST::normaliseIdentifierName(std::string(first, position));
+			} else {
+				fail("Expected a name.");
+			}
+			return std::string(first, position);
+		}
+		
+		int64_t Reader::number() {
+			skipLayout();
+			const char* first = position;
+			if (peek() == '-') {
+				++ position;
+			}
+			if (!is(peek(), digit)) {
+				fail("Expected a number.");
+			}
+			while (position < end && is(*position, digit)) {
+				++ position;
+			}
+			// The text is held by a string, so it is terminated, and the digits may be converted in place.
+			errno = 0;
+			long long value = std::strtoll(first, nullptr, 10);
+			if (errno == ERANGE) {
+				position = first;
+				fail("The number is out of range.");
+			}
+			return static_cast<int64_t>(value);
+		}
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace Epilog {
+	namespace AST {
+		class Clauses;
+		class CompoundTerm;
+		class EnrichedCompoundTerm;
+		class Body;
+		class Term;
+		class PredicateIndicator;
+	}
+	
+	namespace Parser {
+		// Reads programs in the language of EpilogGrammar by recursive descent, building the same syntax trees as EpilogParser, which is kept as a reference.
+		// Every choice in the grammar can be made by looking at most two characters ahead, so nothing is backtracked or memoised: characters are classified by a table, and the ends of quoted atoms, strings and comments are found by memchr, which the C library vectorises.
+		// test/differential.cc checks that both read the examples, and the clauses of test/adversarial.el, into the same trees. They differ on purpose in one respect: the grammar skips layout and comments between the characters of quoted atoms and strings, so that a % or /* within one (as in 'a%b') begins a comment, whereas the reader takes everything up to the closing quote as written, as ClauseStream does when splitting clauses.
+		class Reader {
+			public:
+			// Reads a sequence of clauses from text. Returns nullptr if it is not one, setting error to why, and line to the line of the text on which reading failed.
+			std::unique_ptr<AST::Clauses> read(const std::string& text, std::string& error, std::size_t& line);
+			
+			private:
+			struct SyntaxError {
+				const char* position;
+				std::string message;
+			};
+			
+			// Skips whitespace and comments.
+			void skipLayout();
+			
+			// Returns the character at the given offset from the position, or 0 past the end of the text.
+			char peek(std::size_t offset = 0) const {
+				return position + offset < end ? position[offset] : '\0';
+			}
+			
+			// Skips layout, then consumes the given token if it follows.
+			bool accept(const char* token);
+			
+			void expect(const char* token, const char* description);
+			
+			[[noreturn]] void fail(const std::string& message) const;
+			
+			// Returns the position of the quote that closes a quoted atom or string whose content starts at the given position, or fails if there is none.
+			const char* closingQuote(const char* from, char quote, const char* description) const;
+			
+			std::unique_ptr<AST::Clauses> clauses();
+			std::unique_ptr<AST::CompoundTerm> compoundTerm();
+			std::unique_ptr<AST::EnrichedCompoundTerm> enrichedCompoundTerm();
+			std::unique_ptr<AST::Body> body();
+			std::unique_ptr<AST::Term> term();
+			std::unique_ptr<AST::PredicateIndicator> indicator();
+			std::string identifier();
+			int64_t number();
+			
+			const char* start;
+			const char* position;
+			const char* end;
+		};
+	}
+}
@@ -1,447 +1,1557 @@
+#include <algorithm>
 #include <iostream>
+#include <new>
 #include <vector>
 #include <string>
 #include <stack>
 #include "runtime.hh"
+#include "conjunction.hh"
 #include "interpreter.hh"
+#include "jit.hh"
 #include "standardlibrary.hh"
+#include "tabling.hh"
 
 namespace Epilog {
-	Runtime* Runtime::currentRuntime = nullptr;
+	thread_local Runtime* Runtime::currentRuntime = nullptr;
 	
-	std::unique_ptr<HeapContainer>& HeapReference::get() const {
+	const Instruction::instructionReference Instruction::failLabel;
+	
+	Cell& HeapReference::get(Runtime& runtime) const {
 		switch (area) {
 			case StorageArea::heap:
-				return Runtime::currentRuntime->heap[index];
+				return runtime.heap[index];
 			case StorageArea::reg:
-				return Runtime::currentRuntime->registers[index];
-			case StorageArea::environment:
-				return Runtime::currentRuntime->currentEnvironment()->variables[index];
+				return runtime.registers[index];
+			case StorageArea::environment: {
+				Environment* environment = runtime.currentEnvironment();
+				if (index >= environment->size) {
+					throw RuntimeException("Tried to access a vector index out of bounds.", __FILENAME__, __func__, __LINE__);
+				}
+				return environment->variables()[index];
+			}
 			case StorageArea::undefined:
 				throw RuntimeException("Tried to get an undefined reference.", __FILENAME__, __func__, __LINE__);
 		}
 	}
 	
-	void HeapReference::assign(std::unique_ptr<HeapContainer> value) const {
-		switch (area) {
-			case StorageArea::heap:
-				Runtime::currentRuntime->heap[index] = std::move(value);
-				break;
-			case StorageArea::reg:
-				Runtime::currentRuntime->registers[index] = std::move(value);
-				break;
-			case StorageArea::environment:
-				Runtime::currentRuntime->currentEnvironment()->variables[index] = std::move(value);
-				break;
-			case StorageArea::undefined:
-				throw RuntimeException("Tried to assign to an undefined reference.", __FILENAME__, __func__, __LINE__);
+	void HeapReference::assign(Runtime& runtime, Cell value) const {
+		get(runtime) = value;
+	}
+	
+	Cell Cell::integer(int64_t value) {
+		if (value < minimumInteger || value > maximumInteger) {
+			throw RuntimeException("Tried to store an integer that is too large to be represented.", __FILENAME__, __func__, __LINE__);
 		}
+		return Cell((static_cast<word>(value) << tagBits) | static_cast<word>(Tag::integer));
 	}
 	
-	std::string listToString(HeapContainer* container, bool explicitControlCharacters) {
+	// The symbols used to display lists.
+	static const SymbolTable::symbolIndex listSymbol = SymbolTable::intern(".", 2);
+	static const SymbolTable::symbolIndex emptyListSymbol = SymbolTable::intern("[]", 0);
+	
+	std::string Cell::toString() const {
+		switch (tag()) {
+			case Tag::reference:
+				return "(reference, " + std::to_string(address()) + ")";
+			case Tag::structure:
+				return "(compound term, " + std::to_string(address()) + ")";
+			case Tag::constant:
+			case Tag::functor:
+				return functor().toString();
+			case Tag::integer:
+				return std::to_string(integer());
+			case Tag::empty:
+				return "null";
+		}
+	}
+	
+	std::string listToString(Runtime& runtime, Cell cell, bool explicitControlCharacters) {
 		std::string string;
-		HeapContainer* nextContainer = container;
+		Cell nextCell = cell;
 		bool reachedEnd = false;
 		bool tail = true;
 		while (!reachedEnd) {
 			reachedEnd = true;
-			if (HeapTuple* tuple = dynamic_cast<HeapTuple*>(nextContainer)) {
-				HeapFunctor* functor;
-				if (tuple->type == HeapTuple::Type::compoundTerm && (functor = dynamic_cast<HeapFunctor*>(Runtime::currentRuntime->heap[tuple->reference].get()))) {
-					std::string symbol = functor->toString();
-					if (symbol == "./2") {
-						string += ", " + Runtime::currentRuntime->heap[tuple->reference + 1]->trace(explicitControlCharacters);
-						nextContainer = Runtime::currentRuntime->heap[tuple->reference + 2].get();
-						reachedEnd = false;
-					} else if (symbol == "[]/0") {
-						tail = false;
-					}
+			if (nextCell.tag() == Cell::Tag::structure) {
+				if (runtime.heap[nextCell.address()].symbol() == listSymbol) {
+					string += ", " + runtime.heap[nextCell.address() + 1].trace(runtime, explicitControlCharacters);
+					nextCell = runtime.heap[nextCell.address() + 2];
+					reachedEnd = false;
 				}
+			} else if (nextCell.tag() == Cell::Tag::constant && nextCell.symbol() == emptyListSymbol) {
+				tail = false;
 			}
 		}
-		return string + (tail ? " | " + nextContainer->trace(explicitControlCharacters) : "");
+		return string + (tail ? " | " + nextCell.trace(runtime, explicitControlCharacters) : "");
 	}
 	
-	std::string HeapTuple::trace(bool explicitControlCharacters) const {
-		switch (type) {
-			case Type::compoundTerm: {
-				if (HeapFunctor* functor = dynamic_cast<HeapFunctor*>(Runtime::currentRuntime->heap[reference].get())) {
-					if (functor->name == "." && functor->parameters == 2) {
-						// It's a list, so display it as one.
-						return "[" + Runtime::currentRuntime->heap[reference + 1]->trace(explicitControlCharacters) + listToString(Runtime::currentRuntime->heap[reference + 2].get(), explicitControlCharacters) + "]";
-					} else {
-						std::string parameters = "";
-						for (int64_t i = 0; i < functor->parameters; ++ i) {
-							parameters += (i > 0 ? "," : "") + Runtime::currentRuntime->heap[reference + (i + 1)]->trace(explicitControlCharacters);
-						}
-						return Runtime::currentRuntime->heap[reference]->trace(explicitControlCharacters) + (functor->parameters > 0 ? "(" + parameters + ")" : "");
-					}
-				} else {
+	std::string Cell::trace(Runtime& runtime, bool explicitControlCharacters) const {
+		switch (tag()) {
+			case Tag::structure: {
+				Cell header = runtime.heap[address()];
+				if (header.tag() != Tag::functor) {
 					throw RuntimeException("Dereferenced a structure that did not point to a functor.", __FILENAME__, __func__, __LINE__);
 				}
+				const HeapFunctor& functor = header.functor();
+				if (header.symbol() == listSymbol) {
+					// It's a list, so display it as one.
+					return "[" + runtime.heap[address() + 1].trace(runtime, explicitControlCharacters) + listToString(runtime, runtime.heap[address() + 2], explicitControlCharacters) + "]";
+				} else {
+					std::string parameters = "";
+					for (int64_t i = 0; i < functor.parameters; ++ i) {
+						parameters += (i > 0 ? "," : "") + runtime.heap[address() + (i + 1)].trace(runtime, explicitControlCharacters);
+					}
+					return functor.trace(explicitControlCharacters) + (functor.parameters > 0 ? "(" + parameters + ")" : "");
+				}
 			}
-			case Type::reference: {
-				if (Runtime::currentRuntime->heap[reference].get() != this) {
-					return Runtime::currentRuntime->heap[reference]->trace(explicitControlCharacters);
+			case Tag::reference: {
+				Cell target = runtime.heap[address()];
+				if (target != *this) {
+					return target.trace(runtime, explicitControlCharacters);
 				} else {
 					return "_";
 				}
 			}
+			case Tag::constant:
+			case Tag::functor:
+				return functor().trace(explicitControlCharacters);
+			case Tag::integer:
+				return std::to_string(integer());
+			case Tag::empty:
+				throw RuntimeException("Tried to trace an unset cell.", __FILENAME__, __func__, __LINE__);
 		}
 	}
 	
-	void PushCompoundTermInstruction::execute() {
-		HeapTuple header(HeapTuple::Type::compoundTerm, Runtime::currentRuntime->heap.size() + 1);
-		Runtime::currentRuntime->heap.push_back(header.copy());
-		Runtime::currentRuntime->heap.push_back(functor.copy());
-		registerReference.assign(header.copy());
-		++ Runtime::currentRuntime->nextInstruction;
+	bool pushCompoundTerm(Runtime& runtime, SymbolTable::symbolIndex functor, int64_t parameters, HeapReference registerReference) {
+		if (parameters == 0) {
+			// Atoms are stored directly as constants, rather than as structures on the heap.
+			registerReference.assign(runtime, Cell::constant(functor));
+		} else {
+			StackHeap& heap = runtime.heap;
+			Cell header = Cell::structure(heap.size() + 1);
+			heap.push_back(header);
+			heap.push_back(Cell::functor(functor));
+			registerReference.assign(runtime, header);
+		}
+		return true;
 	}
 	
-	void PushVariableInstruction::execute() {
-		HeapTuple header(HeapTuple::Type::reference, Runtime::currentRuntime->heap.size());
-		Runtime::currentRuntime->heap.push_back(header.copy());
-		registerReference.assign(header.copy());
-		++ Runtime::currentRuntime->nextInstruction;
+	bool pushVariable(Runtime& runtime, HeapReference registerReference) {
+		Cell header = Cell::reference(runtime.heap.size());
+		runtime.heap.push_back(header);
+		registerReference.assign(runtime, header);
+		return true;
 	}
 	
-	void PushValueInstruction::execute() {
-		Runtime::currentRuntime->heap.push_back(registerReference.getAsCopy());
-		++ Runtime::currentRuntime->nextInstruction;
+	bool pushValue(Runtime& runtime, HeapReference registerReference) {
+		runtime.heap.push_back(registerReference.get(runtime));
+		return true;
 	}
 	
-	void PushNumberInstruction::execute() {
-		Runtime::currentRuntime->heap.push_back(number.copy());
-		registerReference.assign(number.copy());
-		++ Runtime::currentRuntime->nextInstruction;
+	bool pushNumber(Runtime& runtime, HeapNumber number, HeapReference registerReference) {
+		// Integers are unboxed, so they do not need to be placed on the heap.
+		registerReference.assign(runtime, Cell::integer(number.value));
+		return true;
 	}
 	
-	HeapReference dereference(const HeapReference& reference) {
-		if (HeapTuple* value = dynamic_cast<HeapTuple*>(reference.getPointer())) {
-			HeapTuple::Type type = value->type;
-			HeapReference::heapIndex next = value->reference;
-			if (type == HeapTuple::Type::reference && (reference.area != StorageArea::heap || next != reference.index)) {
-				HeapReference nextReference(StorageArea::heap, next);
-				return dereference(nextReference);
-			} else { 
+	HeapReference dereference(Runtime& runtime, const HeapReference& reference) {
+		Cell value = reference.get(runtime);
+		switch (value.tag()) {
+			case Cell::Tag::reference:
+				if (reference.area != StorageArea::heap || value.address() != reference.index) {
+					return dereference(runtime, HeapReference(StorageArea::heap, value.address()));
+				}
 				return reference;
-			}
-		} else if (dynamic_cast<HeapNumber*>(reference.getPointer())) {
-			return reference;
-		} else {
-			throw RuntimeException("Tried to dereference a non-tuple address on the stack as a tuple.", __FILENAME__, __func__, __LINE__);
+			case Cell::Tag::structure:
+			case Cell::Tag::constant:
+			case Cell::Tag::integer:
+				return reference;
+			default:
+				throw RuntimeException("Tried to dereference a non-tuple address on the stack as a tuple.", __FILENAME__, __func__, __LINE__);
 		}
 	}
 	
-	void trail(HeapReference& reference) {
+	void trail(Runtime& runtime, HeapReference& reference) {
 		// Only conditional bindings need to be stored.
 		// These are bindings that affect variables existing before the creation of the current choice point.
-		if (Runtime::currentRuntime->topChoicePoint != -1UL && ((reference.area == StorageArea::heap && reference.index < Runtime::currentRuntime->currentChoicePoint()->heapSize) || reference.area == StorageArea::environment)) {
-			Runtime::currentRuntime->trail.push_back(reference);
+		if (runtime.topChoicePoint != -1UL && ((reference.area == StorageArea::heap && reference.index < runtime.currentChoicePoint()->heapSize) || reference.area == StorageArea::environment)) {
+			runtime.trail.push_back(reference);
 		}
 	}
 	
-	void bind(HeapReference& referenceA, HeapReference& referenceB) {
-		HeapTuple* tupleA = dynamic_cast<HeapTuple*>(referenceA.getPointer());
-		HeapTuple* tupleB = dynamic_cast<HeapTuple*>(referenceB.getPointer());
-		HeapNumber* numberA = dynamic_cast<HeapNumber*>(referenceA.getPointer());
-		HeapNumber* numberB = dynamic_cast<HeapNumber*>(referenceB.getPointer());
-		if ((tupleA || numberA) && (tupleB || numberB)) {
-			if ((tupleA && tupleA->type == HeapTuple::Type::reference) && (!tupleB || tupleB->type != HeapTuple::Type::reference || referenceA.index <= referenceB.index)) {
-				referenceA.assign(referenceB.getAsCopy());
-				trail(referenceA);
-			} else {
-				referenceB.assign(referenceA.getAsCopy());
-				trail(referenceB);
-			}
+	void bind(Runtime& runtime, HeapReference& referenceA, HeapReference& referenceB) {
+		Cell cellA = referenceA.get(runtime);
+		Cell cellB = referenceB.get(runtime);
+		if (cellA.tag() == Cell::Tag::reference && (cellB.tag() != Cell::Tag::reference || referenceA.index <= referenceB.index)) {
+			referenceA.assign(runtime, cellB);
+			trail(runtime, referenceA);
 		} else {
-			throw RuntimeException("Tried to bind a non-tuple structure.", __FILENAME__, __func__, __LINE__);
+			referenceB.assign(runtime, cellA);
+			trail(runtime, referenceB);
 		}
 	}
 	
-	void unify(HeapReference& a, HeapReference& b) {
+	bool unify(Runtime& runtime, HeapReference& a, HeapReference& b) {
 		std::stack<HeapReference> pushdownList;
 		pushdownList.push(a);
 		pushdownList.push(b);
 		while (!pushdownList.empty()) {
-			HeapReference referenceA = dereference(pushdownList.top()); pushdownList.pop();
-			HeapReference referenceB = dereference(pushdownList.top()); pushdownList.pop();
+			HeapReference referenceA = dereference(runtime, pushdownList.top()); pushdownList.pop();
+			HeapReference referenceB = dereference(runtime, pushdownList.top()); pushdownList.pop();
 			// Force unification to occur if both values are compound terms placed in registers
 			if (referenceA != referenceB) {
-				HeapTuple* tupleA = dynamic_cast<HeapTuple*>(referenceA.getPointer());
-				HeapTuple* tupleB = dynamic_cast<HeapTuple*>(referenceB.getPointer());
-				HeapNumber* numberA = dynamic_cast<HeapNumber*>(referenceA.getPointer());
-				HeapNumber* numberB = dynamic_cast<HeapNumber*>(referenceB.getPointer());
-				if ((tupleA || numberA) && (tupleB || numberB)) {
-					HeapTuple::Type typeA = tupleA ? tupleA->type : HeapTuple::Type::compoundTerm;
-					HeapTuple::Type typeB = tupleB ? tupleB->type : HeapTuple::Type::compoundTerm;
-					if (typeA == HeapTuple::Type::reference || typeB == HeapTuple::Type::reference) {
-						bind(referenceA, referenceB);
-					} else {
-						if (numberA && numberB) {
-							if (numberA->value != numberB->value) {
-								throw UnificationError("Tried to unify two unequal numbers.", __FILENAME__, __func__, __LINE__);
+				Cell cellA = referenceA.get(runtime);
+				Cell cellB = referenceB.get(runtime);
+				if (cellA.tag() == Cell::Tag::reference || cellB.tag() == Cell::Tag::reference) {
+					bind(runtime, referenceA, referenceB);
+				} else if (cellA.tag() != cellB.tag()) {
+					return false;
+				} else {
+					switch (cellA.tag()) {
+						case Cell::Tag::integer:
+							if (cellA.integer() != cellB.integer()) {
+								return false;
+							}
+							break;
+						case Cell::Tag::constant:
+							if (cellA.symbol() != cellB.symbol()) {
+								return false;
 							}
-						} else if (tupleA && tupleB) {
-							HeapReference::heapIndex indexA = tupleA->reference;
-							HeapReference::heapIndex indexB = tupleB->reference;
-							HeapFunctor* functorA = dynamic_cast<HeapFunctor*>(Runtime::currentRuntime->heap[indexA].get());
-							HeapFunctor* functorB = dynamic_cast<HeapFunctor*>(Runtime::currentRuntime->heap[indexB].get());
-							if (functorA && functorB) {
-								if (functorA->name == functorB->name && functorA->parameters == functorB->parameters) {
-									for (int64_t i = 1; i <= functorA->parameters; ++ i) {
-										pushdownList.push(HeapReference(StorageArea::heap, indexA + i));
-										pushdownList.push(HeapReference(StorageArea::heap, indexB + i));
-									}
-								} else {
-									throw UnificationError("Tried to unify two values that cannot unify.", __FILENAME__, __func__, __LINE__);
+							break;
+						case Cell::Tag::structure: {
+							HeapReference::heapIndex indexA = cellA.address();
+							HeapReference::heapIndex indexB = cellB.address();
+							Cell headerA = runtime.heap[indexA];
+							Cell headerB = runtime.heap[indexB];
+							if (headerA.tag() != Cell::Tag::functor || headerB.tag() != Cell::Tag::functor) {
+								throw RuntimeException("Tried to dereference a non-functor address on the stack as a functor.", __FILENAME__, __func__, __LINE__);
+							}
+							if (headerA.symbol() == headerB.symbol()) {
+								for (int64_t i = 1; i <= headerA.functor().parameters; ++ i) {
+									pushdownList.push(HeapReference(StorageArea::heap, indexA + i));
+									pushdownList.push(HeapReference(StorageArea::heap, indexB + i));
 								}
 							} else {
-								throw RuntimeException("Tried to dereference a non-functor address on the stack as a functor.", __FILENAME__, __func__, __LINE__);
+								return false;
 							}
-						} else {
-							throw UnificationError("Tried to unify a number with a compound term.", __FILENAME__, __func__, __LINE__);
+							break;
 						}
+						default:
+							throw RuntimeException("Tried to dereference a non-tuple address on the stack as a tuple.", __FILENAME__, __func__, __LINE__);
 					}
-				} else {
-					throw RuntimeException("Tried to dereference a non-tuple address on the stack as a tuple.", __FILENAME__, __func__, __LINE__);
 				}
 			}
 		}
+		return true;
 	}
 	
-	void UnifyCompoundTermInstruction::execute() {
-		HeapReference address = dereference(registerReference);
-		if (HeapTuple* value = dynamic_cast<HeapTuple*>(address.getPointer())) {
-			HeapTuple::Type type = value->type;
-			switch (type) {
-				case HeapTuple::Type::reference: {
-					HeapReference::heapIndex index = Runtime::currentRuntime->heap.size();
-					Runtime::currentRuntime->heap.push_back(std::unique_ptr<HeapTuple>(new HeapTuple(HeapTuple::Type::compoundTerm, index + 1)));
-					Runtime::currentRuntime->heap.push_back(functor.copy());
+	bool unifyCompoundTerm(Runtime& runtime, SymbolTable::symbolIndex functor, int64_t parameters, HeapReference registerReference) {
+		HeapReference address = dereference(runtime, registerReference);
+		Cell value = address.get(runtime);
+		switch (value.tag()) {
+			case Cell::Tag::reference: {
+				if (parameters == 0) {
+					address.assign(runtime, Cell::constant(functor));
+					trail(runtime, address);
+				} else {
+					StackHeap& heap = runtime.heap;
+					HeapReference::heapIndex index = heap.size();
+					heap.push_back(Cell::structure(index + 1));
+					heap.push_back(Cell::functor(functor));
 					HeapReference newCompoundTerm(StorageArea::heap, index);
-					bind(address, newCompoundTerm);
-					Runtime::currentRuntime->mode = Mode::write;
-					break;
+					bind(runtime, address, newCompoundTerm);
 				}
-				case HeapTuple::Type::compoundTerm: {
-					HeapReference::heapIndex reference = value->reference;
-					if (HeapFunctor* fnc = dynamic_cast<HeapFunctor*>(Runtime::currentRuntime->heap[reference].get())) {
-						if (fnc->name == functor.name && fnc->parameters == functor.parameters) {
-							Runtime::currentRuntime->unificationIndex = reference + 1;
-							Runtime::currentRuntime->mode = Mode::read;
-						} else {
-							throw UnificationError("Tried to unify two functors that cannot unify.", __FILENAME__, __func__, __LINE__);
-						}
-					} else {
-						throw RuntimeException("Tried to dereference a non-functor address on the stack as a functor.", __FILENAME__, __func__, __LINE__);
-					}
-					break;
-				}					
+				runtime.mode = Mode::write;
+				break;
 			}
-		} else if (dynamic_cast<HeapNumber*>(address.getPointer())) {
-			throw UnificationError("Tried to unify a compound term with a number.", __FILENAME__, __func__, __LINE__);
-		} else {
-			throw RuntimeException("Tried to dereference a non-tuple address on the stack as a tuple.", __FILENAME__, __func__, __LINE__);
-		}
-		++ Runtime::currentRuntime->nextInstruction;
-	}
-	
-	void UnifyNumberInstruction::execute() {
-		HeapReference address = dereference(registerReference);
-		if (HeapTuple* value = dynamic_cast<HeapTuple*>(address.getPointer())) {
-			HeapTuple::Type type = value->type;
-			switch (type) {
-				case HeapTuple::Type::reference: {
-					HeapReference::heapIndex index = Runtime::currentRuntime->heap.size();
-					Runtime::currentRuntime->heap.push_back(number.copy());
-					HeapReference newNumber(StorageArea::heap, index);
-					bind(address, newNumber);
-					Runtime::currentRuntime->mode = Mode::write;
-					break;
+			case Cell::Tag::structure: {
+				HeapReference::heapIndex reference = value.address();
+				Cell header = runtime.heap[reference];
+				if (header.tag() != Cell::Tag::functor) {
+					throw RuntimeException("Tried to dereference a non-functor address on the stack as a functor.", __FILENAME__, __func__, __LINE__);
 				}
-				case HeapTuple::Type::compoundTerm: {
-					throw UnificationError("Tried to unify a number with a compound term.", __FILENAME__, __func__, __LINE__);
-				}					
-			}
-		} else if (HeapNumber* num = dynamic_cast<HeapNumber*>(address.getPointer())) {
-			if (num->value == number.value) {
-				Runtime::currentRuntime->unificationIndex = address.index + 1;
-				Runtime::currentRuntime->mode = Mode::read;
-			} else {
-				throw UnificationError("Tried to unify two unequal numbers.", __FILENAME__, __func__, __LINE__);
+				if (header.symbol() == functor) {
+					runtime.unificationIndex = reference + 1;
+					runtime.mode = Mode::read;
+				} else {
+					return false;
+				}
+				break;
 			}
-		} else {
-			throw RuntimeException("Tried to dereference a non-tuple address on the stack as a tuple.", __FILENAME__, __func__, __LINE__);
+			case Cell::Tag::constant: {
+				if (value.symbol() == functor) {
+					runtime.mode = Mode::read;
+				} else {
+					return false;
+				}
+				break;
+			}
+			case Cell::Tag::integer:
+				return false;
+			default:
+				throw RuntimeException("Tried to dereference a non-tuple address on the stack as a tuple.", __FILENAME__, __func__, __LINE__);
+		}
+		return true;
+	}
+	
+	bool unifyNumber(Runtime& runtime, HeapNumber number, HeapReference registerReference) {
+		HeapReference address = dereference(runtime, registerReference);
+		Cell value = address.get(runtime);
+		switch (value.tag()) {
+			case Cell::Tag::reference:
+				address.assign(runtime, Cell::integer(number.value));
+				trail(runtime, address);
+				runtime.mode = Mode::write;
+				break;
+			case Cell::Tag::integer:
+				if (value.integer() != number.value) {
+					return false;
+				}
+				runtime.mode = Mode::read;
+				break;
+			case Cell::Tag::structure:
+			case Cell::Tag::constant:
+				return false;
+			default:
+				throw RuntimeException("Tried to dereference a non-tuple address on the stack as a tuple.", __FILENAME__, __func__, __LINE__);
 		}
-		++ Runtime::currentRuntime->nextInstruction;
+		return true;
 	}
 	
-	void UnifyVariableInstruction::execute() {
-		switch (Runtime::currentRuntime->mode) {
+	bool unifyVariable(Runtime& runtime, HeapReference registerReference) {
+		switch (runtime.mode) {
 			case Mode::read:
-				registerReference.assign(Runtime::currentRuntime->heap[Runtime::currentRuntime->unificationIndex]->copy());
+				registerReference.assign(runtime, runtime.heap[runtime.unificationIndex]);
 				break;
 			case Mode::write:
-				HeapTuple header(HeapTuple::Type::reference, Runtime::currentRuntime->heap.size());
-				Runtime::currentRuntime->heap.push_back(header.copy());
-				registerReference.assign(header.copy());
+				Cell header = Cell::reference(runtime.heap.size());
+				runtime.heap.push_back(header);
+				registerReference.assign(runtime, header);
 				break;
 		}
-		++ Runtime::currentRuntime->unificationIndex;
-		++ Runtime::currentRuntime->nextInstruction;
+		++ runtime.unificationIndex;
+		return true;
 	}
 	
-	void UnifyValueInstruction::execute() {
-		switch (Runtime::currentRuntime->mode) {
+	bool unifyValue(Runtime& runtime, HeapReference registerReference) {
+		switch (runtime.mode) {
 			case Mode::read: {
-				HeapReference unificationReference(StorageArea::heap, Runtime::currentRuntime->unificationIndex);
-				unify(registerReference, unificationReference);
+				HeapReference unificationReference(StorageArea::heap, runtime.unificationIndex);
+				if (!unify(runtime, registerReference, unificationReference)) {
+					return false;
+				}
 				break;
 			}
 			case Mode::write: {
-				Runtime::currentRuntime->heap.push_back(registerReference.getAsCopy());
+				runtime.heap.push_back(registerReference.get(runtime));
 				break;
 			}
 		}
-		++ Runtime::currentRuntime->unificationIndex;
-		++ Runtime::currentRuntime->nextInstruction;
+		++ runtime.unificationIndex;
+		return true;
+	}
+	
+	bool pushVariableToAll(Runtime& runtime, HeapReference registerReference, HeapReference argumentReference) {
+		Cell header = Cell::reference(runtime.heap.size());
+		runtime.heap.push_back(header);
+		registerReference.assign(runtime, header);
+		argumentReference.assign(runtime, header);
+		return true;
 	}
 	
-	void PushVariableToAllInstruction::execute() {
-		HeapTuple header(HeapTuple::Type::reference, Runtime::currentRuntime->heap.size());
-		Runtime::currentRuntime->heap.push_back(header.copy());
-		registerReference.assign(header.copy());
-		argumentReference.assign(header.copy());
-		++ Runtime::currentRuntime->nextInstruction;
+	bool copyRegisterToArgument(Runtime& runtime, HeapReference registerReference, HeapReference argumentReference) {
+		argumentReference.assign(runtime, registerReference.get(runtime));
+		return true;
 	}
 	
-	void CopyRegisterToArgumentInstruction::execute() {
-		argumentReference.assign(registerReference.getAsCopy());
-		++ Runtime::currentRuntime->nextInstruction;
+	bool copyArgumentToRegister(Runtime& runtime, HeapReference registerReference, HeapReference argumentReference) {
+		registerReference.assign(runtime, argumentReference.get(runtime));
+		return true;
 	}
 	
-	void CopyArgumentToRegisterInstruction::execute() {
-		registerReference.assign(argumentReference.getAsCopy());
-		++ Runtime::currentRuntime->nextInstruction;
+	bool unifyRegisterAndArgument(Runtime& runtime, HeapReference registerReference, HeapReference argumentReference) {
+		if (!unify(runtime, registerReference, argumentReference)) {
+			return false;
+		}
+		return true;
 	}
 	
-	void UnifyRegisterAndArgumentInstruction::execute() {
-		unify(registerReference, argumentReference);
-		++ Runtime::currentRuntime->nextInstruction;
+	bool call(Runtime& runtime, SymbolTable::symbolIndex functor, int64_t parameters, Modifier::Type modifier, const Instruction::instructionReference*& label, Instruction::instructionReference continuation) {
+		// A call without a modifier only has to hide the modifier of an enclosing call from proceed, so calls without modifiers share one, rather than the stack growing with every call.
+		if (modifier != Modifier::Type::none || (!runtime.modifiers.empty() && runtime.modifiers.top().type != Modifier::Type::none)) {
+			// The frames that a negation or catch may restore are kept until its modifier is removed.
+			StateReference::stateIndex floor = runtime.modifiers.empty() ? 0 : runtime.modifiers.top().floor;
+			if (modifier != Modifier::Type::none) {
+				floor = runtime.topOfStateStack();
+			}
+			runtime.modifiers.push(Modifier(modifier, continuation, runtime.topEnvironment, runtime.topChoicePoint, floor));
+		}
+		if (label == nullptr) {
+			// Calls that have not been linked look up the label once, and then use it directly.
+			auto entry = runtime.labels.find(functor);
+			if (entry == runtime.labels.end()) {
+				// Calling an undefined predicate simply fails.
+				return false;
+			}
+			label = &entry->second;
+		}
+		if (*label == Instruction::failLabel) {
+			return false;
+		}
+		// A goal of a conjunction that has been cancelled fails at each call, so that it finishes promptly even if it would never have.
+		if (runtime.cancellation != nullptr && runtime.cancellation->isCancelled()) {
+			return false;
+		}
+		// The heap is collected as a predicate is entered, as only its arguments are in use.
+		if (runtime.heap.size() >= runtime.collector.trigger()) {
+			runtime.collector.collect(runtime, static_cast<HeapReference::heapIndex>(parameters));
+		}
+		runtime.nextGoal = continuation;
+		runtime.currentNumberOfArguments = parameters;
+		runtime.nextInstruction = *label;
+		return true;
 	}
 	
-	void CallInstruction::execute() {
-		Runtime::currentRuntime->modifiers.push(Modifier(modifier, Runtime::currentRuntime->nextInstruction + 1, Runtime::currentRuntime->topEnvironment, Runtime::currentRuntime->topChoicePoint));
-		std::string label = functor.toString();
-		if (Runtime::currentRuntime->labels.find(label) != Runtime::currentRuntime->labels.end()) {
-			Runtime::currentRuntime->nextGoal = Runtime::currentRuntime->nextInstruction + 1;
-			Runtime::currentRuntime->currentNumberOfArguments = functor.parameters;
-			Runtime::currentRuntime->nextInstruction = Runtime::currentRuntime->labels[label];
-		} else {
-			throw UnificationError("Tried to jump to an inexistent label.", __FILENAME__, __func__, __LINE__);
+	bool parallelCall(Runtime& runtime, const Conjunction& conjunction, Instruction::instructionReference continuation) {
+		// The goals are only run in parallel outside a negation or catch, which depends on the frames that running them in turn would create.
+		// Nor are they while a tabled call is being evaluated, as calls within them depend on the evaluations of this runtime.
+		bool succeeded;
+		if (runtime.tasks != nullptr && (runtime.modifiers.empty() || runtime.modifiers.top().type == Modifier::Type::none) && (runtime.tables == nullptr || runtime.tables->evaluations.empty()) && runtime.tasks->execute(runtime, conjunction, succeeded)) {
+			runtime.nextInstruction = continuation;
+			return succeeded;
 		}
+		const Instruction::instructionReference* label = conjunction.label;
+		return call(runtime, conjunction.functor, conjunction.parameters, Modifier::Type::none, label, continuation);
 	}
 	
-	void ProceedInstruction::execute() {
-		if (!Runtime::currentRuntime->modifiers.empty()) {
-			Modifier& modifier(Runtime::currentRuntime->modifiers.top());
-			if (modifier.type == Modifier::Type::negate) {
-				throw UnificationError("Successfully unified within not.", true, __FILENAME__, __func__, __LINE__);
-			}
-			if (modifier.type == Modifier::Type::intercept) {
-				throw UnificationError("Successfully unified within catch.", true, __FILENAME__, __func__, __LINE__);
+	bool proceed(Runtime& runtime) {
+		if (!runtime.modifiers.empty()) {
+			Modifier& modifier(runtime.modifiers.top());
+			if (modifier.type == Modifier::Type::negate || modifier.type == Modifier::Type::intercept) {
+				// Succeeding within a not or a catch is a failure that cannot itself be negated.
+				runtime.forcefulFailure = true;
+				return false;
 			}
 			// Otherwise, the modifier is empty, and we may proceed as usual.
 		}
-		Runtime::currentRuntime->nextInstruction = Runtime::currentRuntime->nextGoal;
+		runtime.nextInstruction = runtime.nextGoal;
+		return true;
 	}
 	
-	void AllocateInstruction::execute() {
-		std::unique_ptr<Environment> environment(new Environment(Runtime::currentRuntime->nextGoal));
-		environment->previousEnvironment = Runtime::currentRuntime->topEnvironment;
-		for (int64_t i = 0; i < variables; ++ i) {
-			environment->variables.push_back(nullptr);
-		}
-		Runtime::currentRuntime->topEnvironment = Runtime::currentRuntime->stateStack.size();
-		Runtime::currentRuntime->stateStack.push_back(std::move(environment));
-		++ Runtime::currentRuntime->nextInstruction;
+	bool allocate(Runtime& runtime, int64_t variables) {
+		StateReference::stateIndex index = runtime.pushFrame(sizeof(Environment) / sizeof(uint64_t) + variables);
+		Environment* environment = new (&runtime.stateStack[index]) Environment(runtime.topEnvironment, runtime.nextGoal, variables);
+		std::fill(environment->variables(), environment->variables() + variables, Cell());
+		runtime.topEnvironment = index;
+		return true;
 	}
 	
-	void DeallocateInstruction::execute() {
-		Runtime::currentRuntime->nextInstruction = Runtime::currentRuntime->currentEnvironment()->nextGoal;
-		Runtime::currentRuntime->popTopEnvironment();
+	bool deallocate(Runtime& runtime) {
+		// Execution continues with the following instruction (a proceed, or the call of the last goal), which returns to the continuation of the environment.
+		runtime.nextGoal = runtime.currentEnvironment()->nextGoal;
+		runtime.popTopEnvironment();
+		return true;
 	}
 	
-	void unwindTrail(std::vector<HeapReference>::size_type from, std::vector<HeapReference>::size_type to) {
+	bool trim(Runtime& runtime, HeapReference::heapIndex variables) {
+		// A choice point created since the environment may resume at an earlier goal, which could still use the variables, in which case they are kept.
+		if (runtime.topChoicePoint == -1UL || runtime.topChoicePoint < runtime.topEnvironment) {
+			Environment* environment = runtime.currentEnvironment();
+			environment->size = std::min(environment->size, variables);
+		}
+		return true;
+	}
+	
+	void unwindTrail(Runtime& runtime, std::vector<HeapReference>::size_type from, std::vector<HeapReference>::size_type to) {
 		for (std::vector<HeapReference>::size_type i = from; i < to; ++ i) {
-			HeapTuple header(HeapTuple::Type::reference, Runtime::currentRuntime->trail[i].index);
-			Runtime::currentRuntime->trail[i].assign(header.copy());
+			runtime.trail[i].assign(runtime, Cell::reference(runtime.trail[i].index));
 		}
 	}
 	
-	void TryInitialClauseInstruction::execute() {
-		if (Runtime::currentRuntime->topEnvironment == -1UL) {
+	void pushChoicePoint(Runtime& runtime, Instruction::instructionReference nextClause) {
+		if (runtime.topEnvironment == -1UL) {
 			throw RuntimeException("Tried to try an intial clause with no environment.", __FILENAME__, __func__, __LINE__);
 		}
-		std::unique_ptr<ChoicePoint> choicePoint(new ChoicePoint(Runtime::currentRuntime->topEnvironment, Runtime::currentRuntime->nextGoal, label, Runtime::currentRuntime->trail.size(), Runtime::currentRuntime->heap.size()));
-		choicePoint->previousChoicePoint = Runtime::currentRuntime->topChoicePoint;
-		choicePoint->environment = Runtime::currentRuntime->topEnvironment;
-		// Initialise the arguments
-		for (int64_t i = 0; i < Runtime::currentRuntime->currentNumberOfArguments; ++ i) {
-			choicePoint->arguments.push_back(Runtime::currentRuntime->registers[i]->copy());
+		HeapReference::heapIndex arguments = static_cast<HeapReference::heapIndex>(runtime.currentNumberOfArguments);
+		if (arguments > runtime.registers.size()) {
+			throw RuntimeException("Tried to access a vector index out of bounds.", __FILENAME__, __func__, __LINE__);
 		}
-		Runtime::currentRuntime->topChoicePoint = Runtime::currentRuntime->stateStack.size();
-		Runtime::currentRuntime->stateStack.push_back(std::move(choicePoint));
-		++ Runtime::currentRuntime->nextInstruction;
+		StateReference::stateIndex alternatives = runtime.topChoicePoint != -1UL ? runtime.currentChoicePoint()->alternatives : 0;
+		StateReference::stateIndex answers = runtime.topChoicePoint != -1UL ? runtime.currentChoicePoint()->answers : 0;
+		StateReference::stateIndex index = runtime.pushFrame(sizeof(ChoicePoint) / sizeof(uint64_t) + arguments);
+		ChoicePoint* choicePoint = new (&runtime.stateStack[index]) ChoicePoint(runtime.topEnvironment, runtime.nextGoal, nextClause, runtime.topChoicePoint, runtime.trail.size(), runtime.heap.size(), runtime.modifiers.size(), arguments);
+		choicePoint->alternatives = alternatives;
+		choicePoint->answers = answers;
+		// Initialise the arguments
+		std::copy(runtime.registers.begin(), runtime.registers.begin() + arguments, choicePoint->arguments());
+		runtime.topChoicePoint = index;
 	}
 	
-	void TryIntermediateClauseInstruction::execute() {
-		ChoicePoint* choicePoint = Runtime::currentRuntime->currentChoicePoint();
+	ChoicePoint* restoreChoicePoint(Runtime& runtime) {
+		ChoicePoint* choicePoint = runtime.currentChoicePoint();
 		// Set the arguments from frame
-		for (HeapReference::heapIndex i = 0; i < choicePoint->arguments.size(); ++ i) {
-			Runtime::currentRuntime->registers[i] = choicePoint->arguments[i]->copy();
-		}
+		std::copy(choicePoint->arguments(), choicePoint->arguments() + choicePoint->size, runtime.registers.begin());
 		// Set other variables
-		Runtime::currentRuntime->topEnvironment = choicePoint->environment;
-		Runtime::currentRuntime->compressStateStack();
-		Runtime::currentRuntime->nextGoal = choicePoint->nextGoal;
-		choicePoint->nextClause = label;
-		unwindTrail(choicePoint->trailSize, Runtime::currentRuntime->trail.size());
-		while (Runtime::currentRuntime->trail.size() > choicePoint->trailSize) {
-			Runtime::currentRuntime->trail.pop_back();
+		runtime.topEnvironment = choicePoint->environment;
+		runtime.nextGoal = choicePoint->nextGoal;
+		// Any calls made since the choice point was created have been undone.
+		while (runtime.modifiers.size() > choicePoint->modifiers) {
+			runtime.modifiers.pop();
 		}
-		while (Runtime::currentRuntime->heap.size() > choicePoint->heapSize) {
-			Runtime::currentRuntime->heap.pop_back();
+		unwindTrail(runtime, choicePoint->trailSize, runtime.trail.size());
+		runtime.trail.resize(choicePoint->trailSize);
+		runtime.heap.truncate(choicePoint->heapSize);
+		return choicePoint;
+	}
+	
+	bool tryInitialClause(Runtime& runtime, Instruction::instructionReference label) {
+		pushChoicePoint(runtime, label);
+		return true;
+	}
+	
+	bool tryIntermediateClause(Runtime& runtime, Instruction::instructionReference label) {
+		restoreChoicePoint(runtime)->nextClause = label;
+		return true;
+	}
+	
+	bool tryFinalClause(Runtime& runtime) {
+		restoreChoicePoint(runtime);
+		runtime.popTopChoicePoint();
+		return true;
+	}
+	
+	bool tryClause(Runtime& runtime, Instruction::instructionReference label, Instruction::instructionReference continuation) {
+		pushChoicePoint(runtime, continuation);
+		runtime.nextInstruction = label;
+		return true;
+	}
+	
+	bool retryClause(Runtime& runtime, Instruction::instructionReference label, Instruction::instructionReference continuation) {
+		restoreChoicePoint(runtime)->nextClause = continuation;
+		runtime.nextInstruction = label;
+		return true;
+	}
+	
+	bool trustClause(Runtime& runtime, Instruction::instructionReference label) {
+		restoreChoicePoint(runtime);
+		runtime.popTopChoicePoint();
+		runtime.nextInstruction = label;
+		return true;
+	}
+	
+	bool jumpToLabel(Runtime& runtime, Instruction::instructionReference label) {
+		if (label == Instruction::failLabel) {
+			return false;
 		}
-		++ Runtime::currentRuntime->nextInstruction;
+		runtime.nextInstruction = label;
+		return true;
 	}
 	
-	void TryFinalClauseInstruction::execute() {
-		ChoicePoint* choicePoint = Runtime::currentRuntime->currentChoicePoint();
-		// Set the arguments from frame
-		for (HeapReference::heapIndex i = 0; i < choicePoint->arguments.size(); ++ i) {
-			Runtime::currentRuntime->registers[i] = choicePoint->arguments[i]->copy();
+	bool switchOnTerm(Runtime& runtime, Instruction::instructionReference variableLabel, Instruction::instructionReference constantLabel, Instruction::instructionReference listLabel, Instruction::instructionReference structureLabel) {
+		Cell argument = dereference(runtime, HeapReference(StorageArea::reg, 0)).get(runtime);
+		switch (argument.tag()) {
+			case Cell::Tag::reference:
+				return jumpToLabel(runtime, variableLabel);
+			case Cell::Tag::constant:
+			case Cell::Tag::integer:
+				return jumpToLabel(runtime, constantLabel);
+			case Cell::Tag::structure:
+				return jumpToLabel(runtime, runtime.heap[argument.address()].symbol() == listSymbol ? listLabel : structureLabel);
+			default:
+				throw RuntimeException("Tried to switch on an argument that was not a term.", __FILENAME__, __func__, __LINE__);
 		}
-		// Set other variables
-		Runtime::currentRuntime->nextGoal = choicePoint->nextGoal;
-		unwindTrail(choicePoint->trailSize, Runtime::currentRuntime->trail.size());
-		while (Runtime::currentRuntime->trail.size() > choicePoint->trailSize) {
-			Runtime::currentRuntime->trail.pop_back();
+	}
+	
+	bool switchOnConstant(Runtime& runtime, const std::unordered_map<Cell::word, Instruction::instructionReference>& labels, Instruction::instructionReference defaultLabel) {
+		Cell argument = dereference(runtime, HeapReference(StorageArea::reg, 0)).get(runtime);
+		auto label = labels.find(argument.value);
+		return jumpToLabel(runtime, label != labels.end() ? label->second : defaultLabel);
+	}
+	
+	bool switchOnStructure(Runtime& runtime, const std::unordered_map<Cell::word, Instruction::instructionReference>& labels, Instruction::instructionReference defaultLabel) {
+		Cell argument = dereference(runtime, HeapReference(StorageArea::reg, 0)).get(runtime);
+		auto label = labels.find(runtime.heap[argument.address()].symbol());
+		return jumpToLabel(runtime, label != labels.end() ? label->second : defaultLabel);
+	}
+	
+	Cell argumentKey(Runtime& runtime, Cell argument) {
+		// Returns the cell by which a (dereferenced) argument is indexed, or an empty cell if it is unbound.
+		switch (argument.tag()) {
+			case Cell::Tag::constant:
+			case Cell::Tag::integer:
+				return argument;
+			case Cell::Tag::structure:
+				return runtime.heap[argument.address()];
+			default:
+				return Cell();
+		}
+	}
+	
+	void ArgumentIndex::update(std::vector<Instruction::instructionReference> clauses, std::vector<std::vector<Cell>> keys) {
+		// The addresses of the clauses may have changed, so any indexes are rebuilt when they are next used.
+		this->clauses = clauses;
+		this->keys = keys;
+		boundCalls.resize(keys.size());
+		tables.clear();
+		tables.resize(keys.size());
+	}
+	
+	void ArgumentIndex::build(argumentIndex argument) {
+		std::unique_ptr<Table> table(new Table());
+		std::unordered_map<Cell::word, std::vector<Instruction::instructionReference>> candidates;
+		std::vector<Instruction::instructionReference> variables;
+		for (std::vector<Instruction::instructionReference>::size_type i = 0; i < clauses.size(); ++ i) {
+			const Cell& key = keys[argument][i];
+			if (key.tag() != Cell::Tag::empty) {
+				candidates.emplace(key.value, variables);
+			}
+		}
+		for (std::vector<Instruction::instructionReference>::size_type i = 0; i < clauses.size(); ++ i) {
+			const Cell& key = keys[argument][i];
+			if (key.tag() != Cell::Tag::empty) {
+				candidates[key.value].push_back(clauses[i]);
+			} else {
+				variables.push_back(clauses[i]);
+				for (auto& candidate : candidates) {
+					candidate.second.push_back(clauses[i]);
+				}
+			}
 		}
-		while (Runtime::currentRuntime->heap.size() > choicePoint->heapSize) {
-			Runtime::currentRuntime->heap.pop_back();
+		for (auto& candidate : candidates) {
+			table->candidates[candidate.first] = std::make_shared<const std::vector<Instruction::instructionReference>>(std::move(candidate.second));
 		}
-		Runtime::currentRuntime->popTopChoicePoint();
-		++ Runtime::currentRuntime->nextInstruction;
+		table->variables = std::make_shared<const std::vector<Instruction::instructionReference>>(std::move(variables));
+		// Keep the statistics of the previous table for this argument, if it had to be rebuilt.
+		if (tables[argument] != nullptr) {
+			table->lookups = tables[argument]->lookups;
+			table->builds = tables[argument]->builds;
+		}
+		++ table->builds;
+		tables[argument] = std::move(table);
 	}
 	
-	void CommandInstruction::execute() {
-		if (StandardLibrary::commands.find(function) != StandardLibrary::commands.end()) {
-			StandardLibrary::commands[function]();
-		} else {
+	void ArgumentIndex::share() {
+		for (argumentIndex argument = 1; argument < keys.size(); ++ argument) {
+			if (tables[argument] == nullptr && std::any_of(keys[argument].begin(), keys[argument].end(), [] (const Cell& key) { return key.tag() != Cell::Tag::empty; })) {
+				build(argument);
+			}
+		}
+		shared = true;
+	}
+	
+	const ArgumentIndex::candidateList* ArgumentIndex::select(Runtime& runtime) {
+		if (!shared) {
+			++ calls;
+		}
+		// Calls with a bound first argument are already indexed by the first-argument switch.
+		if (argumentKey(runtime, dereference(runtime, HeapReference(StorageArea::reg, 0)).get(runtime)).tag() != Cell::Tag::empty) {
+			return nullptr;
+		}
+		const candidateList* selection = nullptr;
+		for (argumentIndex argument = 1; argument < keys.size(); ++ argument) {
+			Cell key = argumentKey(runtime, dereference(runtime, HeapReference(StorageArea::reg, argument)).get(runtime));
+			if (key.tag() == Cell::Tag::empty) {
+				continue;
+			}
+			if (tables[argument] == nullptr) {
+				if (shared || ++ boundCalls[argument] < threshold || std::all_of(keys[argument].begin(), keys[argument].end(), [] (const Cell& key) { return key.tag() == Cell::Tag::empty; })) {
+					continue;
+				}
+				build(argument);
+			}
+			Table& table = *tables[argument];
+			if (!shared) {
+				++ table.lookups;
+			}
+			auto candidates = table.candidates.find(key.value);
+			const candidateList& list = candidates != table.candidates.end() ? candidates->second : table.variables;
+			// Prefer whichever index leaves the fewest candidates.
+			if (selection == nullptr || list->size() < (*selection)->size()) {
+				selection = &list;
+			}
+		}
+		if (selection != nullptr && !shared) {
+			++ indexedCalls;
+		}
+		return selection;
+	}
+	
+	std::string ArgumentIndex::toString() const {
+		std::string description = SymbolTable::get(functor).toString() + ": " + std::to_string(clauses.size()) + " clauses, " + std::to_string(calls) + " calls, " + std::to_string(indexedCalls) + " indexed";
+		for (argumentIndex argument = 0; argument < tables.size(); ++ argument) {
+			if (tables[argument] != nullptr) {
+				description += "\n\t\targument " + std::to_string(argument + 1) + ": " + std::to_string(tables[argument]->candidates.size()) + " keys, " + std::to_string(tables[argument]->lookups) + " lookups, built " + std::to_string(tables[argument]->builds) + " times";
+			}
+		}
+		return description;
+	}
+	
+	bool indexArguments(Runtime& runtime, ArgumentIndex* index, Instruction::instructionReference fallbackLabel, Instruction::instructionReference continuation) {
+		const ArgumentIndex::candidateList* selection = index->select(runtime);
+		if (selection == nullptr) {
+			runtime.nextInstruction = fallbackLabel;
+			return true;
+		}
+		const ArgumentIndex::candidateList& candidates = *selection;
+		if (candidates->empty()) {
+			return false;
+		}
+		if (candidates->size() > 1) {
+			// The alternatives are tried by the retry instruction immediately following this one.
+			pushChoicePoint(runtime, continuation);
+			ChoicePoint* choicePoint = runtime.currentChoicePoint();
+			// Candidate lists are held alongside the frame stack, discarding those of any choice point that is no longer reachable.
+			runtime.alternatives.resize(choicePoint->alternatives);
+			runtime.alternatives.push_back(candidates);
+			choicePoint->alternatives += 1;
+			choicePoint->nextAlternative = 1;
+		}
+		runtime.nextInstruction = candidates->front();
+		return true;
+	}
+	
+	bool retryAlternative(Runtime& runtime) {
+		ChoicePoint* choicePoint = restoreChoicePoint(runtime);
+		const std::vector<Instruction::instructionReference>& candidates = *runtime.alternatives[choicePoint->alternatives - 1];
+		Instruction::instructionReference alternative = candidates[choicePoint->nextAlternative ++];
+		if (choicePoint->nextAlternative == candidates.size()) {
+			runtime.popTopChoicePoint();
+		}
+		runtime.nextInstruction = alternative;
+		return true;
+	}
+	
+	// Gives a tabled call the answers of its subgoal, leaving a choice point for the rest, or for those that are yet to be found while the subgoal is incomplete.
+	static bool returnAnswers(Runtime& runtime, std::shared_ptr<Subgoal> subgoal, Instruction::instructionReference answers) {
+		if (subgoal->answers.empty()) {
+			return false;
+		}
+		runtime.currentNumberOfArguments = subgoal->parameters;
+		if (subgoal->answers.size() > 1 || subgoal->state != Subgoal::State::complete) {
+			pushChoicePoint(runtime, answers);
+			ChoicePoint* choicePoint = runtime.currentChoicePoint();
+			// Subgoals are held alongside the frame stack, as candidate lists are.
+			runtime.answers.resize(choicePoint->answers);
+			runtime.answers.push_back(subgoal);
+			choicePoint->answers += 1;
+			choicePoint->nextAlternative = 1;
+		}
+		return subgoal->unify(runtime, 0) && proceed(runtime);
+	}
+	
+	// Runs the clauses of the innermost evaluation, which return each solution to the new_answer instruction rather than to the caller.
+	static bool evaluate(Runtime& runtime, Tables::Evaluation& evaluation) {
+		Instruction::instructionReference newAnswer = runtime.code->next(runtime.code->next(evaluation.answers));
+		// A negation or catch around the call applies to its answers, not to the solutions of its clauses, so it is hidden from them, as it is by call.
+		if (!runtime.modifiers.empty() && runtime.modifiers.top().type != Modifier::Type::none) {
+			runtime.modifiers.push(Modifier(Modifier::Type::none, newAnswer, runtime.topEnvironment, runtime.topChoicePoint, runtime.modifiers.top().floor));
+		}
+		runtime.nextGoal = newAnswer;
+		runtime.currentNumberOfArguments = evaluation.subgoal->parameters;
+		runtime.nextInstruction = evaluation.entry;
+		return true;
+	}
+	
+	bool tableCall(Runtime& runtime, SymbolTable::symbolIndex functor, Instruction::instructionReference entry, Instruction::instructionReference answers) {
+		if (runtime.tables == nullptr || runtime.tables->links != runtime.code->links) {
+			runtime.tables = std::make_shared<Tables>(runtime.code->links);
+		}
+		Tables& tables = *runtime.tables;
+		tables.prune(runtime);
+		std::shared_ptr<Subgoal> subgoal = tables.lookup(runtime, functor);
+		if (subgoal->state == Subgoal::State::incomplete) {
+			std::size_t position = tables.follow(*subgoal);
+			if (position == -1UL) {
+				// The generator choice point is backtracked into once the clauses have no more solutions.
+				pushChoicePoint(runtime, runtime.code->next(answers));
+				return evaluate(runtime, tables.begin(runtime, subgoal, entry, answers));
+			}
+			tables.depend(position);
+		} else if (subgoal->state == Subgoal::State::evaluating) {
+			tables.depend(tables.follow(*subgoal));
+		}
+		return returnAnswers(runtime, subgoal, answers);
+	}
+	
+	bool retryAnswer(Runtime& runtime) {
+		ChoicePoint* choicePoint = restoreChoicePoint(runtime);
+		std::shared_ptr<Subgoal> subgoal = runtime.answers[choicePoint->answers - 1];
+		std::size_t answer = choicePoint->nextAlternative ++;
+		// Answers may still be found for an incomplete subgoal, so its choice point is kept until they have all been given.
+		if (answer >= subgoal->answers.size() || (answer + 1 == subgoal->answers.size() && subgoal->state == Subgoal::State::complete)) {
+			runtime.popTopChoicePoint();
+		}
+		return answer < subgoal->answers.size() && subgoal->unify(runtime, answer) && proceed(runtime);
+	}
+	
+	bool completeTable(Runtime& runtime) {
+		if (runtime.tables != nullptr) {
+			runtime.tables->prune(runtime);
+		}
+		if (runtime.tables == nullptr || runtime.tables->evaluations.empty()) {
+			throw RuntimeException("Tried to complete a table that is not being evaluated.", __FILENAME__, __func__, __LINE__);
+		}
+		Tables& tables = *runtime.tables;
+		restoreChoicePoint(runtime);
+		std::shared_ptr<Subgoal> subgoal = tables.evaluations.back().subgoal;
+		Instruction::instructionReference answers = tables.evaluations.back().answers;
+		if (tables.finish()) {
+			return evaluate(runtime, tables.evaluations.back());
+		}
+		runtime.popTopChoicePoint();
+		return returnAnswers(runtime, subgoal, answers);
+	}
+	
+	bool newAnswer(Runtime& runtime) {
+		if (runtime.tables != nullptr) {
+			runtime.tables->prune(runtime);
+		}
+		if (runtime.tables == nullptr || runtime.tables->evaluations.empty()) {
+			throw RuntimeException("Tried to add an answer to a table that is not being evaluated.", __FILENAME__, __func__, __LINE__);
+		}
+		Tables::Evaluation& evaluation = runtime.tables->evaluations.back();
+		// The arguments of the call are held by the generator choice point.
+		ChoicePoint* generator = reinterpret_cast<ChoicePoint*>(&runtime.stateStack[evaluation.choicePoint]);
+		if (evaluation.subgoal->add(runtime, generator->arguments())) {
+			evaluation.changed = true;
+		}
+		// Every solution is found by backtracking, as though this one had failed.
+		return false;
+	}
+	
+	Arithmetic arithmeticOperation(const std::string& name, int64_t parameters) {
+		// Addition and multiplication may take any number of operands.
+		if (name == "+" && parameters > 1) {
+			return Arithmetic::add;
+		}
+		if (name == "-" && parameters == 2) {
+			return Arithmetic::subtract;
+		}
+		if (name == "*" && parameters > 1) {
+			return Arithmetic::multiply;
+		}
+		if (name == "/" && parameters == 2) {
+			return Arithmetic::divide;
+		}
+		if (name == "mod" && parameters == 2) {
+			return Arithmetic::modulo;
+		}
+		return Arithmetic::none;
+	}
+	
+	static int64_t divide(int64_t x, int64_t y) {
+		if (y == 0) {
+			throw RuntimeException("Tried to divide by zero.", __FILENAME__, __func__, __LINE__);
+		}
+		return x / y;
+	}
+	
+	static int64_t modulo(int64_t x, int64_t y) {
+		if (y == 0) {
+			throw RuntimeException("Tried to divide by zero.", __FILENAME__, __func__, __LINE__);
+		}
+		return ((x % y) + y) % y;
+	}
+	
+	int64_t evaluate(Runtime& runtime, HeapReference reference) {
+		Cell cell = dereference(runtime, reference).get(runtime);
+		switch (cell.tag()) {
+			case Cell::Tag::integer:
+				return cell.integer();
+			case Cell::Tag::reference:
+				throw RuntimeException("Tried to evaluate an unbound variable.", __FILENAME__, __func__, __LINE__);
+			case Cell::Tag::constant:
+				throw RuntimeException("Tried to evaluate a functor (" + cell.functor().toString() + ") that is not a recognised operation.", __FILENAME__, __func__, __LINE__);
+			case Cell::Tag::structure: {
+				HeapReference::heapIndex address = cell.address();
+				SymbolTable::symbolIndex symbol = runtime.heap[address].symbol();
+				// The operation of each functor is only looked up from its name the first time it is evaluated (by each thread).
+				static thread_local std::unordered_map<SymbolTable::symbolIndex, Arithmetic> operations;
+				auto operation = operations.find(symbol);
+				if (operation == operations.end()) {
+					operation = operations.emplace(symbol, arithmeticOperation(SymbolTable::get(symbol).name, SymbolTable::get(symbol).parameters)).first;
+				}
+				auto operand = [&runtime, address] (int64_t i) { return evaluate(runtime, HeapReference(StorageArea::heap, address + i)); };
+				switch (operation->second) {
+					case Arithmetic::add: {
+						int64_t sum = 0;
+						for (int64_t i = 1; i <= SymbolTable::get(symbol).parameters; ++ i) {
+							sum += operand(i);
+						}
+						return sum;
+					}
+					case Arithmetic::subtract:
+						return operand(1) - operand(2);
+					case Arithmetic::multiply: {
+						int64_t product = 1;
+						for (int64_t i = 1; i <= SymbolTable::get(symbol).parameters; ++ i) {
+							product *= operand(i);
+						}
+						return product;
+					}
+					case Arithmetic::divide:
+						return divide(operand(1), operand(2));
+					case Arithmetic::modulo:
+						return modulo(operand(1), operand(2));
+					case Arithmetic::none:
+						throw RuntimeException("Tried to evaluate a functor (" + SymbolTable::get(symbol).toString() + ") that is not a recognised operation.", __FILENAME__, __func__, __LINE__);
+				}
+			}
+			default:
+				throw RuntimeException("Tried to evaluate an unknown container.", __FILENAME__, __func__, __LINE__);
+		}
+	}
+	
+	bool loadInteger(Runtime& runtime, HeapReference reference, std::size_t integer) {
+		// Expressions that were built at runtime are evaluated from the heap.
+		Cell cell = dereference(runtime, reference).get(runtime);
+		runtime.integers[integer] = cell.tag() == Cell::Tag::integer ? cell.integer() : evaluate(runtime, reference);
+		return true;
+	}
+	
+	bool loadConstant(Runtime& runtime, int64_t value, std::size_t integer) {
+		runtime.integers[integer] = value;
+		return true;
+	}
+	
+	bool addIntegers(Runtime& runtime, std::size_t destination, std::size_t left, std::size_t right) {
+		std::array<int64_t, Runtime::integerRegisters>& integers = runtime.integers;
+		integers[destination] = integers[left] + integers[right];
+		return true;
+	}
+	
+	bool subtractIntegers(Runtime& runtime, std::size_t destination, std::size_t left, std::size_t right) {
+		std::array<int64_t, Runtime::integerRegisters>& integers = runtime.integers;
+		integers[destination] = integers[left] - integers[right];
+		return true;
+	}
+	
+	bool multiplyIntegers(Runtime& runtime, std::size_t destination, std::size_t left, std::size_t right) {
+		std::array<int64_t, Runtime::integerRegisters>& integers = runtime.integers;
+		integers[destination] = integers[left] * integers[right];
+		return true;
+	}
+	
+	bool divideIntegers(Runtime& runtime, std::size_t destination, std::size_t left, std::size_t right) {
+		std::array<int64_t, Runtime::integerRegisters>& integers = runtime.integers;
+		integers[destination] = divide(integers[left], integers[right]);
+		return true;
+	}
+	
+	bool moduloIntegers(Runtime& runtime, std::size_t destination, std::size_t left, std::size_t right) {
+		std::array<int64_t, Runtime::integerRegisters>& integers = runtime.integers;
+		integers[destination] = modulo(integers[left], integers[right]);
+		return true;
+	}
+	
+	bool lessThan(Runtime& runtime, std::size_t left, std::size_t right) {
+		return runtime.integers[left] < runtime.integers[right];
+	}
+	
+	bool lessOrEqual(Runtime& runtime, std::size_t left, std::size_t right) {
+		return runtime.integers[left] <= runtime.integers[right];
+	}
+	
+	bool greaterThan(Runtime& runtime, std::size_t left, std::size_t right) {
+		return runtime.integers[left] > runtime.integers[right];
+	}
+	
+	bool greaterOrEqual(Runtime& runtime, std::size_t left, std::size_t right) {
+		return runtime.integers[left] >= runtime.integers[right];
+	}
+	
+	bool storeInteger(Runtime& runtime, std::size_t integer, HeapReference reference) {
+		reference.assign(runtime, Cell::integer(runtime.integers[integer]));
+		return true;
+	}
+	
+	bool unifyInteger(Runtime& runtime, std::size_t integer, HeapReference reference) {
+		return unifyNumber(runtime, HeapNumber(runtime.integers[integer]), reference);
+	}
+	
+	bool command(Runtime& runtime, const std::function<bool(Runtime&)>* function) {
+		if (function == nullptr) {
 			throw RuntimeException("Tried to execute an unknown command.", __FILENAME__, __func__, __LINE__);
 		}
-		++ Runtime::currentRuntime->nextInstruction;
+		return (*function)(runtime);
+	}
+}
+
+namespace Epilog {
+	const Bytecode::word Bytecode::operands[] = {
+		3, 1, 1, 2, // put_structure, set_variable, set_value, put_integer
+		3, 1, 1, 2, // get_structure, unify_variable, unify_value, get_integer
+		2, 2, 2, 2, // put_variable, put_value, get_variable, get_value
+		4, 4, 0, 1, 0, 1, // call, execute, proceed, allocate, deallocate, trim
+		1, 1, 0, // try_me_else, retry_me_else, trust_me
+		1, 1, 1, // try, retry, trust
+		4, 2, 2, // switch_on_term, switch_on_constant, switch_on_structure
+		2, 0, // index_arguments, retry_alternative
+		2, 2, 3, 3, 3, 3, 3, // load_integer, load_constant, add, subtract, multiply, divide, modulo
+		2, 2, 2, 2, 2, 2, // less_than, less_or_equal, greater_than, greater_or_equal, store_integer, unify_integer
+		2, 0, 0, 0, // table, retry_answer, complete_table, new_answer
+		2, // parallel_call
+		2, // command
+		1, 2 // profile, native
+	};
+	
+	void PushCompoundTermInstruction::encode(Bytecode& code) const {
+		code.emit(Opcode::put_structure, { functor, static_cast<Bytecode::word>(parameters), Bytecode::encode(registerReference) });
+	}
+	
+	void PushVariableInstruction::encode(Bytecode& code) const {
+		code.emit(Opcode::set_variable, { Bytecode::encode(registerReference) });
+	}
+	
+	void PushValueInstruction::encode(Bytecode& code) const {
+		code.emit(Opcode::set_value, { Bytecode::encode(registerReference) });
+	}
+	
+	void PushNumberInstruction::encode(Bytecode& code) const {
+		code.emit(Opcode::put_integer, { static_cast<Bytecode::word>(number.value), Bytecode::encode(registerReference) });
+	}
+	
+	void UnifyCompoundTermInstruction::encode(Bytecode& code) const {
+		code.emit(Opcode::get_structure, { functor, static_cast<Bytecode::word>(parameters), Bytecode::encode(registerReference) });
+	}
+	
+	void UnifyVariableInstruction::encode(Bytecode& code) const {
+		code.emit(Opcode::unify_variable, { Bytecode::encode(registerReference) });
+	}
+	
+	void UnifyValueInstruction::encode(Bytecode& code) const {
+		code.emit(Opcode::unify_value, { Bytecode::encode(registerReference) });
+	}
+	
+	void UnifyNumberInstruction::encode(Bytecode& code) const {
+		code.emit(Opcode::get_integer, { static_cast<Bytecode::word>(number.value), Bytecode::encode(registerReference) });
+	}
+	
+	void PushVariableToAllInstruction::encode(Bytecode& code) const {
+		code.emit(Opcode::put_variable, { Bytecode::encode(registerReference), Bytecode::encode(argumentReference) });
+	}
+	
+	void CopyRegisterToArgumentInstruction::encode(Bytecode& code) const {
+		code.emit(Opcode::put_value, { Bytecode::encode(registerReference), Bytecode::encode(argumentReference) });
+	}
+	
+	void CopyArgumentToRegisterInstruction::encode(Bytecode& code) const {
+		code.emit(Opcode::get_variable, { Bytecode::encode(registerReference), Bytecode::encode(argumentReference) });
+	}
+	
+	void UnifyRegisterAndArgumentInstruction::encode(Bytecode& code) const {
+		code.emit(Opcode::get_value, { Bytecode::encode(registerReference), Bytecode::encode(argumentReference) });
+	}
+	
+	void CallInstruction::encode(Bytecode& code) const {
+		// Resolve the call to the label of its functor, so that calling does not have to look the label up.
+		// The label of a functor that has not (yet) been defined causes the call to fail until it is defined. Labels are never removed, so this remains valid as the predicate is (re)defined.
+		const Instruction::instructionReference* label = &Runtime::currentRuntime->labels.emplace(functor, Instruction::failLabel).first->second;
+		code.emit(Opcode::call, { functor, static_cast<Bytecode::word>(parameters), static_cast<Bytecode::word>(modifier), reinterpret_cast<Bytecode::word>(label) });
+	}
+	
+	void ProceedInstruction::encode(Bytecode& code) const {
+		code.emit(Opcode::proceed);
+	}
+	
+	void AllocateInstruction::encode(Bytecode& code) const {
+		code.emit(Opcode::allocate, { static_cast<Bytecode::word>(variables) });
+	}
+	
+	void ExecuteInstruction::encode(Bytecode& code) const {
+		const Instruction::instructionReference* label = &Runtime::currentRuntime->labels.emplace(functor, Instruction::failLabel).first->second;
+		code.emit(Opcode::execute, { functor, static_cast<Bytecode::word>(parameters), static_cast<Bytecode::word>(modifier), reinterpret_cast<Bytecode::word>(label) });
+	}
+	
+	void DeallocateInstruction::encode(Bytecode& code) const {
+		code.emit(Opcode::deallocate);
+	}
+	
+	void TrimInstruction::encode(Bytecode& code) const {
+		code.emit(Opcode::trim, { variables });
+	}
+	
+	void TryInitialClauseInstruction::encode(Bytecode& code) const {
+		code.emit(Opcode::try_me_else, { label });
+	}
+	
+	void TryIntermediateClauseInstruction::encode(Bytecode& code) const {
+		code.emit(Opcode::retry_me_else, { label });
+	}
+	
+	void TryFinalClauseInstruction::encode(Bytecode& code) const {
+		code.emit(Opcode::trust_me);
+	}
+	
+	void TryClauseInstruction::encode(Bytecode& code) const {
+		code.emit(Opcode::try_clause, { label });
+	}
+	
+	void RetryClauseInstruction::encode(Bytecode& code) const {
+		code.emit(Opcode::retry_clause, { label });
+	}
+	
+	void TrustClauseInstruction::encode(Bytecode& code) const {
+		code.emit(Opcode::trust_clause, { label });
+	}
+	
+	void SwitchOnTermInstruction::encode(Bytecode& code) const {
+		code.emit(Opcode::switch_on_term, { variableLabel, constantLabel, listLabel, structureLabel });
+	}
+	
+	void SwitchOnConstantInstruction::encode(Bytecode& code) const {
+		code.tables.emplace_back(labels.begin(), labels.end());
+		code.emit(Opcode::switch_on_constant, { reinterpret_cast<Bytecode::word>(&code.tables.back()), defaultLabel });
+	}
+	
+	void SwitchOnStructureInstruction::encode(Bytecode& code) const {
+		code.tables.emplace_back(labels.begin(), labels.end());
+		code.emit(Opcode::switch_on_structure, { reinterpret_cast<Bytecode::word>(&code.tables.back()), defaultLabel });
+	}
+	
+	void IndexArgumentsInstruction::encode(Bytecode& code) const {
+		code.argumentIndexes.push_back(index);
+		code.emit(Opcode::index_arguments, { reinterpret_cast<Bytecode::word>(index.get()), fallbackLabel });
+	}
+	
+	void RetryAlternativeInstruction::encode(Bytecode& code) const {
+		code.emit(Opcode::retry_alternative);
+	}
+	
+	void LoadIntegerInstruction::encode(Bytecode& code) const {
+		code.emit(Opcode::load_integer, { Bytecode::encode(reference), integer });
+	}
+	
+	void LoadConstantInstruction::encode(Bytecode& code) const {
+		code.emit(Opcode::load_constant, { static_cast<Bytecode::word>(value), integer });
+	}
+	
+	void ArithmeticInstruction::encode(Bytecode& code) const {
+		code.emit(operation, { destination, left, right });
+	}
+	
+	std::string ArithmeticInstruction::toString() const {
+		static const std::unordered_map<Bytecode::word, std::string> names = {
+			{ static_cast<Bytecode::word>(Opcode::add), "add" },
+			{ static_cast<Bytecode::word>(Opcode::subtract), "subtract" },
+			{ static_cast<Bytecode::word>(Opcode::multiply), "multiply" },
+			{ static_cast<Bytecode::word>(Opcode::divide), "divide" },
+			{ static_cast<Bytecode::word>(Opcode::modulo), "modulo" }
+		};
+		return names.at(static_cast<Bytecode::word>(operation)) + " I" + std::to_string(destination) + ", I" + std::to_string(left) + ", I" + std::to_string(right);
+	}
+	
+	void ComparisonInstruction::encode(Bytecode& code) const {
+		code.emit(comparison, { left, right });
+	}
+	
+	std::string ComparisonInstruction::toString() const {
+		static const std::unordered_map<Bytecode::word, std::string> names = {
+			{ static_cast<Bytecode::word>(Opcode::less_than), "less_than" },
+			{ static_cast<Bytecode::word>(Opcode::less_or_equal), "less_or_equal" },
+			{ static_cast<Bytecode::word>(Opcode::greater_than), "greater_than" },
+			{ static_cast<Bytecode::word>(Opcode::greater_or_equal), "greater_or_equal" }
+		};
+		return names.at(static_cast<Bytecode::word>(comparison)) + " I" + std::to_string(left) + ", I" + std::to_string(right);
+	}
+	
+	void StoreIntegerInstruction::encode(Bytecode& code) const {
+		code.emit(Opcode::store_integer, { integer, Bytecode::encode(reference) });
+	}
+	
+	void UnifyIntegerInstruction::encode(Bytecode& code) const {
+		code.emit(Opcode::unify_integer, { integer, Bytecode::encode(reference) });
+	}
+	
+	void TableInstruction::encode(Bytecode& code) const {
+		code.emit(Opcode::table, { functor, entry });
+	}
+	
+	void RetryAnswerInstruction::encode(Bytecode& code) const {
+		code.emit(Opcode::retry_answer);
+	}
+	
+	void CompleteTableInstruction::encode(Bytecode& code) const {
+		code.emit(Opcode::complete_table);
+	}
+	
+	void NewAnswerInstruction::encode(Bytecode& code) const {
+		code.emit(Opcode::new_answer);
+	}
+	
+	void ParallelCallInstruction::encode(Bytecode& code) const {
+		code.conjunctions.push_back(conjunction);
+		code.emit(Opcode::parallel_call, { reinterpret_cast<Bytecode::word>(conjunction.get()), last });
+	}
+	
+	void CommandInstruction::encode(Bytecode& code) const {
+		// Unknown commands are only reported if they are executed.
+		auto command = StandardLibrary::commands.find(function);
+		const std::function<bool(Runtime&)>* pointer = command != StandardLibrary::commands.end() ? &command->second : nullptr;
+		code.emit(Opcode::command, { function, reinterpret_cast<Bytecode::word>(pointer) });
+	}
+	
+	void ProfileInstruction::encode(Bytecode& code) const {
+		code.emit(Opcode::profile, { reinterpret_cast<Bytecode::word>(profile) });
+	}
+	
+	void NativeInstruction::encode(Bytecode& code) const {
+		code.emit(Opcode::native, { reinterpret_cast<Bytecode::word>(this->code), address });
+	}
+	
+	void Bytecode::shareIndexes() {
+		for (auto& index : argumentIndexes) {
+			index->share();
+		}
+	}
+	
+	std::unique_ptr<Instruction> Bytecode::decode(Instruction::instructionReference address) const {
+		auto operand = [this, address] (word index) { return words[address + 1 + index]; };
+		auto table = [&operand] (word index) { return *reinterpret_cast<const std::unordered_map<word, Instruction::instructionReference>*>(operand(index)); };
+		switch (opcode(address)) {
+			case Opcode::put_structure:
+				return std::unique_ptr<Instruction>(new PushCompoundTermInstruction(SymbolTable::get(operand(0)), decodeReference(operand(2))));
+			case Opcode::set_variable:
+				return std::unique_ptr<Instruction>(new PushVariableInstruction(decodeReference(operand(0))));
+			case Opcode::set_value:
+				return std::unique_ptr<Instruction>(new PushValueInstruction(decodeReference(operand(0))));
+			case Opcode::put_integer:
+				return std::unique_ptr<Instruction>(new PushNumberInstruction(HeapNumber(static_cast<int64_t>(operand(0))), decodeReference(operand(1))));
+			case Opcode::get_structure:
+				return std::unique_ptr<Instruction>(new UnifyCompoundTermInstruction(SymbolTable::get(operand(0)), decodeReference(operand(2))));
+			case Opcode::unify_variable:
+				return std::unique_ptr<Instruction>(new UnifyVariableInstruction(decodeReference(operand(0))));
+			case Opcode::unify_value:
+				return std::unique_ptr<Instruction>(new UnifyValueInstruction(decodeReference(operand(0))));
+			case Opcode::get_integer:
+				return std::unique_ptr<Instruction>(new UnifyNumberInstruction(HeapNumber(static_cast<int64_t>(operand(0))), decodeReference(operand(1))));
+			case Opcode::put_variable:
+				return std::unique_ptr<Instruction>(new PushVariableToAllInstruction(decodeReference(operand(0)), decodeReference(operand(1))));
+			case Opcode::put_value:
+				return std::unique_ptr<Instruction>(new CopyRegisterToArgumentInstruction(decodeReference(operand(0)), decodeReference(operand(1))));
+			case Opcode::get_variable:
+				return std::unique_ptr<Instruction>(new CopyArgumentToRegisterInstruction(decodeReference(operand(0)), decodeReference(operand(1))));
+			case Opcode::get_value:
+				return std::unique_ptr<Instruction>(new UnifyRegisterAndArgumentInstruction(decodeReference(operand(0)), decodeReference(operand(1))));
+			case Opcode::call: {
+				std::unique_ptr<CallInstruction> instruction(new CallInstruction(SymbolTable::get(operand(0))));
+				instruction->modifier = static_cast<Modifier::Type>(operand(2));
+				return std::move(instruction);
+			}
+			case Opcode::execute: {
+				CallInstruction call(SymbolTable::get(operand(0)));
+				call.modifier = static_cast<Modifier::Type>(operand(2));
+				return std::unique_ptr<Instruction>(new ExecuteInstruction(call));
+			}
+			case Opcode::proceed:
+				return std::unique_ptr<Instruction>(new ProceedInstruction());
+			case Opcode::allocate:
+				return std::unique_ptr<Instruction>(new AllocateInstruction(static_cast<int64_t>(operand(0))));
+			case Opcode::deallocate:
+				return std::unique_ptr<Instruction>(new DeallocateInstruction());
+			case Opcode::trim:
+				return std::unique_ptr<Instruction>(new TrimInstruction(operand(0)));
+			case Opcode::try_me_else:
+				return std::unique_ptr<Instruction>(new TryInitialClauseInstruction(operand(0)));
+			case Opcode::retry_me_else:
+				return std::unique_ptr<Instruction>(new TryIntermediateClauseInstruction(operand(0)));
+			case Opcode::trust_me:
+				return std::unique_ptr<Instruction>(new TryFinalClauseInstruction());
+			case Opcode::try_clause:
+				return std::unique_ptr<Instruction>(new TryClauseInstruction(operand(0)));
+			case Opcode::retry_clause:
+				return std::unique_ptr<Instruction>(new RetryClauseInstruction(operand(0)));
+			case Opcode::trust_clause:
+				return std::unique_ptr<Instruction>(new TrustClauseInstruction(operand(0)));
+			case Opcode::switch_on_term:
+				return std::unique_ptr<Instruction>(new SwitchOnTermInstruction(operand(0), operand(1), operand(2), operand(3)));
+			case Opcode::switch_on_constant:
+				return std::unique_ptr<Instruction>(new SwitchOnConstantInstruction(table(0), operand(1)));
+			case Opcode::switch_on_structure: {
+				auto labels = table(0);
+				return std::unique_ptr<Instruction>(new SwitchOnStructureInstruction(std::unordered_map<SymbolTable::symbolIndex, Instruction::instructionReference>(labels.begin(), labels.end()), operand(1)));
+			}
+			case Opcode::index_arguments: {
+				auto index = std::find_if(argumentIndexes.begin(), argumentIndexes.end(), [&operand] (const std::shared_ptr<ArgumentIndex>& index) { return reinterpret_cast<word>(index.get()) == operand(0); });
+				return std::unique_ptr<Instruction>(new IndexArgumentsInstruction(*index, operand(1)));
+			}
+			case Opcode::retry_alternative:
+				return std::unique_ptr<Instruction>(new RetryAlternativeInstruction());
+			case Opcode::load_integer:
+				return std::unique_ptr<Instruction>(new LoadIntegerInstruction(decodeReference(operand(0)), operand(1)));
+			case Opcode::load_constant:
+				return std::unique_ptr<Instruction>(new LoadConstantInstruction(static_cast<int64_t>(operand(0)), operand(1)));
+			case Opcode::add:
+			case Opcode::subtract:
+			case Opcode::multiply:
+			case Opcode::divide:
+			case Opcode::modulo:
+				return std::unique_ptr<Instruction>(new ArithmeticInstruction(opcode(address), operand(0), operand(1), operand(2)));
+			case Opcode::less_than:
+			case Opcode::less_or_equal:
+			case Opcode::greater_than:
+			case Opcode::greater_or_equal:
+				return std::unique_ptr<Instruction>(new ComparisonInstruction(opcode(address), operand(0), operand(1)));
+			case Opcode::store_integer:
+				return std::unique_ptr<Instruction>(new StoreIntegerInstruction(operand(0), decodeReference(operand(1))));
+			case Opcode::unify_integer:
+				return std::unique_ptr<Instruction>(new UnifyIntegerInstruction(operand(0), decodeReference(operand(1))));
+			case Opcode::table:
+				return std::unique_ptr<Instruction>(new TableInstruction(operand(0), operand(1)));
+			case Opcode::retry_answer:
+				return std::unique_ptr<Instruction>(new RetryAnswerInstruction());
+			case Opcode::complete_table:
+				return std::unique_ptr<Instruction>(new CompleteTableInstruction());
+			case Opcode::new_answer:
+				return std::unique_ptr<Instruction>(new NewAnswerInstruction());
+			case Opcode::parallel_call: {
+				auto conjunction = std::find_if(conjunctions.begin(), conjunctions.end(), [&operand] (const std::shared_ptr<Conjunction>& conjunction) { return reinterpret_cast<word>(conjunction.get()) == operand(0); });
+				return std::unique_ptr<Instruction>(new ParallelCallInstruction(*conjunction, operand(1) != 0));
+			}
+			case Opcode::command:
+				return std::unique_ptr<Instruction>(new CommandInstruction(SymbolTable::get(operand(0)).name));
+			case Opcode::profile:
+				return std::unique_ptr<Instruction>(new ProfileInstruction(reinterpret_cast<PredicateProfile*>(operand(0))));
+			case Opcode::native:
+				return std::unique_ptr<Instruction>(new NativeInstruction(reinterpret_cast<NativeInstruction::function>(operand(0)), operand(1)));
+		}
+		throw RuntimeException("Tried to decode an unknown opcode.", __FILENAME__, __func__, __LINE__);
+	}
+	
+	bool Bytecode::execute(Runtime& runtime, Instruction::instructionReference endAddress, bool singleStep) {
+		// Each instruction jumps directly to the handler for the next one (using computed gotos, where the compiler supports them), rather than returning to a central loop.
+		const word* code = words.data();
+		Instruction::instructionReference& next = runtime.nextInstruction;
+		#define OPERAND(index) code[next + 1 + (index)]
+		#define REFERENCE(index) decodeReference(OPERAND(index))
+		#define LABEL(index) static_cast<Instruction::instructionReference>(OPERAND(index))
+		#define LENGTH(opcode) (1 + operands[static_cast<word>(Opcode::opcode)])
+		#if defined(__GNUC__)
+			static void* const handlers[] = {
+				&&put_structure, &&set_variable, &&set_value, &&put_integer,
+				&&get_structure, &&unify_variable, &&unify_value, &&get_integer,
+				&&put_variable, &&put_value, &&get_variable, &&get_value,
+				&&call, &&execute, &&proceed, &&allocate, &&deallocate, &&trim,
+				&&try_me_else, &&retry_me_else, &&trust_me,
+				&&try_clause, &&retry_clause, &&trust_clause,
+				&&switch_on_term, &&switch_on_constant, &&switch_on_structure,
+				&&index_arguments, &&retry_alternative,
+				&&load_integer, &&load_constant, &&add, &&subtract, &&multiply, &&divide, &&modulo,
+				&&less_than, &&less_or_equal, &&greater_than, &&greater_or_equal, &&store_integer, &&unify_integer,
+				&&table, &&retry_answer, &&complete_table, &&new_answer,
+				&&parallel_call,
+				&&command,
+				&&profile, &&native
+			};
+			#define HANDLER(opcode) opcode
+			#define DISPATCH() goto *handlers[code[next]]
+		#else
+			#define HANDLER(opcode) case Opcode::opcode
+			#define DISPATCH() goto dispatch
+		#endif
+		// Continue with the next instruction, unless execution should stop.
+		#define CONTINUE() if (singleStep || next >= words.size() || next == endAddress) { return true; } DISPATCH()
+		// Continue with the instruction following this one, if this one succeeded.
+		#define ADVANCE(opcode, succeeded) if (!(succeeded)) { return false; } next += LENGTH(opcode); CONTINUE()
+		// Continue with the instruction that this one jumped to, if it succeeded.
+		#define JUMP(succeeded) if (!(succeeded)) { return false; } CONTINUE()
+		
+		if (next >= words.size() || next == endAddress) {
+			return true;
+		}
+		#if defined(__GNUC__)
+			DISPATCH();
+		#else
+			dispatch:
+			switch (static_cast<Opcode>(code[next])) {
+		#endif
+		HANDLER(put_structure): {
+			ADVANCE(put_structure, pushCompoundTerm(runtime, OPERAND(0), static_cast<int64_t>(OPERAND(1)), REFERENCE(2)));
+		}
+		HANDLER(set_variable): {
+			ADVANCE(set_variable, pushVariable(runtime, REFERENCE(0)));
+		}
+		HANDLER(set_value): {
+			ADVANCE(set_value, pushValue(runtime, REFERENCE(0)));
+		}
+		HANDLER(put_integer): {
+			ADVANCE(put_integer, pushNumber(runtime, HeapNumber(static_cast<int64_t>(OPERAND(0))), REFERENCE(1)));
+		}
+		HANDLER(get_structure): {
+			ADVANCE(get_structure, unifyCompoundTerm(runtime, OPERAND(0), static_cast<int64_t>(OPERAND(1)), REFERENCE(2)));
+		}
+		HANDLER(unify_variable): {
+			ADVANCE(unify_variable, unifyVariable(runtime, REFERENCE(0)));
+		}
+		HANDLER(unify_value): {
+			ADVANCE(unify_value, unifyValue(runtime, REFERENCE(0)));
+		}
+		HANDLER(get_integer): {
+			ADVANCE(get_integer, unifyNumber(runtime, HeapNumber(static_cast<int64_t>(OPERAND(0))), REFERENCE(1)));
+		}
+		HANDLER(put_variable): {
+			ADVANCE(put_variable, pushVariableToAll(runtime, REFERENCE(0), REFERENCE(1)));
+		}
+		HANDLER(put_value): {
+			ADVANCE(put_value, copyRegisterToArgument(runtime, REFERENCE(0), REFERENCE(1)));
+		}
+		HANDLER(get_variable): {
+			ADVANCE(get_variable, copyArgumentToRegister(runtime, REFERENCE(0), REFERENCE(1)));
+		}
+		HANDLER(get_value): {
+			ADVANCE(get_value, unifyRegisterAndArgument(runtime, REFERENCE(0), REFERENCE(1)));
+		}
+		HANDLER(call): {
+			Instruction::instructionReference address = next;
+			const Instruction::instructionReference* label = reinterpret_cast<const Instruction::instructionReference*>(OPERAND(3));
+			bool linked = label != nullptr;
+			bool succeeded = Epilog::call(runtime, OPERAND(0), static_cast<int64_t>(OPERAND(1)), static_cast<Modifier::Type>(OPERAND(2)), label, next + LENGTH(call));
+			// Calls that had not been linked are resolved by their first execution. Other calls leave the code untouched, as it may be shared between threads.
+			if (!linked) {
+				words[address + 4] = reinterpret_cast<word>(label);
+			}
+			JUMP(succeeded);
+		}
+		HANDLER(execute): {
+			Instruction::instructionReference address = next;
+			const Instruction::instructionReference* label = reinterpret_cast<const Instruction::instructionReference*>(OPERAND(3));
+			bool linked = label != nullptr;
+			bool succeeded = Epilog::call(runtime, OPERAND(0), static_cast<int64_t>(OPERAND(1)), static_cast<Modifier::Type>(OPERAND(2)), label, runtime.nextGoal);
+			if (!linked) {
+				words[address + 4] = reinterpret_cast<word>(label);
+			}
+			JUMP(succeeded);
+		}
+		HANDLER(proceed): {
+			JUMP(Epilog::proceed(runtime));
+		}
+		HANDLER(allocate): {
+			ADVANCE(allocate, Epilog::allocate(runtime, static_cast<int64_t>(OPERAND(0))));
+		}
+		HANDLER(deallocate): {
+			ADVANCE(deallocate, Epilog::deallocate(runtime));
+		}
+		HANDLER(trim): {
+			ADVANCE(trim, Epilog::trim(runtime, OPERAND(0)));
+		}
+		HANDLER(try_me_else): {
+			ADVANCE(try_me_else, tryInitialClause(runtime, LABEL(0)));
+		}
+		HANDLER(retry_me_else): {
+			ADVANCE(retry_me_else, tryIntermediateClause(runtime, LABEL(0)));
+		}
+		HANDLER(trust_me): {
+			ADVANCE(trust_me, tryFinalClause(runtime));
+		}
+		HANDLER(try_clause): {
+			JUMP(tryClause(runtime, LABEL(0), next + LENGTH(try_clause)));
+		}
+		HANDLER(retry_clause): {
+			JUMP(retryClause(runtime, LABEL(0), next + LENGTH(retry_clause)));
+		}
+		HANDLER(trust_clause): {
+			JUMP(trustClause(runtime, LABEL(0)));
+		}
+		HANDLER(switch_on_term): {
+			JUMP(switchOnTerm(runtime, LABEL(0), LABEL(1), LABEL(2), LABEL(3)));
+		}
+		HANDLER(switch_on_constant): {
+			JUMP(switchOnConstant(runtime, *reinterpret_cast<const std::unordered_map<word, Instruction::instructionReference>*>(OPERAND(0)), LABEL(1)));
+		}
+		HANDLER(switch_on_structure): {
+			JUMP(switchOnStructure(runtime, *reinterpret_cast<const std::unordered_map<word, Instruction::instructionReference>*>(OPERAND(0)), LABEL(1)));
+		}
+		HANDLER(index_arguments): {
+			JUMP(indexArguments(runtime, reinterpret_cast<ArgumentIndex*>(OPERAND(0)), LABEL(1), next + LENGTH(index_arguments)));
+		}
+		HANDLER(retry_alternative): {
+			JUMP(retryAlternative(runtime));
+		}
+		HANDLER(load_integer): {
+			ADVANCE(load_integer, loadInteger(runtime, REFERENCE(0), OPERAND(1)));
+		}
+		HANDLER(load_constant): {
+			ADVANCE(load_constant, loadConstant(runtime, static_cast<int64_t>(OPERAND(0)), OPERAND(1)));
+		}
+		HANDLER(add): {
+			ADVANCE(add, addIntegers(runtime, OPERAND(0), OPERAND(1), OPERAND(2)));
+		}
+		HANDLER(subtract): {
+			ADVANCE(subtract, subtractIntegers(runtime, OPERAND(0), OPERAND(1), OPERAND(2)));
+		}
+		HANDLER(multiply): {
+			ADVANCE(multiply, multiplyIntegers(runtime, OPERAND(0), OPERAND(1), OPERAND(2)));
+		}
+		HANDLER(divide): {
+			ADVANCE(divide, divideIntegers(runtime, OPERAND(0), OPERAND(1), OPERAND(2)));
+		}
+		HANDLER(modulo): {
+			ADVANCE(modulo, moduloIntegers(runtime, OPERAND(0), OPERAND(1), OPERAND(2)));
+		}
+		HANDLER(less_than): {
+			ADVANCE(less_than, lessThan(runtime, OPERAND(0), OPERAND(1)));
+		}
+		HANDLER(less_or_equal): {
+			ADVANCE(less_or_equal, lessOrEqual(runtime, OPERAND(0), OPERAND(1)));
+		}
+		HANDLER(greater_than): {
+			ADVANCE(greater_than, greaterThan(runtime, OPERAND(0), OPERAND(1)));
+		}
+		HANDLER(greater_or_equal): {
+			ADVANCE(greater_or_equal, greaterOrEqual(runtime, OPERAND(0), OPERAND(1)));
+		}
+		HANDLER(store_integer): {
+			ADVANCE(store_integer, storeInteger(runtime, OPERAND(0), REFERENCE(1)));
+		}
+		HANDLER(unify_integer): {
+			ADVANCE(unify_integer, unifyInteger(runtime, OPERAND(0), REFERENCE(1)));
+		}
+		HANDLER(table): {
+			JUMP(tableCall(runtime, OPERAND(0), LABEL(1), next + LENGTH(table)));
+		}
+		HANDLER(retry_answer): {
+			JUMP(retryAnswer(runtime));
+		}
+		HANDLER(complete_table): {
+			JUMP(completeTable(runtime));
+		}
+		HANDLER(new_answer): {
+			JUMP(newAnswer(runtime));
+		}
+		HANDLER(parallel_call): {
+			JUMP(parallelCall(runtime, *reinterpret_cast<const Conjunction*>(OPERAND(0)), OPERAND(1) != 0 ? runtime.nextGoal : next + LENGTH(parallel_call)));
+		}
+		HANDLER(command): {
+			ADVANCE(command, Epilog::command(runtime, reinterpret_cast<const std::function<bool(Runtime&)>*>(OPERAND(1))));
+		}
+		HANDLER(profile): {
+			PredicateProfile* profile = reinterpret_cast<PredicateProfile*>(OPERAND(0));
+			next = profile->entry;
+			// Predicates are only profiled by a runtime that may compile them, as the code is otherwise only read.
+			if (runtime.jit != nullptr && ++ profile->calls == runtime.jit->threshold) {
+				if (runtime.jit->compile(runtime, *profile)) {
+					next = runtime.labels[profile->functor];
+				}
+				// Compiling adds the entries of the native code to the code area, which may move it.
+				code = words.data();
+			}
+			CONTINUE();
+		}
+		HANDLER(native): {
+			JUMP(reinterpret_cast<NativeInstruction::function>(OPERAND(0))(runtime));
+		}
+		#if !defined(__GNUC__)
+			}
+			throw RuntimeException("Tried to execute an unknown opcode.", __FILENAME__, __func__, __LINE__);
+		#endif
+		#undef OPERAND
+		#undef REFERENCE
+		#undef LABEL
+		#undef LENGTH
+		#undef HANDLER
+		#undef DISPATCH
+		#undef CONTINUE
+		#undef ADVANCE
+		#undef JUMP
 	}
 }
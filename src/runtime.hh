@@ -1,8 +1,18 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <initializer_list>
 #include <iomanip>
+#include <iostream>
+#include <limits>
 #include <stack>
+#include <string>
 #include <unordered_map>
+#include <vector>
 
 #define __FILENAME__ (strrchr(__FILE__, '/') ? strrchr(__FILE__, '/') + 1 : __FILE__)
 
@@ -23,8 +33,12 @@ namespace Epilog {
 		std::string function;
 		int64_t line;
 		
+		std::string toString() const {
+			return std::string(indentation, '\t') + file + " > " + function + "() (L" + std::to_string(line) + "): " + message;
+		}
+		
 		void print() const {
-			std::cerr << std::string(indentation, '\t') << file << " > " << function << "() (L" << line << "): " << message << std::endl;
+			std::cerr << toString() << std::endl;
 		}
 		
 		Exception(std::string message, std::string file, std::string function, int64_t line, int64_t indentation = 0) : indentation(indentation), message(message), file(file), function(function), line(line) { }
@@ -44,32 +58,163 @@ namespace Epilog {
 		RuntimeException(std::string message, bool forceful, std::string file, std::string function, int64_t line) : Exception(message, file, function, line, 2), forceful(forceful) { }
 	};
 	
-	class UnificationError: public RuntimeException {
+	enum class Mode { read, write };
+	
+	struct HeapFunctor {
+		std::string name;
+		int64_t parameters;
+		
+		std::string toString() const {
+			return name + "/" + std::to_string(parameters);
+		}
+		
+		std::string trace(bool explicitControlCharacters = false) const {
+			if (!explicitControlCharacters && name.length() > 2 && name[0] == '\'') {
+				std::string unquoted = name.substr(1, name.length() - 2);
+				std::string::size_type position = 0;
+				while ((position = unquoted.find("\\'", position)) != std::string::npos) {
+					unquoted.replace(position, 2, "'");
+					position += 1;
+				}
+				return unquoted;
+			}
+			return name;
+		}
+		
+		HeapFunctor(std::string name, int64_t parameters) : name(name), parameters(parameters) { }
+	};
+	
+	// The process-wide table of interned functors.
+	// Each name/arity pair is assigned a compact index when it is first compiled, so that functors may be compared, and used as keys, as integers.
+	class SymbolTable {
 		public:
-		UnificationError(std::string message, std::string file, std::string function, int64_t line) : RuntimeException(message, file, function, line) { }
+		typedef std::deque<HeapFunctor>::size_type symbolIndex;
+		
+		static symbolIndex intern(const std::string& name, int64_t parameters) {
+			std::string symbol = name + "/" + std::to_string(parameters);
+			auto previous = indices().find(symbol);
+			if (previous != indices().end()) {
+				return previous->second;
+			}
+			symbolIndex index = functors().size();
+			functors().emplace_back(name, parameters);
+			indices().emplace(symbol, index);
+			return index;
+		}
+		
+		static symbolIndex intern(const HeapFunctor& functor) {
+			return intern(functor.name, functor.parameters);
+		}
+		
+		static const HeapFunctor& get(symbolIndex index) {
+			return functors()[index];
+		}
+		
+		static symbolIndex size() {
+			return functors().size();
+		}
 		
-		UnificationError(std::string message, bool forceful, std::string file, std::string function, int64_t line) : RuntimeException(message, forceful, file, function, line) { }
+		private:
+		// The tables are function-local statics so that they may be used safely during static initialisation (for example, by the standard library).
+		static std::deque<HeapFunctor>& functors() {
+			static std::deque<HeapFunctor> functors;
+			return functors;
+		}
+		
+		static std::unordered_map<std::string, symbolIndex>& indices() {
+			static std::unordered_map<std::string, symbolIndex> indices;
+			return indices;
+		}
 	};
 	
-	enum class Mode { read, write };
+	struct HeapNumber {
+		int64_t value;
+		
+		std::string toString() const {
+			return std::to_string(value);
+		}
+		
+		HeapNumber(int64_t value) : value(value) { }
+	};
 	
-	struct HeapContainer {
-		// Ensure HeapContainer is polymorphic, so that we can use dynamic_cast
-		POLYMORPHIC(HeapContainer);
+	class Runtime;
+	
+	struct Subgoal;
+	
+	// A single tagged word of the heap, a register or an environment.
+	// The low bits hold the tag and the remaining bits hold a heap address (for references and structures), an unboxed integer, or an interned symbol (for constants and functors).
+	struct Cell {
+		enum class Tag: uint64_t { reference, structure, constant, integer, functor, empty };
+		
+		typedef uint64_t word;
+		
+		static const word tagBits = 3;
+		static const word tagMask = (1 << tagBits) - 1;
+		static const int64_t maximumInteger = (INT64_C(1) << (63 - tagBits)) - 1;
+		static const int64_t minimumInteger = -maximumInteger - 1;
+		
+		word value;
+		
+		Tag tag() const {
+			return static_cast<Tag>(value & tagMask);
+		}
+		
+		std::size_t address() const {
+			return static_cast<std::size_t>(value >> tagBits);
+		}
+		
+		int64_t integer() const {
+			return static_cast<int64_t>(value) >> tagBits;
+		}
+		
+		SymbolTable::symbolIndex symbol() const {
+			return static_cast<SymbolTable::symbolIndex>(value >> tagBits);
+		}
+		
+		const HeapFunctor& functor() const {
+			return SymbolTable::get(symbol());
+		}
+		
+		bool operator==(const Cell& other) const {
+			return value == other.value;
+		}
+		
+		bool operator!=(const Cell& other) const {
+			return value != other.value;
+		}
+		
+		static Cell reference(std::size_t address) {
+			return Cell((static_cast<word>(address) << tagBits) | static_cast<word>(Tag::reference));
+		}
 		
-		virtual std::unique_ptr<HeapContainer> copy() const = 0;
+		static Cell structure(std::size_t address) {
+			return Cell((static_cast<word>(address) << tagBits) | static_cast<word>(Tag::structure));
+		}
+		
+		static Cell constant(SymbolTable::symbolIndex symbol) {
+			return Cell((static_cast<word>(symbol) << tagBits) | static_cast<word>(Tag::constant));
+		}
 		
-		virtual std::string toString() const {
-			return "container";
+		static Cell functor(SymbolTable::symbolIndex symbol) {
+			return Cell((static_cast<word>(symbol) << tagBits) | static_cast<word>(Tag::functor));
 		}
 		
-		virtual std::string trace(bool explicitControlCharacters = false) const = 0;
+		static Cell integer(int64_t value);
+		
+		std::string toString() const;
+		
+		std::string trace(Runtime& runtime, bool explicitControlCharacters = false) const;
+		
+		Cell() : value(static_cast<word>(Tag::empty)) { }
+		
+		private:
+		explicit Cell(word value) : value(value) { }
 	};
 	
 	enum class StorageArea { heap, reg, environment, undefined };
 	
-	struct HeapReference: public std::pair<StorageArea, std::vector<std::unique_ptr<HeapContainer>>::size_type> {
-		typedef typename std::vector<std::unique_ptr<HeapContainer>>::size_type heapIndex;
+	struct HeapReference: public std::pair<StorageArea, std::vector<Cell>::size_type> {
+		typedef typename std::vector<Cell>::size_type heapIndex;
 		
 		StorageArea area;
 		heapIndex index;
@@ -88,17 +233,9 @@ namespace Epilog {
 			return !(*this == other);
 		}
 		
-		std::unique_ptr<HeapContainer>& get() const;
-		
-		std::unique_ptr<HeapContainer> getAsCopy() const {
-			return get()->copy();
-		}
-		
-		HeapContainer* getPointer() const {
-			return get().get();
-		}
+		Cell& get(Runtime& runtime) const;
 		
-		void assign(std::unique_ptr<HeapContainer> value) const;
+		void assign(Runtime& runtime, Cell value) const;
 		
 		std::string toString() const {
 			std::string string;
@@ -119,71 +256,9 @@ namespace Epilog {
 		}
 	};
 	
-	struct HeapTuple: HeapContainer {
-		enum class Type { compoundTerm, reference };
-		Type type;
-		HeapReference::heapIndex reference;
-		
-		virtual std::unique_ptr<HeapContainer> copy() const override {
-			return std::unique_ptr<HeapTuple>(new HeapTuple(*this));
-		}
-		
-		virtual std::string toString() const override {
-			return std::string("(") + (type == Type::compoundTerm ? "compound term" : "reference") + ", " + std::to_string(reference) + ")";
-		}
-		
-		virtual std::string trace(bool explicitControlCharacters = false) const override;
-		
-		HeapTuple(Type type, HeapReference::heapIndex reference) : type(type), reference(reference) { }
-	};
-	
-	struct HeapFunctor: HeapContainer {
-		std::string name;
-		int64_t parameters;
-		
-		virtual std::unique_ptr<HeapContainer> copy() const override {
-			return std::unique_ptr<HeapFunctor>(new HeapFunctor(*this));
-		}
-		
-		virtual std::string toString() const override {
-			return name + "/" + std::to_string(parameters);
-		}
-		
-		virtual std::string trace(bool explicitControlCharacters = false) const override {
-			if (!explicitControlCharacters && name.length() > 2 && name[0] == '\'') {
-				std::string unquoted = name.substr(1, name.length() - 2);
-				std::string::size_type position = 0;
-				while ((position = unquoted.find("\\'", position)) != std::string::npos) {
-					unquoted.replace(position, 2, "'");
-					position += 1;
-				}
-				return unquoted;
-			}
-			return name;
-		}
-		
-		HeapFunctor(std::string name, int64_t parameters) : name(name), parameters(parameters) { }
-	};
-	
-	struct HeapNumber: HeapContainer {
-		int64_t value;
-		
-		virtual std::unique_ptr<HeapContainer> copy() const override {
-			return std::unique_ptr<HeapNumber>(new HeapNumber(*this));
-		}
-		
-		virtual std::string toString() const override {
-			return std::to_string(value);
-		}
-		
-		virtual std::string trace(bool explicitControlCharacters = false) const override {
-			return toString();
-		}
-		
-		HeapNumber(int64_t value) : value(value) { }
-	};
+	HeapReference dereference(Runtime& runtime, const HeapReference& reference);
 	
-	HeapReference dereference(const HeapReference& reference);
+	bool unify(Runtime& runtime, HeapReference& a, HeapReference& b);
 	
 	template <class T>
 	class BoundsCheckedVector: public std::vector<T> {
@@ -196,70 +271,372 @@ namespace Epilog {
 		}
 	};
 	
-	template <class T>
-	class BoundsCheckedUniqueVector: public BoundsCheckedVector<std::unique_ptr<T>> { };
-	
 	template <class T>
 	class BoundsCheckedSharedVector: public BoundsCheckedVector<std::shared_ptr<T>> { };
 	
-	class StackHeap: public BoundsCheckedUniqueVector<HeapContainer> {
+	class StackHeap: public BoundsCheckedVector<Cell> {
 		public:
+		// Discard every cell above the given size. As cells are plain words, this does not need to visit each of them.
+		void truncate(HeapReference::heapIndex size) {
+			if (size < this->size()) {
+				erase(begin() + size, end());
+			}
+		}
+		
 		void print() {
 			for (HeapReference::heapIndex i = 0; i < size(); ++ i) {
-				std::cerr << std::setw(2) << i << ": " << ((*this)[i] != nullptr ? (*this)[i]->toString() : "null") << std::endl;
+				std::cerr << std::setw(2) << i << ": " << (*this)[i].toString() << std::endl;
 			}
 		}
 	};
 	
+	class Bytecode;
+	
 	struct Instruction {
 		POLYMORPHIC(Instruction);
 		
 		typedef typename BoundsCheckedVector<Instruction>::size_type instructionReference;
 		
-		virtual void execute() = 0;
+		// A label that causes execution to fail, rather than jump.
+		static const instructionReference failLabel = -1UL;
+		
+		static std::string labelToString(instructionReference label) {
+			return label != failLabel ? std::to_string(label) : "fail";
+		}
+		
+		// Appends the bytecode for the instruction, resolving any labels it refers to.
+		virtual void encode(Bytecode& code) const = 0;
 		
 		virtual std::string toString() const = 0;
 	};
 	
 	struct StateReference {
-		POLYMORPHIC(StateReference);
+		// An index into the frame stack, of the first word of an environment or choice point.
+		typedef std::vector<uint64_t>::size_type stateIndex;
+	};
+	
+	struct Modifier {
+		enum class Type { none, negate, intercept };
+		Type type;
+		Instruction::instructionReference nextInstruction;
+		StateReference::stateIndex topEnvironment;
+		StateReference::stateIndex topChoicePoint;
+		// The frames below this point on the frame stack are kept while the modifier is, so that its frames (and those of any modifier below it) may be restored.
+		StateReference::stateIndex floor;
+		
+		Modifier(Type type, Instruction::instructionReference nextInstruction, StateReference::stateIndex topEnvironment, StateReference::stateIndex topChoicePoint, StateReference::stateIndex floor) : type(type), nextInstruction(nextInstruction), topEnvironment(topEnvironment), topChoicePoint(topChoicePoint), floor(floor) { }
+	};
+	
+	// The modifiers of the enclosing calls, which may also be visited in order (for example, to find the frames they may restore).
+	class ModifierStack: public std::stack<Modifier> {
+		public:
+		std::deque<Modifier>::const_iterator begin() const {
+			return c.begin();
+		}
 		
-		typedef std::vector<std::unique_ptr<StateReference>>::size_type stateIndex;
+		std::deque<Modifier>::const_iterator end() const {
+			return c.end();
+		}
 	};
 	
-	struct Environment: StateReference {
+	// Environments and choice points are laid out contiguously on the frame stack, each immediately followed by its cells.
+	struct Environment {
 		StateReference::stateIndex previousEnvironment;
 		Instruction::instructionReference nextGoal;
-		StackHeap variables;
+		HeapReference::heapIndex size;
+		
+		Environment(StateReference::stateIndex previousEnvironment, Instruction::instructionReference nextGoal, HeapReference::heapIndex size) : previousEnvironment(previousEnvironment), nextGoal(nextGoal), size(size) { }
 		
-		Environment(Instruction::instructionReference nextGoal) : nextGoal(nextGoal) {}
+		Cell* variables() {
+			return reinterpret_cast<Cell*>(this + 1);
+		}
+		
+		// The number of words taken up by the environment on the frame stack.
+		StateReference::stateIndex words() const {
+			return sizeof(Environment) / sizeof(uint64_t) + size;
+		}
 	};
 	
-	struct ChoicePoint: StateReference {
-		StackHeap arguments;
+	struct ChoicePoint {
 		StateReference::stateIndex environment;
 		Instruction::instructionReference nextGoal;
 		Instruction::instructionReference nextClause;
 		StateReference::stateIndex previousChoicePoint;
 		std::vector<HeapReference>::size_type trailSize;
 		HeapReference::heapIndex heapSize;
+		// The number of modifiers when the choice point was created, which are restored when backtracking.
+		std::stack<Modifier>::size_type modifiers;
+		// The number of candidate lists held for this choice point and those below it, when the clauses were selected by an argument index rather than a clause chain.
+		std::vector<std::shared_ptr<const std::vector<Instruction::instructionReference>>>::size_type alternatives;
+		std::vector<Instruction::instructionReference>::size_type nextAlternative = 0;
+		// The number of subgoals held for the answer choice points of tabled calls, for this choice point and those below it.
+		std::vector<std::shared_ptr<Subgoal>>::size_type answers = 0;
+		HeapReference::heapIndex size;
+		
+		ChoicePoint(StateReference::stateIndex environment, Instruction::instructionReference nextGoal, Instruction::instructionReference nextClause, StateReference::stateIndex previousChoicePoint, std::vector<HeapReference>::size_type trailSize, HeapReference::heapIndex heapSize, std::stack<Modifier>::size_type modifiers, HeapReference::heapIndex size) : environment(environment), nextGoal(nextGoal), nextClause(nextClause), previousChoicePoint(previousChoicePoint), trailSize(trailSize), heapSize(heapSize), modifiers(modifiers), size(size) { }
+		
+		Cell* arguments() {
+			return reinterpret_cast<Cell*>(this + 1);
+		}
 		
-		ChoicePoint(StateReference::stateIndex environment, Instruction::instructionReference nextGoal, Instruction::instructionReference nextClause, std::stack<HeapReference>::size_type trailSize, HeapReference::heapIndex heapSize) : environment(environment), nextGoal(nextGoal), nextClause(nextClause), trailSize(trailSize), heapSize(heapSize) { }
+		// The number of words taken up by the choice point on the frame stack.
+		StateReference::stateIndex words() const {
+			return sizeof(ChoicePoint) / sizeof(uint64_t) + size;
+		}
 	};
 	
-	struct Modifier {
-		enum class Type { none, negate, intercept };
-		Type type;
-		Instruction::instructionReference nextInstruction;
-		StateReference::stateIndex topEnvironment;
-		StateReference::stateIndex topChoicePoint;
+	// Call statistics for a predicate with several clauses, along with the hash indexes on its non-first arguments that are built once they have been bound in enough calls.
+	struct ArgumentIndex {
+		typedef std::vector<Cell>::size_type argumentIndex;
+		typedef std::shared_ptr<const std::vector<Instruction::instructionReference>> candidateList;
+		
+		// The number of calls in which an argument is bound (while the first argument is not) before that argument is indexed.
+		static const uint64_t threshold = 8;
+		
+		struct Table {
+			// The candidate clauses for each key: those with that key, along with those with a variable in that argument.
+			std::unordered_map<Cell::word, candidateList> candidates;
+			// The candidate clauses for a key that no clause has.
+			candidateList variables;
+			uint64_t lookups = 0;
+			uint64_t builds = 0;
+		};
+		
+		SymbolTable::symbolIndex functor;
+		// The address of the code of each clause (after any clause-chaining instruction).
+		std::vector<Instruction::instructionReference> clauses;
+		// The key of each argument of each clause (as a constant, integer or functor cell), or an empty cell if it is a variable.
+		std::vector<std::vector<Cell>> keys;
+		std::vector<uint64_t> boundCalls;
+		std::vector<std::unique_ptr<Table>> tables;
+		uint64_t calls = 0;
+		uint64_t indexedCalls = 0;
+		
+		// Set once the index is shared between threads, after which it is only read: no more tables are built, and calls are no longer counted.
+		bool shared = false;
+		
+		ArgumentIndex(SymbolTable::symbolIndex functor) : functor(functor) { }
+		
+		void update(std::vector<Instruction::instructionReference> clauses, std::vector<std::vector<Cell>> keys);
+		
+		// Builds a table for every argument that any clause has a key for, and then shares the index.
+		void share();
+		
+		// Returns the candidate clauses for a call, or nullptr if no built index applies.
+		const candidateList* select(Runtime& runtime);
+		
+		std::string toString() const;
+		
+		private:
+		void build(argumentIndex argument);
+	};
+	
+	// The calls made to a linked predicate, from which frequently called predicates are chosen to be compiled to native code.
+	struct PredicateProfile {
+		SymbolTable::symbolIndex functor;
+		// The range of the code area holding the linked code of the predicate, and the address within it at which the predicate is entered.
+		Instruction::instructionReference start;
+		Instruction::instructionReference end;
+		Instruction::instructionReference entry;
+		uint64_t calls = 0;
+		
+		PredicateProfile(SymbolTable::symbolIndex functor, Instruction::instructionReference start, Instruction::instructionReference end, Instruction::instructionReference entry) : functor(functor), start(start), end(end), entry(entry) { }
+	};
+	
+	// A conjunction of goals in a rule, which may be run in parallel when the terms they are called with share no unbound variables.
+	// The conjunction is compiled into a hidden predicate that calls each goal in turn, and a hidden predicate for each goal alone, each of which takes the variables that the goals share with the rest of the rule.
+	struct Conjunction {
+		struct Goal {
+			const Instruction::instructionReference* label;
+			// The arguments of the conjunction that the goal uses.
+			std::vector<std::size_t> arguments;
+		};
+		
+		SymbolTable::symbolIndex functor;
+		int64_t parameters;
+		const Instruction::instructionReference* label;
+		std::vector<Goal> goals;
 		
-		Modifier(Type type, Instruction::instructionReference nextInstruction, StateReference::stateIndex topEnvironment, StateReference::stateIndex topChoicePoint) : type(type), nextInstruction(nextInstruction), topEnvironment(topEnvironment), topChoicePoint(topChoicePoint) { }
+		Conjunction(SymbolTable::symbolIndex functor, int64_t parameters, const Instruction::instructionReference* label) : functor(functor), parameters(parameters), label(label) { }
 	};
 	
+	// The opcode of each instruction in the bytecode, named after its disassembly.
+	enum class Opcode: uint64_t { put_structure, set_variable, set_value, put_integer, get_structure, unify_variable, unify_value, get_integer, put_variable, put_value, get_variable, get_value, call, execute, proceed, allocate, deallocate, trim, try_me_else, retry_me_else, trust_me, try_clause, retry_clause, trust_clause, switch_on_term, switch_on_constant, switch_on_structure, index_arguments, retry_alternative, load_integer, load_constant, add, subtract, multiply, divide, modulo, less_than, less_or_equal, greater_than, greater_or_equal, store_integer, unify_integer, table, retry_answer, complete_table, new_answer, parallel_call, command, profile, native };
+	
+	// The compiled program, as a contiguous sequence of words, in which each instruction is its opcode followed by its operands.
+	// Addresses (such as labels) refer to the word holding the opcode of an instruction.
+	class Bytecode {
+		public:
+		typedef uint64_t word;
+		
+		// The number of operands following each opcode.
+		static const word operands[];
+		
+		// Operands that do not fit in a word are held here, and are referred to by pointer.
+		std::deque<std::unordered_map<word, Instruction::instructionReference>> tables;
+		std::vector<std::shared_ptr<ArgumentIndex>> argumentIndexes;
+		std::deque<PredicateProfile> profiles;
+		std::vector<std::shared_ptr<Conjunction>> conjunctions;
+		// The number of times predicates have been linked into the code.
+		uint64_t links = 0;
+		
+		Instruction::instructionReference size() const {
+			return words.size();
+		}
+		
+		// Appends the encoded form of an instruction, returning its address.
+		Instruction::instructionReference append(const Instruction& instruction) {
+			Instruction::instructionReference address = words.size();
+			instruction.encode(*this);
+			return address;
+		}
+		
+		// Discards the code from the given address, to which nothing may still refer.
+		void truncate(Instruction::instructionReference address) {
+			words.resize(address);
+		}
+		
+		void emit(Opcode opcode, std::initializer_list<word> values = {}) {
+			words.push_back(static_cast<word>(opcode));
+			words.insert(words.end(), values.begin(), values.end());
+		}
+		
+		Opcode opcode(Instruction::instructionReference address) const {
+			return static_cast<Opcode>(words[address]);
+		}
+		
+		word& operand(Instruction::instructionReference address, word index) {
+			return words[address + 1 + index];
+		}
+		
+		// Returns the address of the instruction following the one at the given address.
+		Instruction::instructionReference next(Instruction::instructionReference address) const {
+			return address + 1 + operands[words[address]];
+		}
+		
+		// Builds every table that an argument index would build while the code is executed, and then shares the indexes.
+		// This is done before the code is shared between threads, after which it is only read.
+		void shareIndexes();
+		
+		// Reconstructs the instruction at the given address, so that it may be disassembled.
+		std::unique_ptr<Instruction> decode(Instruction::instructionReference address) const;
+		
+		// Executes instructions from the runtime's next instruction until the end address is reached (or after a single instruction, if stepping).
+		// Returns false if an instruction failed, in which case execution should backtrack.
+		bool execute(Runtime& runtime, Instruction::instructionReference endAddress, bool singleStep);
+		
+		static word encode(HeapReference reference) {
+			return reference.index << 2 | static_cast<word>(reference.area);
+		}
+		
+		static HeapReference decodeReference(word operand) {
+			return HeapReference(static_cast<StorageArea>(operand & 3), operand >> 2);
+		}
+		
+		private:
+		std::vector<word> words;
+		
+		friend class Image;
+	};
+	
+	// The operations performed by each instruction, given its operands, which return false if the instruction fails.
+	// The operations that transfer control set the next instruction themselves; otherwise, their caller advances to the following instruction.
+	bool pushCompoundTerm(Runtime& runtime, SymbolTable::symbolIndex functor, int64_t parameters, HeapReference registerReference);
+	bool pushVariable(Runtime& runtime, HeapReference registerReference);
+	bool pushValue(Runtime& runtime, HeapReference registerReference);
+	bool pushNumber(Runtime& runtime, HeapNumber number, HeapReference registerReference);
+	bool unifyCompoundTerm(Runtime& runtime, SymbolTable::symbolIndex functor, int64_t parameters, HeapReference registerReference);
+	bool unifyVariable(Runtime& runtime, HeapReference registerReference);
+	bool unifyValue(Runtime& runtime, HeapReference registerReference);
+	bool unifyNumber(Runtime& runtime, HeapNumber number, HeapReference registerReference);
+	bool pushVariableToAll(Runtime& runtime, HeapReference registerReference, HeapReference argumentReference);
+	bool copyRegisterToArgument(Runtime& runtime, HeapReference registerReference, HeapReference argumentReference);
+	bool copyArgumentToRegister(Runtime& runtime, HeapReference registerReference, HeapReference argumentReference);
+	bool unifyRegisterAndArgument(Runtime& runtime, HeapReference registerReference, HeapReference argumentReference);
+	bool call(Runtime& runtime, SymbolTable::symbolIndex functor, int64_t parameters, Modifier::Type modifier, const Instruction::instructionReference*& label, Instruction::instructionReference continuation);
+	bool parallelCall(Runtime& runtime, const Conjunction& conjunction, Instruction::instructionReference continuation);
+	bool proceed(Runtime& runtime);
+	bool allocate(Runtime& runtime, int64_t variables);
+	bool deallocate(Runtime& runtime);
+	bool trim(Runtime& runtime, HeapReference::heapIndex variables);
+	bool tryInitialClause(Runtime& runtime, Instruction::instructionReference label);
+	bool tryIntermediateClause(Runtime& runtime, Instruction::instructionReference label);
+	bool tryFinalClause(Runtime& runtime);
+	bool tryClause(Runtime& runtime, Instruction::instructionReference label, Instruction::instructionReference continuation);
+	bool retryClause(Runtime& runtime, Instruction::instructionReference label, Instruction::instructionReference continuation);
+	bool trustClause(Runtime& runtime, Instruction::instructionReference label);
+	bool switchOnTerm(Runtime& runtime, Instruction::instructionReference variableLabel, Instruction::instructionReference constantLabel, Instruction::instructionReference listLabel, Instruction::instructionReference structureLabel);
+	bool switchOnConstant(Runtime& runtime, const std::unordered_map<Cell::word, Instruction::instructionReference>& labels, Instruction::instructionReference defaultLabel);
+	bool switchOnStructure(Runtime& runtime, const std::unordered_map<Cell::word, Instruction::instructionReference>& labels, Instruction::instructionReference defaultLabel);
+	bool indexArguments(Runtime& runtime, ArgumentIndex* index, Instruction::instructionReference fallbackLabel, Instruction::instructionReference continuation);
+	bool retryAlternative(Runtime& runtime);
+	bool tableCall(Runtime& runtime, SymbolTable::symbolIndex functor, Instruction::instructionReference entry, Instruction::instructionReference answers);
+	bool retryAnswer(Runtime& runtime);
+	bool completeTable(Runtime& runtime);
+	bool newAnswer(Runtime& runtime);
+	bool loadInteger(Runtime& runtime, HeapReference reference, std::size_t integer);
+	bool loadConstant(Runtime& runtime, int64_t value, std::size_t integer);
+	bool addIntegers(Runtime& runtime, std::size_t destination, std::size_t left, std::size_t right);
+	bool subtractIntegers(Runtime& runtime, std::size_t destination, std::size_t left, std::size_t right);
+	bool multiplyIntegers(Runtime& runtime, std::size_t destination, std::size_t left, std::size_t right);
+	bool divideIntegers(Runtime& runtime, std::size_t destination, std::size_t left, std::size_t right);
+	bool moduloIntegers(Runtime& runtime, std::size_t destination, std::size_t left, std::size_t right);
+	bool lessThan(Runtime& runtime, std::size_t left, std::size_t right);
+	bool lessOrEqual(Runtime& runtime, std::size_t left, std::size_t right);
+	bool greaterThan(Runtime& runtime, std::size_t left, std::size_t right);
+	bool greaterOrEqual(Runtime& runtime, std::size_t left, std::size_t right);
+	bool storeInteger(Runtime& runtime, std::size_t integer, HeapReference reference);
+	bool unifyInteger(Runtime& runtime, std::size_t integer, HeapReference reference);
+	
+	// The arithmetic operations, which are either compiled into instructions on the integer registers, or evaluated from a term built at runtime.
+	enum class Arithmetic { none, add, subtract, multiply, divide, modulo };
+	Arithmetic arithmeticOperation(const std::string& name, int64_t parameters);
+	
+	// Evaluates an arithmetic expression that was built on the heap.
+	int64_t evaluate(Runtime& runtime, HeapReference reference);
+	
+	// Reclaims the cells of the heap that are no longer reachable, by marking those that are and sliding them down over the rest.
+	// Cells keep their relative order, so bindings still point in the same direction, and the cells below the heap size of a choice point are still those created before it.
+	class GarbageCollector {
+		public:
+		// The heap is not collected until it has this many cells. A threshold of 0 disables collection.
+		HeapReference::heapIndex threshold = HeapReference::heapIndex(1) << 20;
+		// After a collection, the heap may grow to this multiple of the cells that survived, before it is collected again.
+		double growth = 2;
+		
+		uint64_t collections = 0;
+		// The number of cells reclaimed by every collection.
+		uint64_t reclaimed = 0;
+		std::chrono::steady_clock::duration pauses = std::chrono::steady_clock::duration::zero();
+		std::chrono::steady_clock::duration longestPause = std::chrono::steady_clock::duration::zero();
+		
+		// The size of the heap at which it is next collected.
+		HeapReference::heapIndex trigger() const {
+			return threshold == 0 ? std::numeric_limits<HeapReference::heapIndex>::max() : std::max(threshold, limit);
+		}
+		
+		// Collects the heap of the given runtime, when the only registers in use are the given number of arguments (as when a predicate is entered).
+		void collect(Runtime& runtime, HeapReference::heapIndex arguments);
+		
+		std::string toString() const;
+		
+		private:
+		HeapReference::heapIndex limit = 0;
+	};
+	
+	class JIT;
+	
+	class TaskPool;
+	
+	struct Cancellation;
+	
+	class Tables;
+	
 	class Runtime {
 		public:
-		static Runtime* currentRuntime;
+		// The runtime into which code is being compiled and linked on this thread.
+		// Execution is passed its runtime explicitly, so this is only consulted on entry, and by the compiler.
+		static thread_local Runtime* currentRuntime;
 		
 		// The global stack used to contain term structures used when unifying.
 		StackHeap heap;
@@ -267,43 +644,70 @@ namespace Epilog {
 		// The registers used to temporarily hold pointers when building queries or rules
 		StackHeap registers;
 		
-		// The instructions corresponding to the compiled program
-		std::shared_ptr<BoundsCheckedSharedVector<Instruction>> instructions;
+		// The registers holding the unboxed integers of arithmetic expressions while they are evaluated.
+		// Each expression uses as many as the depth of its nesting, so expressions nested more deeply are evaluated from the heap instead.
+		static const std::size_t integerRegisters = 64;
+		std::array<int64_t, integerRegisters> integers;
+		
+		// The bytecode corresponding to the compiled program
+		std::shared_ptr<Bytecode> code;
 		
 		// The stack used to store variable bindings and choice points
-		std::vector<std::unique_ptr<StateReference>> stateStack;
+		std::vector<uint64_t> stateStack;
+		
+		// The candidate clauses remaining for each choice point created by an argument index
+		std::vector<std::shared_ptr<const std::vector<Instruction::instructionReference>>> alternatives;
+		
+		// The subgoal whose answers are returned by each answer choice point
+		std::vector<std::shared_ptr<Subgoal>> answers;
+		
+		// The answers of the calls to tabled predicates, which are created on the first such call
+		std::shared_ptr<Tables> tables;
+		
+		// Returns the index at which a new frame is pushed: above the current environment and choice point, and any frames that a modifier may restore.
+		// Any frame above this is no longer reachable, so its space is reused.
+		StateReference::stateIndex topOfStateStack() {
+			StateReference::stateIndex top = modifiers.empty() ? 0 : modifiers.top().floor;
+			if (topEnvironment != -1UL) {
+				top = std::max(top, topEnvironment + currentEnvironment()->words());
+			}
+			if (topChoicePoint != -1UL) {
+				top = std::max(top, topChoicePoint + currentChoicePoint()->words());
+			}
+			return top;
+		}
 		
-		void compressStateStack() {
-			// At the moment, the stack currently continues growing as more environments and choice points are added.
-			// The stack should instead be overwritten, so that it grows only as much as is necessary.
+		// Reserves space for a frame of the given number of words at the top of the stack, returning its index.
+		StateReference::stateIndex pushFrame(StateReference::stateIndex words) {
+			StateReference::stateIndex index = topOfStateStack();
+			if (stateStack.size() < index + words) {
+				stateStack.resize(index + words);
+			}
+			return index;
 		}
 		
 		StateReference::stateIndex topEnvironment = -1UL;
 		Environment* currentEnvironment() {
-			if (Environment* environment = dynamic_cast<Environment*>(stateStack[topEnvironment].get())) {
-				return environment;
-			} else {
-				throw RuntimeException("Tried to access a choice point as an environment.", __FILENAME__, __func__, __LINE__);
+			if (topEnvironment == -1UL) {
+				throw RuntimeException("Tried to access an environment when there is none.", __FILENAME__, __func__, __LINE__);
 			}
+			return reinterpret_cast<Environment*>(&stateStack[topEnvironment]);
 		}
 		void popTopEnvironment() {
 			topEnvironment = currentEnvironment()->previousEnvironment;
-			compressStateStack();
 		}
 		
-		std::vector<std::shared_ptr<StateReference>>::size_type topChoicePoint = -1UL;
+		StateReference::stateIndex topChoicePoint = -1UL;
 		ChoicePoint* currentChoicePoint() {
-			if (ChoicePoint* choicePoint = dynamic_cast<ChoicePoint*>(stateStack[topChoicePoint].get())) {
-				return choicePoint;
-			} else {
-				throw RuntimeException("Tried to access an environment as a choice point.", __FILENAME__, __func__, __LINE__);
+			if (topChoicePoint == -1UL) {
+				throw RuntimeException("Tried to access a choice point when there is none.", __FILENAME__, __func__, __LINE__);
 			}
+			return reinterpret_cast<ChoicePoint*>(&stateStack[topChoicePoint]);
 		}
 		void popTopChoicePoint() {
 			ChoicePoint* choicePoint = currentChoicePoint();
 			topEnvironment = choicePoint->environment;
 			topChoicePoint = choicePoint->previousChoicePoint;
-			compressStateStack();
 		}
 		
 		int64_t currentNumberOfArguments = 0;
@@ -312,7 +716,19 @@ namespace Epilog {
 		std::vector<HeapReference> trail;
 		
 		// Labels with which a particular instruction can be jumped to
-		std::unordered_map<std::string, Instruction::instructionReference> labels;
+		std::unordered_map<SymbolTable::symbolIndex, Instruction::instructionReference> labels;
+		
+		// The argument indexes of each predicate with several clauses
+		std::unordered_map<SymbolTable::symbolIndex, std::shared_ptr<ArgumentIndex>> argumentIndexes;
+		
+		// The compiler of frequently called predicates to native code, if native code may be generated
+		std::shared_ptr<JIT> jit;
+		
+		// The threads on which the goals of a conjunction may be run in parallel, if they may be
+		TaskPool* tasks = nullptr;
+		
+		// Set while the runtime runs a goal of a conjunction in parallel, which fails at its next call or backtrack once the conjunction is cancelled
+		const Cancellation* cancellation = nullptr;
 		
 		Instruction::instructionReference nextInstruction;
 		
@@ -322,32 +738,47 @@ namespace Epilog {
 		
 		HeapReference::heapIndex unificationIndex;
 		
-		std::stack<Modifier> modifiers;
+		// Set when an instruction fails in a way that may not be inverted by a modifier (such as succeeding within a not).
+		bool forcefulFailure = false;
+		
+		ModifierStack modifiers;
+		
+		GarbageCollector collector;
+		
+		// The stream to which the program writes its output.
+		std::ostream* output = &std::cout;
 		
 		Runtime() {
-			instructions.reset(new BoundsCheckedSharedVector<Instruction>);
+			code.reset(new Bytecode());
 		}
 		
+		// Creates a runtime that shares the code of another, with its own heap, registers, frames and trail.
+		// The code is only read, so native code is not generated, as compiling a predicate modifies it.
 		Runtime(Runtime& other) {
-			instructions = other.instructions;
+			code = other.code;
 			labels = other.labels;
+			argumentIndexes = other.argumentIndexes;
+			tasks = other.tasks;
+			collector.threshold = other.collector.threshold;
+			collector.growth = other.collector.growth;
 			// Make sure we don't overflow the number of Epilog registers.
 			while (registers.size() < other.registers.size()) {
-				registers.push_back(nullptr);
+				registers.push_back(Cell());
 			}
 		}
 	};
 	
 	struct PushCompoundTermInstruction: Instruction {
-		HeapFunctor functor;
+		SymbolTable::symbolIndex functor;
+		int64_t parameters;
 		HeapReference registerReference;
 		
-		PushCompoundTermInstruction(HeapFunctor functor, HeapReference registerReference) : functor(functor), registerReference(registerReference) { }
+		PushCompoundTermInstruction(HeapFunctor functor, HeapReference registerReference) : functor(SymbolTable::intern(functor)), parameters(functor.parameters), registerReference(registerReference) { }
 		
-		virtual void execute() override;
+		virtual void encode(Bytecode& code) const override;
 		
 		virtual std::string toString() const override {
-			return "put_structure " + functor.name + "/" + std::to_string(functor.parameters) + ", " + registerReference.toString();
+			return "put_structure " + SymbolTable::get(functor).toString() + ", " + registerReference.toString();
 		}
 	};
 	
@@ -356,7 +787,7 @@ namespace Epilog {
 		
 		PushVariableInstruction(HeapReference registerReference) : registerReference(registerReference) { }
 		
-		virtual void execute() override;
+		virtual void encode(Bytecode& code) const override;
 		
 		virtual std::string toString() const override {
 			return "set_variable " + registerReference.toString();
@@ -368,7 +799,7 @@ namespace Epilog {
 		
 		PushValueInstruction(HeapReference registerReference) : registerReference(registerReference) { }
 		
-		virtual void execute() override;
+		virtual void encode(Bytecode& code) const override;
 		
 		virtual std::string toString() const override {
 			return "set_value " + registerReference.toString();
@@ -381,7 +812,7 @@ namespace Epilog {
 		
 		PushNumberInstruction(HeapNumber number, HeapReference registerReference) : number(number), registerReference(registerReference) { }
 		
-		virtual void execute() override;
+		virtual void encode(Bytecode& code) const override;
 		
 		virtual std::string toString() const override {
 			return "put_integer " + std::to_string(number.value) + ", " + registerReference.toString();
@@ -389,15 +820,18 @@ namespace Epilog {
 	};
 	
 	struct UnifyCompoundTermInstruction: Instruction {
-		HeapFunctor functor;
+		SymbolTable::symbolIndex functor;
+		int64_t parameters;
 		HeapReference registerReference;
 		
-		UnifyCompoundTermInstruction(HeapFunctor functor, HeapReference registerReference) : functor(functor), registerReference(registerReference) { }
+		UnifyCompoundTermInstruction(HeapFunctor functor, HeapReference registerReference) : functor(SymbolTable::intern(functor)), parameters(functor.parameters), registerReference(registerReference) { }
+		
+		UnifyCompoundTermInstruction(SymbolTable::symbolIndex functor, HeapReference registerReference) : functor(functor), parameters(SymbolTable::get(functor).parameters), registerReference(registerReference) { }
 		
-		virtual void execute() override;
+		virtual void encode(Bytecode& code) const override;
 		
 		virtual std::string toString() const override {
-			return "get_structure " + functor.name + "/" + std::to_string(functor.parameters) + ", " + registerReference.toString();
+			return "get_structure " + SymbolTable::get(functor).toString() + ", " + registerReference.toString();
 		}
 	};
 	
@@ -406,7 +840,7 @@ namespace Epilog {
 		
 		UnifyVariableInstruction(HeapReference registerReference) : registerReference(registerReference) { }
 		
-		virtual void execute() override;
+		virtual void encode(Bytecode& code) const override;
 		
 		virtual std::string toString() const override {
 			return "unify_variable " + registerReference.toString();
@@ -418,7 +852,7 @@ namespace Epilog {
 		
 		UnifyValueInstruction(HeapReference registerReference) : registerReference(registerReference) { }
 		
-		virtual void execute() override;
+		virtual void encode(Bytecode& code) const override;
 		
 		virtual std::string toString() const override {
 			return "unify_value " + registerReference.toString();
@@ -431,7 +865,7 @@ namespace Epilog {
 		
 		UnifyNumberInstruction(HeapNumber number, HeapReference registerReference) : number(number), registerReference(registerReference) { }
 		
-		virtual void execute() override;
+		virtual void encode(Bytecode& code) const override;
 		
 		virtual std::string toString() const override {
 			return "get_integer " + std::to_string(number.value) + ", " + registerReference.toString();
@@ -444,7 +878,7 @@ namespace Epilog {
 		
 		PushVariableToAllInstruction(HeapReference registerReference, HeapReference argumentReference) : registerReference(registerReference), argumentReference(argumentReference) { }
 		
-		virtual void execute() override;
+		virtual void encode(Bytecode& code) const override;
 		
 		virtual std::string toString() const override {
 			return "put_variable " + registerReference.toString() + ", " + argumentReference.toString();
@@ -457,7 +891,7 @@ namespace Epilog {
 		
 		CopyRegisterToArgumentInstruction(HeapReference registerReference, HeapReference argumentReference) : registerReference(registerReference), argumentReference(argumentReference) { }
 		
-		virtual void execute() override;
+		virtual void encode(Bytecode& code) const override;
 		
 		virtual std::string toString() const override {
 			return "put_value " + registerReference.toString() + ", " + argumentReference.toString();
@@ -470,7 +904,7 @@ namespace Epilog {
 		
 		CopyArgumentToRegisterInstruction(HeapReference registerReference, HeapReference argumentReference) : registerReference(registerReference), argumentReference(argumentReference) { }
 		
-		virtual void execute() override;
+		virtual void encode(Bytecode& code) const override;
 		
 		virtual std::string toString() const override {
 			return "get_variable " + registerReference.toString() + ", " + argumentReference.toString();
@@ -483,7 +917,7 @@ namespace Epilog {
 		
 		UnifyRegisterAndArgumentInstruction(HeapReference registerReference, HeapReference argumentReference) : registerReference(registerReference), argumentReference(argumentReference) { }
 		
-		virtual void execute() override;
+		virtual void encode(Bytecode& code) const override;
 		
 		virtual std::string toString() const override {
 			return "get_value " + registerReference.toString() + ", " + argumentReference.toString();
@@ -491,20 +925,47 @@ namespace Epilog {
 	};
 	
 	struct CallInstruction: Instruction {
-		HeapFunctor functor;
+		SymbolTable::symbolIndex functor;
+		int64_t parameters;
 		Modifier::Type modifier = Modifier::Type::none;
 		
-		CallInstruction(const HeapFunctor functor) : functor(functor) { }
+		CallInstruction(const HeapFunctor functor) : functor(SymbolTable::intern(functor)), parameters(functor.parameters) { }
+		
+		virtual void encode(Bytecode& code) const override;
+		
+		virtual std::string toString() const override {
+			return "call " + std::string(modifier == Modifier::Type::negate ? "\\+" : modifier == Modifier::Type::intercept ? "\\:" : "") + SymbolTable::get(functor).toString();
+		}
+	};
+	
+	// The call of the last goal of a rule, once its environment has been deallocated, which returns directly to the rule's caller.
+	struct ExecuteInstruction: CallInstruction {
+		ExecuteInstruction(const CallInstruction& call) : CallInstruction(call) { }
+		
+		virtual void encode(Bytecode& code) const override;
+		
+		virtual std::string toString() const override {
+			return "execute " + std::string(modifier == Modifier::Type::negate ? "\\+" : modifier == Modifier::Type::intercept ? "\\:" : "") + SymbolTable::get(functor).toString();
+		}
+	};
+	
+	// Runs the goals of a conjunction in parallel, if they are independent, and otherwise calls the hidden predicate that runs them in turn.
+	// The last goal of a rule returns directly to the rule's caller, as execute does.
+	struct ParallelCallInstruction: Instruction {
+		std::shared_ptr<Conjunction> conjunction;
+		bool last;
+		
+		ParallelCallInstruction(std::shared_ptr<Conjunction> conjunction, bool last) : conjunction(conjunction), last(last) { }
 		
-		virtual void execute() override;
+		virtual void encode(Bytecode& code) const override;
 		
 		virtual std::string toString() const override {
-			return "call " + std::string(modifier == Modifier::Type::negate ? "\\+" : modifier == Modifier::Type::intercept ? "\\:" : "") + functor.name + "/" + std::to_string(functor.parameters);
+			return "parallel_call " + SymbolTable::get(conjunction->functor).toString() + ", " + std::to_string(conjunction->goals.size()) + (last ? ", last" : "");
 		}
 	};
 	
 	struct ProceedInstruction: Instruction {
-		virtual void execute() override;
+		virtual void encode(Bytecode& code) const override;
 		
 		virtual std::string toString() const override {
 			return "proceed";
@@ -516,7 +977,7 @@ namespace Epilog {
 		
 		AllocateInstruction(int64_t variables) : variables(variables) { }
 		
-		virtual void execute() override;
+		virtual void encode(Bytecode& code) const override;
 		
 		virtual std::string toString() const override {
 			return "allocate " + std::to_string(variables);
@@ -524,19 +985,32 @@ namespace Epilog {
 	};
 	
 	struct DeallocateInstruction: Instruction {
-		virtual void execute() override;
+		virtual void encode(Bytecode& code) const override;
 		
 		virtual std::string toString() const override {
 			return "deallocate";
 		}
 	};
 	
+	// Discards the permanent variables of the current environment that are no longer used.
+	struct TrimInstruction: Instruction {
+		HeapReference::heapIndex variables;
+		
+		TrimInstruction(HeapReference::heapIndex variables) : variables(variables) { }
+		
+		virtual void encode(Bytecode& code) const override;
+		
+		virtual std::string toString() const override {
+			return "trim " + std::to_string(variables);
+		}
+	};
+	
 	struct TryInitialClauseInstruction: Instruction {
 		Instruction::instructionReference label;
 		
 		TryInitialClauseInstruction(Instruction::instructionReference label) : label(label) { }
 		
-		virtual void execute() override;
+		virtual void encode(Bytecode& code) const override;
 		
 		virtual std::string toString() const override {
 			return "try_me_else";
@@ -548,7 +1022,7 @@ namespace Epilog {
 		
 		TryIntermediateClauseInstruction(Instruction::instructionReference label) : label(label) { }
 		
-		virtual void execute() override;
+		virtual void encode(Bytecode& code) const override;
 		
 		virtual std::string toString() const override {
 			return "retry_me_else";
@@ -556,22 +1030,277 @@ namespace Epilog {
 	};
 	
 	struct TryFinalClauseInstruction: Instruction {
-		virtual void execute() override;
+		virtual void encode(Bytecode& code) const override;
 		
 		virtual std::string toString() const override {
 			return "trust_me";
 		}
 	};
 	
+	struct TryClauseInstruction: Instruction {
+		Instruction::instructionReference label;
+		
+		TryClauseInstruction(Instruction::instructionReference label) : label(label) { }
+		
+		virtual void encode(Bytecode& code) const override;
+		
+		virtual std::string toString() const override {
+			return "try " + std::to_string(label);
+		}
+	};
+	
+	struct RetryClauseInstruction: Instruction {
+		Instruction::instructionReference label;
+		
+		RetryClauseInstruction(Instruction::instructionReference label) : label(label) { }
+		
+		virtual void encode(Bytecode& code) const override;
+		
+		virtual std::string toString() const override {
+			return "retry " + std::to_string(label);
+		}
+	};
+	
+	struct TrustClauseInstruction: Instruction {
+		Instruction::instructionReference label;
+		
+		TrustClauseInstruction(Instruction::instructionReference label) : label(label) { }
+		
+		virtual void encode(Bytecode& code) const override;
+		
+		virtual std::string toString() const override {
+			return "trust " + std::to_string(label);
+		}
+	};
+	
+	// Selects the candidate clauses using an argument index, if one applies to the call, and otherwise continues to the first-argument index or the clause chain.
+	struct IndexArgumentsInstruction: Instruction {
+		std::shared_ptr<ArgumentIndex> index;
+		Instruction::instructionReference fallbackLabel;
+		
+		IndexArgumentsInstruction(std::shared_ptr<ArgumentIndex> index, Instruction::instructionReference fallbackLabel) : index(index), fallbackLabel(fallbackLabel) { }
+		
+		virtual void encode(Bytecode& code) const override;
+		
+		virtual std::string toString() const override {
+			return "index_arguments " + SymbolTable::get(index->functor).toString() + ", " + std::to_string(fallbackLabel);
+		}
+	};
+	
+	// Backtracks into the next candidate clause selected by an argument index.
+	struct RetryAlternativeInstruction: Instruction {
+		virtual void encode(Bytecode& code) const override;
+		
+		virtual std::string toString() const override {
+			return "retry_alternative";
+		}
+	};
+	
+	// Calls a tabled predicate through its table: a call whose subgoal is complete is given its answers, while one whose subgoal is not is evaluated by running the clauses from the entry.
+	struct TableInstruction: Instruction {
+		SymbolTable::symbolIndex functor;
+		Instruction::instructionReference entry;
+		
+		TableInstruction(SymbolTable::symbolIndex functor, Instruction::instructionReference entry) : functor(functor), entry(entry) { }
+		
+		virtual void encode(Bytecode& code) const override;
+		
+		virtual std::string toString() const override {
+			return "table " + SymbolTable::get(functor).toString() + ", " + labelToString(entry);
+		}
+	};
+	
+	// Backtracks into the next answer given to a tabled call.
+	struct RetryAnswerInstruction: Instruction {
+		virtual void encode(Bytecode& code) const override;
+		
+		virtual std::string toString() const override {
+			return "retry_answer";
+		}
+	};
+	
+	// Backtracked into once the clauses evaluating a tabled call have no more solutions, which either runs them again or completes the call.
+	struct CompleteTableInstruction: Instruction {
+		virtual void encode(Bytecode& code) const override;
+		
+		virtual std::string toString() const override {
+			return "complete_table";
+		}
+	};
+	
+	// Returned to by the clauses evaluating a tabled call, which records their solution as an answer and then backtracks for the next.
+	struct NewAnswerInstruction: Instruction {
+		virtual void encode(Bytecode& code) const override;
+		
+		virtual std::string toString() const override {
+			return "new_answer";
+		}
+	};
+	
+	// Dispatches on the type of the (dereferenced) first argument.
+	struct SwitchOnTermInstruction: Instruction {
+		Instruction::instructionReference variableLabel;
+		Instruction::instructionReference constantLabel;
+		Instruction::instructionReference listLabel;
+		Instruction::instructionReference structureLabel;
+		
+		SwitchOnTermInstruction(Instruction::instructionReference variableLabel, Instruction::instructionReference constantLabel, Instruction::instructionReference listLabel, Instruction::instructionReference structureLabel) : variableLabel(variableLabel), constantLabel(constantLabel), listLabel(listLabel), structureLabel(structureLabel) { }
+		
+		virtual void encode(Bytecode& code) const override;
+		
+		virtual std::string toString() const override {
+			return "switch_on_term " + labelToString(variableLabel) + ", " + labelToString(constantLabel) + ", " + labelToString(listLabel) + ", " + labelToString(structureLabel);
+		}
+	};
+	
+	// Dispatches on the value of a first argument that is an atom or an integer.
+	struct SwitchOnConstantInstruction: Instruction {
+		std::unordered_map<Cell::word, Instruction::instructionReference> labels;
+		Instruction::instructionReference defaultLabel;
+		
+		SwitchOnConstantInstruction(std::unordered_map<Cell::word, Instruction::instructionReference> labels, Instruction::instructionReference defaultLabel) : labels(labels), defaultLabel(defaultLabel) { }
+		
+		virtual void encode(Bytecode& code) const override;
+		
+		virtual std::string toString() const override {
+			return "switch_on_constant " + std::to_string(labels.size()) + ", " + labelToString(defaultLabel);
+		}
+	};
+	
+	// Dispatches on the functor of a first argument that is a compound term.
+	struct SwitchOnStructureInstruction: Instruction {
+		std::unordered_map<SymbolTable::symbolIndex, Instruction::instructionReference> labels;
+		Instruction::instructionReference defaultLabel;
+		
+		SwitchOnStructureInstruction(std::unordered_map<SymbolTable::symbolIndex, Instruction::instructionReference> labels, Instruction::instructionReference defaultLabel) : labels(labels), defaultLabel(defaultLabel) { }
+		
+		virtual void encode(Bytecode& code) const override;
+		
+		virtual std::string toString() const override {
+			return "switch_on_structure " + std::to_string(labels.size()) + ", " + labelToString(defaultLabel);
+		}
+	};
+	
+	// Counts the calls to a predicate, compiling it to native code once it has been called often enough, and then enters it.
+	struct ProfileInstruction: Instruction {
+		PredicateProfile* profile;
+		
+		ProfileInstruction(PredicateProfile* profile) : profile(profile) { }
+		
+		virtual void encode(Bytecode& code) const override;
+		
+		virtual std::string toString() const override {
+			return "profile " + SymbolTable::get(profile->functor).toString() + ", " + labelToString(profile->entry);
+		}
+	};
+	
+	// Executes native code compiled from the bytecode at an address.
+	struct NativeInstruction: Instruction {
+		typedef bool (*function)(Runtime&);
+		
+		function code;
+		Instruction::instructionReference address;
+		
+		NativeInstruction(function code, Instruction::instructionReference address) : code(code), address(address) { }
+		
+		virtual void encode(Bytecode& code) const override;
+		
+		virtual std::string toString() const override {
+			return "native " + labelToString(address);
+		}
+	};
+	
+	// Evaluates the arithmetic expression held by a register or permanent variable into an integer register.
+	struct LoadIntegerInstruction: Instruction {
+		HeapReference reference;
+		std::size_t integer;
+		
+		LoadIntegerInstruction(HeapReference reference, std::size_t integer) : reference(reference), integer(integer) { }
+		
+		virtual void encode(Bytecode& code) const override;
+		
+		virtual std::string toString() const override {
+			return "load_integer " + reference.toString() + ", I" + std::to_string(integer);
+		}
+	};
+	
+	struct LoadConstantInstruction: Instruction {
+		int64_t value;
+		std::size_t integer;
+		
+		LoadConstantInstruction(int64_t value, std::size_t integer) : value(value), integer(integer) { }
+		
+		virtual void encode(Bytecode& code) const override;
+		
+		virtual std::string toString() const override {
+			return "load_constant " + std::to_string(value) + ", I" + std::to_string(integer);
+		}
+	};
+	
+	// Performs an arithmetic operation (add, subtract, multiply, divide or modulo) on two integer registers.
+	struct ArithmeticInstruction: Instruction {
+		Opcode operation;
+		std::size_t destination;
+		std::size_t left;
+		std::size_t right;
+		
+		ArithmeticInstruction(Opcode operation, std::size_t destination, std::size_t left, std::size_t right) : operation(operation), destination(destination), left(left), right(right) { }
+		
+		virtual void encode(Bytecode& code) const override;
+		
+		virtual std::string toString() const override;
+	};
+	
+	// Compares two integer registers (less_than, less_or_equal, greater_than or greater_or_equal), failing if the comparison does not hold.
+	struct ComparisonInstruction: Instruction {
+		Opcode comparison;
+		std::size_t left;
+		std::size_t right;
+		
+		ComparisonInstruction(Opcode comparison, std::size_t left, std::size_t right) : comparison(comparison), left(left), right(right) { }
+		
+		virtual void encode(Bytecode& code) const override;
+		
+		virtual std::string toString() const override;
+	};
+	
+	// Sets a permanent variable that has not yet been used to the value of an integer register.
+	struct StoreIntegerInstruction: Instruction {
+		std::size_t integer;
+		HeapReference reference;
+		
+		StoreIntegerInstruction(std::size_t integer, HeapReference reference) : integer(integer), reference(reference) { }
+		
+		virtual void encode(Bytecode& code) const override;
+		
+		virtual std::string toString() const override {
+			return "store_integer I" + std::to_string(integer) + ", " + reference.toString();
+		}
+	};
+	
+	// Unifies a register or permanent variable with the value of an integer register.
+	struct UnifyIntegerInstruction: Instruction {
+		std::size_t integer;
+		HeapReference reference;
+		
+		UnifyIntegerInstruction(std::size_t integer, HeapReference reference) : integer(integer), reference(reference) { }
+		
+		virtual void encode(Bytecode& code) const override;
+		
+		virtual std::string toString() const override {
+			return "unify_integer I" + std::to_string(integer) + ", " + reference.toString();
+		}
+	};
+	
 	struct CommandInstruction: Instruction {
-		std::string function;
+		SymbolTable::symbolIndex function;
 		
-		CommandInstruction(std::string function) : function(function) { }
+		CommandInstruction(std::string function) : function(SymbolTable::intern(function, 0)) { }
 		
-		virtual void execute() override;
+		virtual void encode(Bytecode& code) const override;
 		
 		virtual std::string toString() const override {
-			return "command " + function;
+			return "command " + SymbolTable::get(function).name;
 		}
 	};
 }
@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <sstream>
+#include <thread>
+#include "interpreter.hh"
+#include "search.hh"
+#include "tabling.hh"
+
+namespace Epilog {
+	bool ParallelSearch::execute(Runtime& runtime, Instruction::instructionReference startAddress, Instruction::instructionReference endAddress, const std::unordered_map<std::string, HeapReference>& variables) {
+		runtime.code->shareIndexes();
+		this->runtime = &runtime;
+		this->endAddress = endAddress;
+		this->variables = &variables;
+		branches.clear();
+		idle = 0;
+		hungry = 0;
+		finished = false;
+		error = nullptr;
+		solutions = 0;
+		
+		auto work = [&] (bool root) {
+			Runtime worker(runtime);
+			Runtime::currentRuntime = &worker;
+			std::ostringstream output;
+			worker.output = &output;
+			try {
+				if (root) {
+					worker.nextInstruction = startAddress;
+					worker.nextGoal = endAddress;
+					explore(worker, -1UL);
+				}
+				while (true) {
+					Branch branch;
+					{
+						std::unique_lock<std::mutex> lock(mutex);
+						flush(worker);
+						++ idle;
+						hungry = idle > branches.size() ? idle - static_cast<unsigned>(branches.size()) : 0;
+						// The search is over once every thread is idle, with no branches left to explore.
+						if (idle == threads && branches.empty()) {
+							finished = true;
+							available.notify_all();
+						}
+						available.wait(lock, [this] { return finished || !branches.empty(); });
+						if (finished) {
+							break;
+						}
+						branch = std::move(branches.front());
+						branches.pop_front();
+						-- idle;
+					}
+					worker.heap.swap(branch.heap);
+					worker.stateStack.swap(branch.stateStack);
+					worker.trail.swap(branch.trail);
+					worker.modifiers = std::move(branch.modifiers);
+					worker.alternatives.swap(branch.alternatives);
+					worker.answers.swap(branch.answers);
+					worker.topChoicePoint = branch.choicePoint;
+					worker.topEnvironment = worker.currentChoicePoint()->environment;
+					worker.forcefulFailure = false;
+					worker.nextInstruction = worker.currentChoicePoint()->nextClause;
+					explore(worker, branch.floor);
+				}
+			} catch (...) {
+				std::lock_guard<std::mutex> lock(mutex);
+				if (error == nullptr) {
+					error = std::current_exception();
+				}
+				finished = true;
+				available.notify_all();
+			}
+		};
+		std::vector<std::thread> workers;
+		for (unsigned i = 0; i < std::max(threads, 1U); ++ i) {
+			workers.emplace_back(work, i == 0);
+		}
+		for (std::thread& worker : workers) {
+			worker.join();
+		}
+		if (error != nullptr) {
+			std::rethrow_exception(error);
+		}
+		return solutions > 0;
+	}
+	
+	void ParallelSearch::explore(Runtime& worker, StateReference::stateIndex floor) {
+		Bytecode& code = *worker.code;
+		while (worker.nextInstruction < code.size()) {
+			bool succeeded = false;
+			if (worker.nextInstruction == endAddress) {
+				// Every solution is found, by backtracking from each as though the query had failed.
+				report(worker);
+			} else {
+				try {
+					succeeded = code.execute(worker, endAddress, false);
+				} catch (const RuntimeException& exception) {
+					if (exception.forceful || !AST::modifyUnificationCondition(worker, Modifier::Type::intercept)) {
+						throw;
+					}
+					continue;
+				}
+			}
+			if (!succeeded) {
+				bool forceful = worker.forcefulFailure;
+				worker.forcefulFailure = false;
+				if (finished) {
+					return;
+				}
+				if (hungry > 0) {
+					share(worker, floor);
+				}
+				if (worker.topChoicePoint != floor) {
+					worker.nextInstruction = worker.currentChoicePoint()->nextClause;
+				} else if (floor != -1UL || forceful || !AST::modifyUnificationCondition(worker, Modifier::Type::negate)) {
+					// The choice points below the floor are backtracked into by the branch that shared them.
+					return;
+				}
+			}
+		}
+	}
+	
+	void ParallelSearch::share(Runtime& worker, StateReference::stateIndex& floor) {
+		auto choicePointAt = [&worker] (StateReference::stateIndex index) {
+			return reinterpret_cast<ChoicePoint*>(&worker.stateStack[index]);
+		};
+		// The oldest choice point is shared, as it is likely to have the most work left beneath it. The newest is kept, as it is about to be backtracked into.
+		StateReference::stateIndex oldest = -1UL;
+		for (StateReference::stateIndex index = worker.topChoicePoint; index != floor && index != -1UL; index = choicePointAt(index)->previousChoicePoint) {
+			oldest = index;
+		}
+		if (oldest == -1UL || oldest == worker.topChoicePoint) {
+			return;
+		}
+		// A thread that is evaluating a tabled call finds every solution of its clauses itself, as they are collected in its own tables.
+		if (worker.tables != nullptr && !worker.tables->evaluations.empty()) {
+			return;
+		}
+		ChoicePoint* choicePoint = choicePointAt(oldest);
+		// The alternatives of a negation or catch are tried by the thread executing it, as it depends on whether any of them succeeds.
+		if (std::any_of(worker.modifiers.begin(), worker.modifiers.begin() + choicePoint->modifiers, [] (const Modifier& modifier) { return modifier.type != Modifier::Type::none; })) {
+			return;
+		}
+		
+		Branch branch;
+		branch.heap.assign(worker.heap.begin(), worker.heap.begin() + choicePoint->heapSize);
+		branch.stateStack.assign(worker.stateStack.begin(), worker.stateStack.begin() + oldest + choicePoint->words());
+		branch.trail.assign(worker.trail.begin(), worker.trail.begin() + choicePoint->trailSize);
+		// The bindings made since the choice point was created are undone, as they would be by backtracking into it.
+		Environment* environment = choicePoint->environment != -1UL ? reinterpret_cast<Environment*>(&branch.stateStack[choicePoint->environment]) : nullptr;
+		for (std::vector<HeapReference>::size_type i = choicePoint->trailSize; i < worker.trail.size(); ++ i) {
+			const HeapReference& reference = worker.trail[i];
+			if (reference.area == StorageArea::heap && reference.index < branch.heap.size()) {
+				branch.heap[reference.index] = Cell::reference(reference.index);
+			} else if (reference.area == StorageArea::environment && environment != nullptr && reference.index < environment->size) {
+				environment->variables()[reference.index] = Cell::reference(reference.index);
+			}
+		}
+		branch.modifiers = worker.modifiers;
+		while (branch.modifiers.size() > choicePoint->modifiers) {
+			branch.modifiers.pop();
+		}
+		branch.alternatives.assign(worker.alternatives.begin(), worker.alternatives.begin() + choicePoint->alternatives);
+		branch.answers.assign(worker.answers.begin(), worker.answers.begin() + choicePoint->answers);
+		branch.choicePoint = oldest;
+		branch.floor = floor;
+		floor = oldest;
+		
+		std::lock_guard<std::mutex> lock(mutex);
+		branches.push_back(std::move(branch));
+		hungry = idle > branches.size() ? idle - static_cast<unsigned>(branches.size()) : 0;
+		available.notify_one();
+	}
+	
+	void ParallelSearch::report(Runtime& worker) {
+		std::string bindings;
+		for (auto& binding : AST::queryBindings(worker, *variables)) {
+			bindings += (bindings.empty() ? "" : ", ") + binding.first + " = " + (binding.second.tag() != Cell::Tag::empty ? binding.second.trace(worker) : "_");
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		flush(worker);
+		if (!bindings.empty()) {
+			*runtime->output << bindings << std::endl;
+		}
+		++ solutions;
+	}
+	
+	void ParallelSearch::flush(Runtime& worker) {
+		std::ostringstream& output = static_cast<std::ostringstream&>(*worker.output);
+		*runtime->output << output.str();
+		output.str(std::string());
+	}
+}
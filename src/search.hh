@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "runtime.hh"
+
+namespace Epilog {
+	// Searches for every solution of a query across several threads, exploring its alternative clauses in parallel (OR-parallelism) by copying stacks, in the style of Muse.
+	// Each thread searches a branch of its own, on a runtime of its own. Whenever a thread is idle, a busy thread shares the oldest choice point of its branch, by copying its heap, frames and trail as they were when the choice point was created.
+	// The idle thread then tries every alternative of the choice point that is left, while the busy thread no longer backtracks into it.
+	class ParallelSearch {
+		public:
+		ParallelSearch(unsigned threads) : threads(threads) { }
+		
+		// Searches for each solution of a query of the given runtime, writing the bindings of the query's variables for each, in the order in which they are found.
+		// Returns false if the query has no solutions.
+		bool execute(Runtime& runtime, Instruction::instructionReference startAddress, Instruction::instructionReference endAddress, const std::unordered_map<std::string, HeapReference>& variables);
+		
+		private:
+		// The state from which a branch is resumed, by backtracking into its top choice point.
+		struct Branch {
+			StackHeap heap;
+			std::vector<uint64_t> stateStack;
+			std::vector<HeapReference> trail;
+			ModifierStack modifiers;
+			std::vector<std::shared_ptr<const std::vector<Instruction::instructionReference>>> alternatives;
+			std::vector<std::shared_ptr<Subgoal>> answers;
+			StateReference::stateIndex choicePoint;
+			// The choice point below which the branch does not backtrack, as those below it belong to another branch.
+			StateReference::stateIndex floor;
+		};
+		
+		// Searches from the next instruction of a runtime, until it has backtracked into every choice point above the floor.
+		void explore(Runtime& worker, StateReference::stateIndex floor);
+		
+		// Hands the oldest choice point above the floor over to an idle thread, which then becomes the floor.
+		void share(Runtime& worker, StateReference::stateIndex& floor);
+		
+		// Records a solution found by a runtime, along with any output written since the last.
+		void report(Runtime& worker);
+		
+		// Writes any output of a runtime. The mutex must be held.
+		void flush(Runtime& worker);
+		
+		unsigned threads;
+		
+		// The query being searched.
+		Runtime* runtime = nullptr;
+		Instruction::instructionReference endAddress;
+		const std::unordered_map<std::string, HeapReference>* variables = nullptr;
+		
+		std::mutex mutex;
+		std::condition_variable available;
+		std::deque<Branch> branches;
+		unsigned idle = 0;
+		// The number of idle threads for which no branch has been shared, which busy threads check each time they backtrack.
+		std::atomic<unsigned> hungry;
+		std::atomic<bool> finished;
+		std::exception_ptr error;
+		uint64_t solutions = 0;
+	};
+}
@@ -0,0 +1,163 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "parser.hh"
+#include "reader.hh"
+#include "server.hh"
+
+namespace Epilog {
+	// Quotes a string as a JSON string.
+	static std::string quote(const std::string& string) {
+		std::string quoted = "\"";
+		for (char character : string) {
+			switch (character) {
+				case '"':
+					quoted += "\\\"";
+					break;
+				case '\\':
+					quoted += "\\\\";
+					break;
+				case '\n':
+					quoted += "\\n";
+					break;
+				case '\t':
+					quoted += "\\t";
+					break;
+				default:
+					if (static_cast<unsigned char>(character) < 0x20) {
+						char escaped[7];
+						std::snprintf(escaped, sizeof(escaped), "\\u%04x", character);
+						quoted += escaped;
+					} else {
+						quoted += character;
+					}
+			}
+		}
+		return quoted + "\"";
+	}
+	
+	void Server::serve(Parser::EpilogParser* reference, Interpreter::Context& context, const std::string& path) {
+		sockaddr_un address;
+		std::memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		if (path.size() >= sizeof(address.sun_path)) {
+			throw RuntimeException("The socket path " + path + " is too long.", __FILENAME__, __func__, __LINE__);
+		}
+		std::strcpy(address.sun_path, path.c_str());
+		// Any socket left by an earlier server is replaced.
+		unlink(path.c_str());
+		int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (listener == -1 || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1 || listen(listener, SOMAXCONN) == -1) {
+			throw RuntimeException("Could not listen on " + path + ": " + std::strerror(errno) + ".", __FILENAME__, __func__, __LINE__);
+		}
+		context.server = this;
+		
+		while (true) {
+			int client = accept(listener, nullptr, nullptr);
+			if (client == -1) {
+				if (errno == EINTR || errno == ECONNABORTED) {
+					continue;
+				}
+				throw RuntimeException("Could not accept a connection on " + path + ": " + std::strerror(errno) + ".", __FILENAME__, __func__, __LINE__);
+			}
+			// Queries are answered as each line is received, until the client closes the connection (or stops reading the responses).
+			std::string received;
+			char buffer[4096];
+			bool connected = true;
+			ssize_t size;
+			while (connected && (size = recv(client, buffer, sizeof(buffer), 0)) > 0) {
+				received.append(buffer, static_cast<std::size_t>(size));
+				std::string::size_type end;
+				while (connected && (end = received.find('\n')) != std::string::npos) {
+					std::string reply = respond(reference, context, received.substr(0, end));
+					received.erase(0, end + 1);
+					for (std::string::size_type sent = 0; connected && sent < reply.size(); ) {
+						ssize_t written = send(client, reply.data() + sent, reply.size() - sent, MSG_NOSIGNAL);
+						connected = written > 0;
+						sent += connected ? static_cast<std::string::size_type>(written) : 0;
+					}
+				}
+			}
+			close(client);
+		}
+	}
+	
+	std::string Server::respond(Parser::EpilogParser* reference, Interpreter::Context& context, const std::string& line) {
+		std::string::size_type first = line.find_first_not_of(" \t\r");
+		if (first == std::string::npos) {
+			return "{\"error\": \"No query was given.\"}\n";
+		}
+		std::string query = line.substr(first, line.find_last_not_of(" \t\r") + 1 - first);
+		if (query.compare(0, 2, "?-") != 0) {
+			query = "?- " + query;
+		}
+		if (query.back() != '.') {
+			query += ".";
+		}
+		
+		std::unique_ptr<AST::Clauses> root;
+		std::string error;
+		bool parsed;
+		if (reference != nullptr) {
+			pegmatite::StringInput input(query);
+			auto report = [&error] (const pegmatite::InputRange&, const std::string& message) {
+				error = message;
+			};
+			parsed = reference->parse(input, reference->grammar.clauses, reference->grammar.ignored, report, root);
+		} else {
+			Parser::Reader reader;
+			std::size_t line;
+			root = reader.read(query, error, line);
+			parsed = root != nullptr;
+		}
+		if (!parsed) {
+			return "{\"error\": " + quote("Could not parse the query: " + error) + "}\n";
+		}
+		// Clients may only query the resident program, so a line holding any other clause (which would add to the program for every later client), or more than one, is refused.
+		if (!root->isQuery()) {
+			return "{\"error\": \"Only a single query may be given.\"}\n";
+		}
+		response.clear();
+		try {
+			root->interpret(context);
+		} catch (const Exception& exception) {
+			response += "{\"error\": " + quote(exception.message) + "}\n";
+		}
+		return response;
+	}
+	
+	void Server::answer(Instruction::instructionReference startAddress, Instruction::instructionReference endAddress, const std::unordered_map<std::string, HeapReference>& variables) {
+		Runtime& runtime = *Runtime::currentRuntime;
+		Bytecode& code = *runtime.code;
+		Instruction::instructionReference linked = code.size();
+		std::ostringstream output;
+		std::ostream* previous = runtime.output;
+		runtime.output = &output;
+		// Queries are independent, so nothing on the heap outlives the query that built it.
+		runtime.heap.truncate(0);
+		std::string result;
+		try {
+			bool succeeded = AST::executeInstructions(runtime, startAddress, endAddress, nullptr);
+			result = std::string("\"success\": ") + (succeeded ? "true" : "false");
+			if (succeeded) {
+				std::string bindings;
+				for (auto& binding : AST::queryBindings(runtime, variables)) {
+					bindings += (bindings.empty() ? "" : ", ") + quote(binding.first) + ": " + quote(binding.second.tag() != Cell::Tag::empty ? binding.second.trace(runtime) : "_");
+				}
+				result += ", \"bindings\": {" + bindings + "}";
+			}
+		} catch (const Exception& exception) {
+			result = "\"error\": " + quote(exception.message);
+		}
+		runtime.output = previous;
+		response += "{" + result + ", \"output\": " + quote(output.str()) + "}\n";
+		// Nothing refers to the query's code once it has finished, so it may be discarded, as long as nothing was linked after it (such as native code, while it was executed).
+		if (code.size() == linked && code.next(endAddress) == linked) {
+			code.truncate(startAddress);
+		}
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include "runtime.hh"
+
+namespace Epilog {
+	namespace Interpreter {
+		class Context;
+	}
+	
+	namespace Parser {
+		class EpilogParser;
+	}
+	
+	// Answers the queries of clients over a Unix domain socket, from a program that is consulted once, so that no query pays for starting the process or compiling the program.
+	// Each line a client sends is a query (with or without its leading ?- and trailing full stop), which is compiled against the resident program and executed from an empty heap and frame stack.
+	// Lines holding any other clause, or more than one, are refused, so that no client may change the program that the others query.
+	// Each is answered by a line of JSON, holding the bindings of its first solution, or an error:
+	// {"success": true, "bindings": {"X": "a"}, "output": ""}
+	class Server {
+		public:
+		// Accepts connections on a socket created at the given path, answering the queries of each client in turn, until the process is stopped.
+		// Queries are not limited in time, so a query that never finishes (or a client that never closes its connection) keeps every other client waiting.
+		// Queries are read by Parser::Reader, unless a reference parser is given.
+		void serve(Parser::EpilogParser* reference, Interpreter::Context& context, const std::string& path);
+		
+		// Executes a query of the current runtime, recording the response to it.
+		// Its code is then discarded, unless other code has been linked after it, so that the code area does not grow with each query.
+		void answer(Instruction::instructionReference startAddress, Instruction::instructionReference endAddress, const std::unordered_map<std::string, HeapReference>& variables);
+		
+		private:
+		// Compiles and executes a line received from a client, returning the response to it.
+		std::string respond(Parser::EpilogParser* reference, Interpreter::Context& context, const std::string& line);
+		
+		std::string response;
+	};
+}
@@ -0,0 +1,228 @@
+#include <algorithm>
+#include <stack>
+#include "tabling.hh"
+
+namespace Epilog {
+	std::pair<TermTrie::Node*, bool> TermTrie::insert(const std::vector<Cell>& cells) {
+		Node* node = &root;
+		for (const Cell& cell : cells) {
+			std::unique_ptr<Node>& child = node->children[cell.value];
+			if (child == nullptr) {
+				child.reset(new Node(cell, node));
+			}
+			node = child.get();
+		}
+		bool inserted = !node->leaf;
+		node->leaf = true;
+		return std::make_pair(node, inserted);
+	}
+	
+	void TermTrie::read(const Node* leaf, std::vector<Cell>& cells) {
+		std::vector<Cell>::size_type start = cells.size();
+		for (const Node* node = leaf; node->parent != nullptr; node = node->parent) {
+			cells.push_back(node->cell);
+		}
+		std::reverse(cells.begin() + static_cast<std::ptrdiff_t>(start), cells.end());
+	}
+	
+	// Appends the cells of a term in prefix order, numbering each unbound variable by the order in which it first appears, as recorded in variables.
+	static void flatten(Runtime& runtime, Cell cell, std::vector<Cell>& cells, std::unordered_map<std::size_t, std::size_t>& variables) {
+		std::stack<Cell> terms;
+		terms.push(cell);
+		while (!terms.empty()) {
+			Cell term = terms.top(); terms.pop();
+			while (term.tag() == Cell::Tag::reference && runtime.heap[term.address()] != term) {
+				term = runtime.heap[term.address()];
+			}
+			switch (term.tag()) {
+				case Cell::Tag::reference:
+					cells.push_back(Cell::reference(variables.emplace(term.address(), variables.size()).first->second));
+					break;
+				case Cell::Tag::structure: {
+					Cell functor = runtime.heap[term.address()];
+					cells.push_back(functor);
+					for (int64_t i = functor.functor().parameters; i >= 1; -- i) {
+						terms.push(runtime.heap[term.address() + static_cast<std::size_t>(i)]);
+					}
+					break;
+				}
+				case Cell::Tag::empty:
+					throw RuntimeException("Tried to table a term with an unset cell.", __FILENAME__, __func__, __LINE__);
+				default:
+					cells.push_back(term);
+			}
+		}
+	}
+	
+	// Builds the term whose flattened cells start at the given position (which is advanced past them) into a cell of the heap.
+	// The variables already built for the answer are held in variables, by number.
+	static void build(Runtime& runtime, const std::vector<Cell>& cells, std::vector<Cell>::size_type& position, std::vector<Cell>& variables, HeapReference::heapIndex destination) {
+		std::stack<HeapReference::heapIndex> arguments;
+		arguments.push(destination);
+		while (!arguments.empty()) {
+			destination = arguments.top(); arguments.pop();
+			Cell cell = cells[position ++];
+			switch (cell.tag()) {
+				case Cell::Tag::reference:
+					// A variable is first met as the cell it is built into.
+					if (cell.address() == variables.size()) {
+						variables.push_back(Cell::reference(destination));
+					}
+					runtime.heap[destination] = variables[cell.address()];
+					break;
+				case Cell::Tag::functor: {
+					HeapReference::heapIndex functor = runtime.heap.size();
+					runtime.heap.push_back(cell);
+					int64_t parameters = cell.functor().parameters;
+					for (int64_t i = 1; i <= parameters; ++ i) {
+						runtime.heap.push_back(Cell());
+					}
+					for (int64_t i = parameters; i >= 1; -- i) {
+						arguments.push(functor + static_cast<HeapReference::heapIndex>(i));
+					}
+					runtime.heap[destination] = Cell::structure(functor);
+					break;
+				}
+				default:
+					runtime.heap[destination] = cell;
+			}
+		}
+	}
+	
+	bool Subgoal::add(Runtime& runtime, const Cell* arguments) {
+		std::vector<Cell> cells;
+		std::unordered_map<std::size_t, std::size_t> variables;
+		for (int64_t argument = 0; argument < parameters; ++ argument) {
+			flatten(runtime, arguments[argument], cells, variables);
+		}
+		auto leaf = trie.insert(cells);
+		if (leaf.second) {
+			answers.push_back(leaf.first);
+		}
+		return leaf.second;
+	}
+	
+	bool Subgoal::unify(Runtime& runtime, std::size_t answer) const {
+		std::vector<Cell> cells;
+		TermTrie::read(answers[answer], cells);
+		std::vector<Cell> variables;
+		std::vector<Cell>::size_type position = 0;
+		for (int64_t argument = 0; argument < parameters; ++ argument) {
+			HeapReference term(StorageArea::heap, runtime.heap.size());
+			runtime.heap.push_back(Cell());
+			build(runtime, cells, position, variables, term.index);
+			HeapReference reference(StorageArea::reg, static_cast<HeapReference::heapIndex>(argument));
+			if (!Epilog::unify(runtime, reference, term)) {
+				return false;
+			}
+		}
+		return true;
+	}
+	
+	std::shared_ptr<Subgoal> Tables::lookup(Runtime& runtime, SymbolTable::symbolIndex functor) {
+		int64_t parameters = SymbolTable::get(functor).parameters;
+		std::vector<Cell> cells { Cell::functor(functor) };
+		std::unordered_map<std::size_t, std::size_t> variables;
+		for (int64_t argument = 0; argument < parameters; ++ argument) {
+			flatten(runtime, runtime.registers[static_cast<HeapReference::heapIndex>(argument)], cells, variables);
+		}
+		auto leaf = calls.insert(cells);
+		if (leaf.second) {
+			leaf.first->value = subgoals.size();
+			subgoals.push_back(std::make_shared<Subgoal>(functor, parameters));
+		}
+		return subgoals[leaf.first->value];
+	}
+	
+	std::size_t Tables::follow(const Subgoal& subgoal) const {
+		if (subgoal.state == Subgoal::State::evaluating) {
+			return subgoal.evaluation;
+		}
+		// A subgoal that depends on an evaluation is only evaluated once by each of its passes: later calls within the pass are given the answers found by the first, and any they miss are found by the next pass.
+		if (subgoal.pass != 0 && subgoal.evaluation < evaluations.size() && evaluations[subgoal.evaluation].pass == subgoal.pass) {
+			return subgoal.evaluation;
+		}
+		return -1UL;
+	}
+	
+	Tables::Evaluation& Tables::begin(Runtime& runtime, std::shared_ptr<Subgoal> subgoal, Instruction::instructionReference entry, Instruction::instructionReference answers) {
+		Evaluation evaluation;
+		evaluation.subgoal = subgoal;
+		evaluation.entry = entry;
+		evaluation.answers = answers;
+		evaluation.choicePoint = runtime.topChoicePoint;
+		evaluation.serial = ++ serials;
+		evaluation.pass = evaluation.serial;
+		evaluation.leader = evaluations.size();
+		runtime.currentChoicePoint()->nextAlternative = evaluation.serial;
+		subgoal->state = Subgoal::State::evaluating;
+		subgoal->evaluation = evaluations.size();
+		evaluations.push_back(std::move(evaluation));
+		return evaluations.back();
+	}
+	
+	void Tables::depend(std::size_t position) {
+		// Every evaluation since the one depended on is part of the same group, which is completed by the oldest of their leaders.
+		std::size_t leader = evaluations[position].leader;
+		for (std::size_t i = position; i < evaluations.size(); ++ i) {
+			evaluations[i].leader = std::min(evaluations[i].leader, leader);
+		}
+		evaluations[leader].dependent = true;
+	}
+	
+	bool Tables::finish() {
+		Evaluation& evaluation = evaluations.back();
+		if (evaluation.leader == evaluations.size() - 1) {
+			if (evaluation.changed && evaluation.dependent) {
+				evaluation.changed = false;
+				evaluation.dependent = false;
+				evaluation.members.clear();
+				evaluation.pass = ++ serials;
+				return true;
+			}
+			evaluation.subgoal->state = Subgoal::State::complete;
+			for (std::shared_ptr<Subgoal>& member : evaluation.members) {
+				member->state = Subgoal::State::complete;
+			}
+		} else {
+			Evaluation& leader = evaluations[evaluation.leader];
+			leader.changed = leader.changed || evaluation.changed;
+			leader.members.push_back(evaluation.subgoal);
+			leader.members.insert(leader.members.end(), evaluation.members.begin(), evaluation.members.end());
+			evaluation.subgoal->state = Subgoal::State::incomplete;
+			evaluation.subgoal->evaluation = evaluation.leader;
+			evaluation.subgoal->pass = leader.pass;
+		}
+		evaluations.pop_back();
+		return false;
+	}
+	
+	void Tables::prune(Runtime& runtime) {
+		while (!evaluations.empty()) {
+			Evaluation& evaluation = evaluations.back();
+			if (runtime.topChoicePoint != -1UL && evaluation.choicePoint <= runtime.topChoicePoint) {
+				ChoicePoint* choicePoint = reinterpret_cast<ChoicePoint*>(&runtime.stateStack[evaluation.choicePoint]);
+				if (choicePoint->nextClause == runtime.code->next(evaluation.answers) && choicePoint->nextAlternative == evaluation.serial) {
+					return;
+				}
+			}
+			evaluation.subgoal->state = Subgoal::State::incomplete;
+			evaluations.pop_back();
+		}
+	}
+	
+	void Tables::reset() {
+		while (!evaluations.empty()) {
+			evaluations.back().subgoal->state = Subgoal::State::incomplete;
+			evaluations.pop_back();
+		}
+	}
+	
+	std::string Tables::toString() const {
+		std::size_t answers = 0;
+		for (const std::shared_ptr<Subgoal>& subgoal : subgoals) {
+			answers += subgoal->answers.size();
+		}
+		return std::to_string(subgoals.size()) + " subgoals, " + std::to_string(answers) + " answers";
+	}
+}
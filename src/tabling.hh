@@ -0,0 +1,120 @@
+#pragma once
+
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "runtime.hh"
+
+namespace Epilog {
+	// A trie of terms, each flattened into its cells in prefix order, in which unbound variables are numbered in the order in which they first appear.
+	// Terms that are variants of each other share a leaf.
+	class TermTrie {
+		public:
+		struct Node {
+			Cell cell;
+			const Node* parent;
+			std::unordered_map<Cell::word, std::unique_ptr<Node>> children;
+			// Set for the leaf of each sequence of cells that has been inserted.
+			bool leaf = false;
+			std::size_t value = 0;
+			
+			Node(Cell cell, const Node* parent) : cell(cell), parent(parent) { }
+		};
+		
+		TermTrie() : root(Cell(), nullptr) { }
+		
+		// Returns the leaf of a sequence of cells, and whether it was inserted, rather than already being held.
+		std::pair<Node*, bool> insert(const std::vector<Cell>& cells);
+		
+		// Appends the sequence of cells ending at a leaf.
+		static void read(const Node* leaf, std::vector<Cell>& cells);
+		
+		private:
+		Node root;
+	};
+	
+	// The answers found for a variant of a call to a tabled predicate.
+	struct Subgoal {
+		enum class State { incomplete, evaluating, complete };
+		
+		SymbolTable::symbolIndex functor;
+		int64_t parameters;
+		State state = State::incomplete;
+		// While evaluating, the position of the evaluation of the subgoal. Otherwise, the position of the evaluation whose pass last evaluated it, if it depends on one.
+		std::size_t evaluation = 0;
+		uint64_t pass = 0;
+		TermTrie trie;
+		// The leaf of each answer, in the order in which they were found.
+		std::vector<const TermTrie::Node*> answers;
+		
+		Subgoal(SymbolTable::symbolIndex functor, int64_t parameters) : functor(functor), parameters(parameters) { }
+		
+		// Adds the arguments of a solution as an answer, returning false if they are a variant of one that has already been found.
+		bool add(Runtime& runtime, const Cell* arguments);
+		
+		// Unifies the argument registers with an answer, whose terms are built on the heap.
+		bool unify(Runtime& runtime, std::size_t answer) const;
+	};
+	
+	// The tables of a runtime: the subgoals of every variant of a call to a tabled predicate that has been made, and the evaluations of those that are being completed.
+	// A subgoal is evaluated by running the clauses of its predicate to exhaustion, from a generator choice point, collecting each solution as an answer. Calls to a subgoal that is still being evaluated (as in left recursion) are given the answers found so far, so the clauses are run again until no more are found, once every subgoal they depend on has been evaluated.
+	// Subgoals that depend on each other are completed together, by the oldest of their evaluations (the leader).
+	class Tables {
+		public:
+		struct Evaluation {
+			std::shared_ptr<Subgoal> subgoal;
+			// The clauses of the predicate, and the retry_answer instruction following the table instruction that called it, which is followed by complete_table and new_answer.
+			Instruction::instructionReference entry;
+			Instruction::instructionReference answers;
+			// The generator choice point, which is recognised by the serial number held in place of its next alternative, as it may have been discarded (by a catch) since.
+			StateReference::stateIndex choicePoint;
+			uint64_t serial;
+			// The number of the current pass of the clauses.
+			uint64_t pass;
+			// The position of the oldest evaluation on which this one depends.
+			std::size_t leader;
+			// Set if an answer has been found by this pass, and if a call within it was given the answers of a subgoal still being evaluated.
+			bool changed = false;
+			bool dependent = false;
+			// The subgoals evaluated within this pass that depend on this evaluation, which are completed along with it.
+			std::vector<std::shared_ptr<Subgoal>> members;
+		};
+		
+		// The number of times the program had been linked when the tables were created. As any predicate may have changed since, they are discarded once it is linked again.
+		uint64_t links;
+		
+		std::vector<Evaluation> evaluations;
+		
+		Tables(uint64_t links) : links(links) { }
+		
+		// Returns the subgoal of a call with the given argument registers, creating it if no variant of the call has been made.
+		std::shared_ptr<Subgoal> lookup(Runtime& runtime, SymbolTable::symbolIndex functor);
+		
+		// Returns the position of the evaluation whose answers a call to an incomplete subgoal should be given, or -1UL if the subgoal should be evaluated.
+		std::size_t follow(const Subgoal& subgoal) const;
+		
+		// Starts evaluating a subgoal, whose generator choice point is the top choice point of the runtime.
+		Evaluation& begin(Runtime& runtime, std::shared_ptr<Subgoal> subgoal, Instruction::instructionReference entry, Instruction::instructionReference answers);
+		
+		// Records that the current evaluation was given the answers of the evaluation at the given position, so that they are completed together.
+		void depend(std::size_t position);
+		
+		// Ends the current pass of the innermost evaluation. Returns true if its clauses must be run again, as answers were found after a call that depended on them.
+		// Otherwise, the evaluation is removed: its subgoal is completed if it leads, and is otherwise left to be completed by its leader.
+		bool finish();
+		
+		// Discards any evaluation whose generator choice point has been discarded, leaving its subgoal incomplete.
+		void prune(Runtime& runtime);
+		
+		// Discards every evaluation, as when execution is restarted.
+		void reset();
+		
+		std::string toString() const;
+		
+		private:
+		TermTrie calls;
+		std::vector<std::shared_ptr<Subgoal>> subgoals;
+		uint64_t serials = 0;
+	};
+}
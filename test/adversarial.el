@@ -0,0 +1,51 @@
+% Clauses that probe the edges of the grammar, each of which Parser::Reader must read as EpilogGrammar does, whether or not it is valid.
+% Layout and comments between tokens.
+p ( a , b ) .
+p(a /* a block comment, with a . in it */, b).
+p(a, % a line comment
+	b).
+/* A comment before a clause. */ q.
+% Empty parameters, and none.
+r().
+r.
+% Operators and the empty list as names.
+ops(=<, =>, <, >, ., +, -, *, /, =).
+'='(X, Y) :- =(X, Y).
+e([]).
+% Numbers.
+n(0, 42, -7, 007).
+% Quoted atoms, with and without redundant quotes, and escaped quotes.
+a('simple', 'Upper', 'with space', ' leading', 'it\'s', '[]', '<', '123').
+% Variables, including anonymous ones, which are numbered as they are read.
+v(X, _, Y_1, _).
+% Lists and strings.
+l([a], [a, b | T], [[a], [b | []]], [X | Y]).
+s("text", " padded ", "quote \" inside", "").
+% Rules, queries and modifiers.
+rule(X) :- \+ p(X), \:q(X), r.
+?- rule(a), \+r.
+?-p(a).
+% Directives.
+:- table path/2.
+:- table p/1, 'quoted'/0.
+:- load_csv('edges.tsv', edge/2).
+:-load_csv(edges, edge/2).
+% Several clauses with no layout between them.
+p(a).q(b).
+% Invalid clauses, which both must reject.
+P(a).
+p(,).
+p(a,).
+p(a b).
+p(- 1).
+p(__).
+v(_Named).
+p([]]).
+p([a|]).
+p([ ]).
+p(a) :- .
+?- .
+:- tabled p/1.
+:- table p.
+:- load_csv(edges.tsv, edge/2).
+p(a) q.
@@ -0,0 +1,4 @@
+% Run with --and-parallel: the conjunction fails at its first goal, as it does when its goals are run in turn, even though its second goal never finishes.
+never :- fail.
+loop :- loop.
+?- never, loop.
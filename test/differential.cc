@@ -0,0 +1,72 @@
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include "../src/consult.hh"
+#include "../src/parser.hh"
+#include "../src/reader.hh"
+
+using namespace Epilog;
+
+// Parses text with both Parser::Reader and the Pegmatite grammar it replaces, returning false (having reported how) if they disagree on whether it is valid, or on the syntax tree it is read into.
+static bool compare(Parser::EpilogParser& reference, const std::string& text, const std::string& source) {
+	// Anonymous variables are numbered as they are read, so each parser numbers them from the same start.
+	AST::anonymousIndex = 0;
+	std::string error;
+	std::size_t line;
+	std::unique_ptr<AST::Clauses> read = Parser::Reader().read(text, error, line);
+	
+	AST::anonymousIndex = 0;
+	std::unique_ptr<AST::Clauses> parsed;
+	pegmatite::StringInput input(text);
+	auto report = [] (const pegmatite::InputRange&, const std::string&) { };
+	if (!reference.parse(input, reference.grammar.clauses, reference.grammar.ignored, report, parsed)) {
+		parsed = nullptr;
+	}
+	
+	if ((read == nullptr) != (parsed == nullptr)) {
+		std::cerr << source << ": the " << (read == nullptr ? "reader" : "grammar") << " rejects what the " << (read == nullptr ? "grammar" : "reader") << " accepts" << (read == nullptr ? " (" + error + ")" : std::string()) << ":" << std::endl << text << std::endl;
+		return false;
+	}
+	if (read != nullptr && read->toString() != parsed->toString()) {
+		std::cerr << source << ": the reader and the grammar disagree on" << std::endl << text << std::endl << "reader:" << std::endl << read->toString() << "grammar:" << std::endl << parsed->toString();
+		return false;
+	}
+	return true;
+}
+
+// Checks that Parser::Reader reads each of the given programs as the Pegmatite grammar does: the whole of each, and each of its clauses on its own, as they are read when consulting, so that every clause of a file of invalid clauses is checked.
+int main(int argc, char* argv[]) {
+	if (argc < 2) {
+		std::cerr << "usage: " << argv[0] << " <file>..." << std::endl;
+		return EXIT_FAILURE;
+	}
+	Parser::EpilogParser reference;
+	bool agreed = true;
+	for (int i = 1; i < argc; ++ i) {
+		std::ifstream file(argv[i], std::ios::binary);
+		if (!file) {
+			std::cerr << "Could not read " << argv[i] << "." << std::endl;
+			return EXIT_FAILURE;
+		}
+		std::stringstream text;
+		text << file.rdbuf();
+		agreed = compare(reference, text.str(), argv[i]) && agreed;
+		
+		int descriptor = open(argv[i], O_RDONLY);
+		if (descriptor == -1) {
+			std::cerr << "Could not read " << argv[i] << "." << std::endl;
+			return EXIT_FAILURE;
+		}
+		ClauseStream stream(descriptor);
+		std::string clause;
+		while (stream.next(clause)) {
+			agreed = compare(reference, clause, std::string(argv[i]) + ":" + std::to_string(stream.firstLine())) && agreed;
+		}
+		close(descriptor);
+	}
+	return agreed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
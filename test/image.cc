@@ -0,0 +1,84 @@
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include "../src/consult.hh"
+#include "../src/image.hh"
+#include "../src/interpreter.hh"
+
+using namespace Epilog;
+
+// Loads an image into a runtime with no code, as when a program is run from its cache.
+static bool load(const std::string& path) {
+	Runtime runtime;
+	Runtime::currentRuntime = &runtime;
+	Image image;
+	return image.load(path);
+}
+
+// Checks that an image whose labels have been corrupted is treated as stale (so that the program is compiled again), rather than being loaded and jumping into the middle of an instruction.
+int main(int argc, char* argv[]) {
+	if (argc != 3) {
+		std::cerr << "usage: " << argv[0] << " <file> <image>" << std::endl;
+		return EXIT_FAILURE;
+	}
+	try {
+		Runtime runtime;
+		Runtime::currentRuntime = &runtime;
+		Interpreter::Context context;
+		Image image;
+		context.image = &image;
+		int file = open(argv[1], O_RDONLY);
+		bool succeeded;
+		if (file == -1 || !consult(nullptr, file, context, succeeded)) {
+			std::cerr << "Could not consult " << argv[1] << "." << std::endl;
+			return EXIT_FAILURE;
+		}
+		close(file);
+		image.save(argv[2]);
+		if (!load(argv[2])) {
+			std::cerr << "The image of " << argv[1] << " was not loaded." << std::endl;
+			return EXIT_FAILURE;
+		}
+		
+		std::vector<Image::word> words;
+		{
+			std::ifstream saved(argv[2], std::ios::binary);
+			Image::word word;
+			while (saved.read(reinterpret_cast<char*>(&word), sizeof(word))) {
+				words.push_back(word);
+			}
+		}
+		// The code follows the magic number, the version, the number of registers and the symbols (each its number of parameters, the length of its name and the name itself).
+		std::size_t position = 3;
+		for (Image::word symbols = words.at(position ++); symbols > 0; -- symbols) {
+			Image::word length = words.at(position + 1);
+			position += 2 + (length + sizeof(Image::word) - 1) / sizeof(Image::word);
+		}
+		Image::word size = words.at(position ++);
+		// The label of the first clause-chaining instruction is pointed at its own operand.
+		Instruction::instructionReference address = 0;
+		while (address < size && static_cast<Opcode>(words.at(position + address)) != Opcode::try_me_else) {
+			address += 1 + Bytecode::operands[words.at(position + address)];
+		}
+		if (address >= size) {
+			std::cerr << "The image of " << argv[1] << " has no clause-chaining instruction." << std::endl;
+			return EXIT_FAILURE;
+		}
+		words.at(position + address + 1) = address + 1;
+		{
+			std::ofstream corrupted(argv[2], std::ios::binary | std::ios::trunc);
+			corrupted.write(reinterpret_cast<const char*>(words.data()), static_cast<std::streamsize>(words.size() * sizeof(Image::word)));
+		}
+		if (load(argv[2])) {
+			std::cerr << "The corrupted image of " << argv[1] << " was loaded." << std::endl;
+			return EXIT_FAILURE;
+		}
+	} catch (const Epilog::Exception& exception) {
+		exception.print();
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,5 @@
+% Saved in an image by the image test, which checks that the image is compiled again once a label of its clause chain is corrupted.
+colour(red).
+colour(green).
+colour(blue).
+?- colour(blue).
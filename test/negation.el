@@ -0,0 +1,13 @@
+% Run with --datalog: an anonymous variable of a negated goal is existentially quantified, rather than needing to be bound.
+edge(a, b).
+edge(b, c).
+edge(c, a).
+edge(c, d).
+node(a).
+node(b).
+node(c).
+node(d).
+node(e).
+sink(X) :- node(X), \+ edge(X, _).
+?- sink(X).
+?- node(X), \+ edge(_, X).